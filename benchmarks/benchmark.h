@@ -0,0 +1,76 @@
+#ifndef BENCHMARK_H
+#define	BENCHMARK_H
+
+#include <chrono>
+#include <functional>
+#include <string>
+
+#include "UnitTest++/UnitTestPP.h"
+
+using namespace std;
+
+// A benchmark is a UnitTest++ test whose body returns one measurement (ns
+// per call, vertices per second, ...). Every parameter combination is
+// registered as its own test, so each shows up with its pass/fail state in
+// the XML report, and the measurements go to the CSV report. The body may
+// use the CHECK macros to validate what it measured.
+//
+// Measurements are compared against an optional baseline; if one got worse
+// by more than the tolerance, the benchmark fails.
+class Benchmark : public UnitTest::Test
+{
+public:
+    // HigherIsBetter for throughputs, false for times
+    Benchmark(const char* pSuite, const string& Name, const char* pUnit, bool HigherIsBetter,
+              const function<double()>& Body);
+
+    virtual void RunImpl() const;
+
+private:
+    const char* m_pUnit;
+    bool m_HigherIsBetter;
+    function<double()> m_Body;
+};
+
+class Stopwatch
+{
+public:
+    Stopwatch()
+    {
+        m_Start = chrono::steady_clock::now();
+    }
+
+    double ElapsedNs() const
+    {
+        return chrono::duration<double, nano>(chrono::steady_clock::now() - m_Start).count();
+    }
+
+private:
+    chrono::steady_clock::time_point m_Start;
+};
+
+// Registers a benchmark with UnitTest++'s global test list
+void AddBenchmark(const char* pSuite, const string& Name, const char* pUnit, bool HigherIsBetter,
+                  const function<double()>& Body);
+
+// Scales iteration counts, below 1 with --quick (smoke runs, e.g. ctest)
+double BenchmarkScale();
+
+// Count * BenchmarkScale(), at least 1
+unsigned ScaledIterations(unsigned Count);
+
+// Runs every benchmark file's registration function from main
+struct BenchmarkRegistrar
+{
+    explicit BenchmarkRegistrar(void (*pRegister)());
+};
+
+// Benchmarks for the model files given on the command line
+void RegisterModelBenchmarks(const string& Filename);
+
+class Scene;
+
+// ns per Scene::BoneTransform call, sampling 60 fps playback
+double TimeBoneTransform(const Scene& S);
+
+#endif	/* BENCHMARK_H */
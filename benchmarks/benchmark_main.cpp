@@ -0,0 +1,248 @@
+// Runs the animation benchmarks.
+//
+// usage: animation_benchmarks [--quick] [--xml FILE] [--csv FILE]
+//                             [--baseline FILE] [--tolerance T]
+//                             [--max-ms N] [--suite NAME] [model files...]
+//
+//   --quick       cut iteration counts down (smoke runs)
+//   --xml FILE    UnitTest++ XML report, one test per benchmark
+//   --csv FILE    measurements as suite,name,value,unit
+//   --baseline    a CSV report of an earlier run; a benchmark fails when
+//                 its measurement got worse by more than the tolerance
+//   --tolerance   allowed relative regression, 0.25 by default
+//   --max-ms      fail any benchmark running longer than N ms
+//   --suite       only run one suite
+//   model files   also benchmark these (e.g. boblampclean.md5mesh)
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fstream>
+#include <list>
+#include <map>
+#include <sstream>
+#include <vector>
+
+#include "UnitTest++/TestReporterStdout.h"
+#include "UnitTest++/XmlTestReporter.h"
+
+#include "benchmark.h"
+
+struct BenchmarkResult
+{
+    string Suite;
+    string Name;
+    double Value;
+    string Unit;
+};
+
+static double s_Scale = 1.0;
+static double s_Tolerance = 0.25;
+static map<string,double> s_Baseline;
+static vector<BenchmarkResult> s_Results;
+static vector<void (*)()>* s_pRegistrations = NULL;
+
+// UnitTest++ keeps the test names as char pointers
+static const char* StoreName(const string& Name)
+{
+    static list<string> Names;
+    Names.push_back(Name);
+    return Names.back().c_str();
+}
+
+
+static string ResultKey(const string& Suite, const string& Name)
+{
+    return Suite + "/" + Name;
+}
+
+
+Benchmark::Benchmark(const char* pSuite, const string& Name, const char* pUnit, bool HigherIsBetter,
+                     const function<double()>& Body)
+    : UnitTest::Test(StoreName(Name), pSuite, __FILE__, 0)
+{
+    m_pUnit          = pUnit;
+    m_HigherIsBetter = HigherIsBetter;
+    m_Body           = Body;
+}
+
+
+void Benchmark::RunImpl() const
+{
+    BenchmarkResult Result;
+    Result.Suite = m_details.suiteName;
+    Result.Name  = m_details.testName;
+    Result.Value = m_Body();
+    Result.Unit  = m_pUnit;
+    s_Results.push_back(Result);
+
+    printf("%-18s %-36s %12.3f %s\n", Result.Suite.c_str(), Result.Name.c_str(), Result.Value, m_pUnit);
+
+    map<string,double>::const_iterator it = s_Baseline.find(ResultKey(Result.Suite, Result.Name));
+
+    if (it != s_Baseline.end()) {
+        const double Limit = m_HigherIsBetter ? it->second * (1.0 - s_Tolerance) : it->second * (1.0 + s_Tolerance);
+        const bool Regressed = m_HigherIsBetter ? Result.Value < Limit : Result.Value > Limit;
+
+        if (Regressed) {
+            UnitTest::MemoryOutStream Message;
+            Message << "Regression: " << Result.Value << " " << m_pUnit << ", baseline " << it->second;
+            UnitTest::CurrentTest::Results()->OnTestFailure(m_details, Message.GetText());
+        }
+    }
+}
+
+
+void AddBenchmark(const char* pSuite, const string& Name, const char* pUnit, bool HigherIsBetter,
+                  const function<double()>& Body)
+{
+    UnitTest::Test::GetTestList().Add(new Benchmark(pSuite, Name, pUnit, HigherIsBetter, Body));
+}
+
+
+double BenchmarkScale()
+{
+    return s_Scale;
+}
+
+
+unsigned ScaledIterations(unsigned Count)
+{
+    const unsigned Scaled = (unsigned)(Count * s_Scale);
+    return Scaled > 0 ? Scaled : 1;
+}
+
+
+// Registration runs from main, after the command line has been parsed,
+// because the benchmark parameters depend on it
+BenchmarkRegistrar::BenchmarkRegistrar(void (*pRegister)())
+{
+    if (!s_pRegistrations) {
+        s_pRegistrations = new vector<void (*)()>;
+    }
+    s_pRegistrations->push_back(pRegister);
+}
+
+
+static bool LoadBaseline(const string& Filename)
+{
+    ifstream In(Filename.c_str());
+
+    if (!In) {
+        return false;
+    }
+
+    string Line;
+    getline(In, Line);  // header
+
+    while (getline(In, Line)) {
+        stringstream Fields(Line);
+        string Suite, Name, Value;
+
+        if (getline(Fields, Suite, ',') && getline(Fields, Name, ',') && getline(Fields, Value, ',')) {
+            s_Baseline[ResultKey(Suite, Name)] = atof(Value.c_str());
+        }
+    }
+
+    return true;
+}
+
+
+static bool WriteCsv(const string& Filename)
+{
+    ofstream Out(Filename.c_str());
+    Out << "suite,name,value,unit\n";
+
+    for (unsigned i = 0 ; i < s_Results.size() ; i++) {
+        const BenchmarkResult& r = s_Results[i];
+        Out << r.Suite << "," << r.Name << "," << r.Value << "," << r.Unit << "\n";
+    }
+
+    return Out.good();
+}
+
+
+struct InSuite
+{
+    const char* pSuite;
+
+    bool operator()(const UnitTest::Test* const pTest) const
+    {
+        return pSuite == NULL || strcmp(pTest->m_details.suiteName, pSuite) == 0;
+    }
+};
+
+
+int main(int argc, char* argv[])
+{
+    string XmlFilename, CsvFilename;
+    const char* pSuite = NULL;
+    int MaxTestTimeMs = 0;
+    vector<string> Models;
+
+    for (int i = 1 ; i < argc ; i++) {
+        const string Arg = argv[i];
+        const bool HasValue = i + 1 < argc;
+
+        if (Arg == "--quick") {
+            s_Scale = 0.05;
+        }
+        else if (Arg == "--xml" && HasValue) {
+            XmlFilename = argv[++i];
+        }
+        else if (Arg == "--csv" && HasValue) {
+            CsvFilename = argv[++i];
+        }
+        else if (Arg == "--baseline" && HasValue) {
+            if (!LoadBaseline(argv[++i])) {
+                printf("Unable to read baseline '%s'\n", argv[i]);
+                return 1;
+            }
+        }
+        else if (Arg == "--tolerance" && HasValue) {
+            s_Tolerance = atof(argv[++i]);
+        }
+        else if (Arg == "--max-ms" && HasValue) {
+            MaxTestTimeMs = atoi(argv[++i]);
+        }
+        else if (Arg == "--suite" && HasValue) {
+            pSuite = argv[++i];
+        }
+        else if (Arg.compare(0, 2, "--") != 0) {
+            Models.push_back(Arg);
+        }
+        else {
+            printf("Unknown option '%s'\n", Arg.c_str());
+            return 1;
+        }
+    }
+
+    for (unsigned i = 0 ; s_pRegistrations && i < s_pRegistrations->size() ; i++) {
+        (*s_pRegistrations)[i]();
+    }
+
+    for (unsigned i = 0 ; i < Models.size() ; i++) {
+        RegisterModelBenchmarks(Models[i]);
+    }
+
+    InSuite Predicate = { pSuite };
+    int Failures;
+
+    if (!XmlFilename.empty()) {
+        ofstream Xml(XmlFilename.c_str());
+        UnitTest::XmlTestReporter Reporter(Xml);
+        UnitTest::TestRunner Runner(Reporter);
+        Failures = Runner.RunTestsIf(UnitTest::Test::GetTestList(), NULL, Predicate, MaxTestTimeMs);
+    }
+    else {
+        UnitTest::TestReporterStdout Reporter;
+        UnitTest::TestRunner Runner(Reporter);
+        Failures = Runner.RunTestsIf(UnitTest::Test::GetTestList(), NULL, Predicate, MaxTestTimeMs);
+    }
+
+    if (!CsvFilename.empty() && !WriteCsv(CsvFilename)) {
+        printf("Unable to write '%s'\n", CsvFilename.c_str());
+        return 1;
+    }
+
+    return Failures;
+}
@@ -0,0 +1,85 @@
+// Animation clip compression: size reduction at the default tolerances,
+// compression time and the cost of decoding while sampling
+#include <stdio.h>
+#include <memory>
+
+#include "benchmark.h"
+#include "scene.h"
+#include "synthetic_scene.h"
+
+static shared_ptr<Scene> LoadSyntheticSkeleton(uint NumBones, uint NumKeys, bool Compress)
+{
+    unique_ptr<aiScene> pScene(CreateSyntheticScene(NumBones, NumKeys, 4 * NumBones));
+    shared_ptr<Scene> pSkeleton(new Scene);
+    pSkeleton->LoadSkeleton(pScene.get());
+
+    if (Compress) {
+        CHECK(pSkeleton->CompressAnimations(ClipCompressionSettings()));
+    }
+
+    return pSkeleton;
+}
+
+
+// Uncompressed size over compressed size
+static double CompressionRatio(uint NumBones, uint NumKeys)
+{
+    shared_ptr<Scene> pRaw = LoadSyntheticSkeleton(NumBones, NumKeys, false);
+    AnimationClip Clip = pRaw->Animation(0);
+
+    const ClipCompressionSettings Settings;
+    CHECK(CompressAnimationClip(Clip, Settings));
+
+    // Key reduction stays within the tolerances at the source keys, the
+    // slack is for interpolating between them
+    const ClipCompressionError Error = MeasureCompressionError(pRaw->Animation(0), Clip);
+    CHECK(Error.Position <= Settings.PositionTolerance * 1.5f);
+    CHECK(Error.Rotation <= Settings.RotationTolerance * 1.5f);
+    CHECK(Error.Scaling <= Settings.ScalingTolerance * 1.5f);
+
+    return double(pRaw->Animation(0).RawSize()) / Clip.Compressed.Size();
+}
+
+
+// ms per clip
+static double TimeCompression(uint NumBones, uint NumKeys)
+{
+    shared_ptr<Scene> pRaw = LoadSyntheticSkeleton(NumBones, NumKeys, false);
+    const uint Iterations = ScaledIterations(10);
+    Stopwatch Timer;
+
+    for (uint i = 0 ; i < Iterations ; i++) {
+        AnimationClip Clip = pRaw->Animation(0);
+        CompressAnimationClip(Clip, ClipCompressionSettings());
+    }
+
+    return Timer.ElapsedNs() * 1e-6 / Iterations;
+}
+
+
+static void RegisterCompressionBenchmarks()
+{
+    char Name[64];
+    const uint Bones[] = { 32, 128 };
+    const uint Keys[] = { 30, 3000 };
+
+    for (uint i = 0 ; i < sizeof(Bones) / sizeof(Bones[0]) ; i++) {
+        for (uint j = 0 ; j < sizeof(Keys) / sizeof(Keys[0]) ; j++) {
+            const uint NumBones = Bones[i], NumKeys = Keys[j];
+
+            snprintf(Name, sizeof(Name), "bones=%u keys=%u ratio", NumBones, NumKeys);
+            AddBenchmark("ClipCompression", Name, "x", true, [=]() { return CompressionRatio(NumBones, NumKeys); });
+
+            snprintf(Name, sizeof(Name), "bones=%u keys=%u compress", NumBones, NumKeys);
+            AddBenchmark("ClipCompression", Name, "ms/clip", false, [=]() { return TimeCompression(NumBones, NumKeys); });
+
+            // Compare with BoneTransform of the same skeleton
+            snprintf(Name, sizeof(Name), "bones=%u keys=%u sample", NumBones, NumKeys);
+            AddBenchmark("ClipCompression", Name, "ns/call", false, [=]() {
+                return TimeBoneTransform(*LoadSyntheticSkeleton(NumBones, NumKeys, true));
+            });
+        }
+    }
+}
+
+static BenchmarkRegistrar s_Registrar(RegisterCompressionBenchmarks);
@@ -0,0 +1,165 @@
+// Frustum culling: throughput of the box test, scalar against SSE kernel,
+// and the cost and coverage of the skinned bounds it is fed with
+#include <math.h>
+#include <stdio.h>
+#include <memory>
+#include <vector>
+
+#define GLM_FORCE_RADIANS
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "benchmark.h"
+#include "cpu_skinning.h"
+#include "synthetic_scene.h"
+
+// Boxes scattered around the origin with a camera looking at it, so that
+// some are inside, some outside and some cross the planes
+static void CreateBoxes(uint NumBoxes, vector<BoundingBox>& Boxes)
+{
+    unsigned int Seed = 12345;
+    auto Random = [&Seed]() {
+        Seed = Seed * 1664525u + 1013904223u;
+        return (Seed >> 8) * (1.0f / 16777216.0f);
+    };
+
+    Boxes.resize(NumBoxes);
+
+    for (uint i = 0 ; i < NumBoxes ; i++) {
+        const aiVector3D Center(200.0f * Random() - 100.0f, 200.0f * Random() - 100.0f, 200.0f * Random() - 100.0f);
+        const aiVector3D Extent(5.0f * Random(), 5.0f * Random(), 5.0f * Random());
+
+        Boxes[i].Min = Center - Extent;
+        Boxes[i].Max = Center + Extent;
+    }
+
+    // A few empty ones, never visible
+    for (uint i = 0 ; i < NumBoxes ; i += 97) {
+        Boxes[i] = BoundingBox();
+    }
+}
+
+
+static Frustum CreateFrustum()
+{
+    const glm::mat4 Projection = glm::perspective(glm::radians(60.0f), 4.0f / 3.0f, 1.0f, 150.0f);
+    const glm::mat4 View = glm::lookAt(glm::vec3(0.0f, 20.0f, 80.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+
+    return Frustum(Projection * View);
+}
+
+
+// Boxes per second
+static double TimeCulling(uint NumBoxes, bool Simd)
+{
+    vector<BoundingBox> Boxes;
+    CreateBoxes(NumBoxes, Boxes);
+
+    const Frustum View = CreateFrustum();
+    vector<unsigned char> Visible(NumBoxes);
+
+    const uint Passes = ScaledIterations(max(50000000 / NumBoxes, 2u));
+    uint NumVisible = 0;
+    Stopwatch Timer;
+
+    for (uint i = 0 ; i < Passes ; i++) {
+        NumVisible = CullBoxes(View, &Boxes[0], NumBoxes, &Visible[0], Simd);
+    }
+
+    const double BoxesPerSecond = double(Passes) * NumBoxes / (Timer.ElapsedNs() * 1e-9);
+
+    // Both kernels have to agree, and something has to be on either side
+    vector<unsigned char> Expected(NumBoxes);
+    CHECK_EQUAL(NumVisible, CullBoxes(View, &Boxes[0], NumBoxes, &Expected[0], false));
+    CHECK(Visible == Expected);
+    CHECK(NumVisible > 0 && NumVisible < NumBoxes);
+
+    return BoxesPerSecond;
+}
+
+
+// Instances per second for SkinnedBounds, checking on a few poses that the
+// boxes hold every vertex as skinned on the CPU
+static double TimeSkinnedBounds(uint NumBones, uint NumVertices, uint NumMeshes)
+{
+    unique_ptr<aiScene> pScene(CreateSyntheticScene(NumBones, 30, NumVertices, NumMeshes));
+
+    Scene S;
+    S.SetKeepVertices(true);
+    S.LoadSkeleton(pScene.get());
+
+    AnimationInstance Instance;
+    S.InitInstance(Instance);
+
+    vector<AffineMatrix> Palette(S.NumBones());
+    vector<BoundingBox> Bounds(S.NumEntries());
+
+    // The boxes of the entries are only told apart with a single mesh
+    if (NumMeshes == 1) {
+        CpuSkinning Skinning;
+        Skinning.Init(&S.Vertices()[0], S.Vertices().size());
+
+        ThreadPool Pool(0);
+        vector<CpuSkinnedVertex> Skinned(S.Vertices().size());
+
+        for (uint Pose = 0 ; Pose < 4 ; Pose++) {
+            S.BoneTransform(Instance, 0.3f * Pose, &Palette[0]);
+            S.SkinnedBounds(Instance, &Bounds[0]);
+            Skinning.Skin(&Palette[0], &Skinned[0], Pool);
+
+            uint Outside = 0;
+
+            for (uint i = 0 ; i < Skinned.size() ; i++) {
+                for (uint k = 0 ; k < 3 ; k++) {
+                    const float Epsilon = 1e-4f * (1.0f + fabsf(Skinned[i].Position[k]));
+                    Outside += Skinned[i].Position[k] < Bounds[0].Min[k] - Epsilon ||
+                               Skinned[i].Position[k] > Bounds[0].Max[k] + Epsilon;
+                }
+            }
+            CHECK_EQUAL(0u, Outside);
+        }
+    }
+    else {
+        S.BoneTransform(Instance, 0.5f, &Palette[0]);
+    }
+
+    const uint Iterations = ScaledIterations(100000);
+    Stopwatch Timer;
+
+    for (uint i = 0 ; i < Iterations ; i++) {
+        S.SkinnedBounds(Instance, &Bounds[0]);
+    }
+
+    return Iterations / (Timer.ElapsedNs() * 1e-9);
+}
+
+
+static void RegisterCullingBenchmarks()
+{
+    char Name[64];
+    const uint Boxes[] = { 1000, 100000 };
+
+    for (uint i = 0 ; i < sizeof(Boxes) / sizeof(Boxes[0]) ; i++) {
+        const uint NumBoxes = Boxes[i];
+
+        for (uint Simd = 0 ; Simd < 2 ; Simd++) {
+#ifndef POSE_MATH_SIMD
+            if (Simd) {
+                continue;
+            }
+#endif
+            snprintf(Name, sizeof(Name), "boxes=%u %s", NumBoxes, Simd ? "sse" : "scalar");
+            AddBenchmark("Culling", Name, "boxes/s", true, [=]() { return TimeCulling(NumBoxes, Simd); });
+        }
+    }
+
+    const uint Meshes[] = { 1, 8 };
+
+    for (uint i = 0 ; i < sizeof(Meshes) / sizeof(Meshes[0]) ; i++) {
+        const uint NumMeshes = Meshes[i];
+
+        snprintf(Name, sizeof(Name), "bones=64 meshes=%u skinned bounds", NumMeshes);
+        AddBenchmark("Culling", Name, "instances/s", true, [=]() { return TimeSkinnedBounds(64, 20000, NumMeshes); });
+    }
+}
+
+static BenchmarkRegistrar s_Registrar(RegisterCullingBenchmarks);
@@ -0,0 +1,95 @@
+// Import throughput: converting an imported scene into the Scene's runtime
+// data, and for model files given on the command line the whole Assimp
+// import plus pose evaluation
+#include <stdio.h>
+#include <memory>
+
+#include "benchmark.h"
+#include "scene.h"
+#include "synthetic_scene.h"
+
+// Vertices per second through Scene::LoadSkeleton, which runs the same
+// conversion as LoadMesh minus the GL upload
+static double TimeConversion(uint NumBones, uint NumVertices, uint NumMeshes)
+{
+    unique_ptr<aiScene> pScene(CreateSyntheticScene(NumBones, 30, NumVertices, NumMeshes));
+
+    const uint Loads = ScaledIterations(max(2000000 / NumVertices, 2u));
+    ThreadPool Pool;
+    Stopwatch Timer;
+
+    for (uint i = 0 ; i < Loads ; i++) {
+        Scene S;
+        S.SetImportPool(&Pool);
+        S.LoadSkeleton(pScene.get());
+        CHECK_EQUAL(NumBones, S.NumBones());
+    }
+
+    return double(Loads) * NumVertices / (Timer.ElapsedNs() * 1e-9);
+}
+
+
+static void RegisterImportBenchmarks()
+{
+    char Name[64];
+    const uint Vertices[] = { 10000, 100000 };
+
+    for (uint i = 0 ; i < sizeof(Vertices) / sizeof(Vertices[0]) ; i++) {
+        const uint NumVertices = Vertices[i];
+
+        snprintf(Name, sizeof(Name), "bones=64 vertices=%u", NumVertices);
+        AddBenchmark("Import", Name, "vertices/s", true, [=]() { return TimeConversion(64, NumVertices, 1); });
+    }
+
+    // Assets split into many submeshes are flattened in parallel
+    snprintf(Name, sizeof(Name), "bones=64 vertices=100000 meshes=128");
+    AddBenchmark("Import", Name, "vertices/s", true, [=]() { return TimeConversion(64, 100000, 128); });
+}
+
+static BenchmarkRegistrar s_Registrar(RegisterImportBenchmarks);
+
+
+// ms per import of Filename, from file to Scene
+static double TimeModelImport(const string& Filename)
+{
+    const uint Loads = ScaledIterations(10);
+    Stopwatch Timer;
+
+    for (uint i = 0 ; i < Loads ; i++) {
+        Assimp::Importer Importer;
+        const aiScene* pScene = Importer.ReadFile(Filename.c_str(), aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs);
+        CHECK(pScene != NULL);
+
+        if (!pScene) {
+            return 0.0;
+        }
+
+        Scene S;
+        S.LoadSkeleton(pScene);
+    }
+
+    return Timer.ElapsedNs() * 1e-6 / Loads;
+}
+
+
+void RegisterModelBenchmarks(const string& Filename)
+{
+    const string::size_type Slash = Filename.find_last_of("/\\");
+    const string BaseName = Slash == string::npos ? Filename : Filename.substr(Slash + 1);
+
+    AddBenchmark("Import", BaseName, "ms/import", false, [=]() { return TimeModelImport(Filename); });
+
+    AddBenchmark("BoneTransform", BaseName, "ns/call", false, [=]() {
+        Assimp::Importer Importer;
+        const aiScene* pScene = Importer.ReadFile(Filename.c_str(), aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs);
+        CHECK(pScene != NULL);
+
+        if (!pScene) {
+            return 0.0;
+        }
+
+        Scene S;
+        S.LoadSkeleton(pScene);
+        return TimeBoneTransform(S);
+    });
+}
@@ -0,0 +1,131 @@
+// Keyframe search: the linear scan Scene used originally against the
+// cursor search of FindKey, for playback and random seeks
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <vector>
+
+#include "animation.h"
+#include "benchmark.h"
+
+#define NUM_CHANNELS 64
+#define NUM_SAMPLES 2000   // per round, fewer with --quick
+
+// The search Scene used before keyframe cursors: a scan from the first key
+static uint FindKeyLinear(const float* pTimes, uint NumKeys, float Time)
+{
+    for (uint i = 0 ; i < NumKeys - 1 ; i++) {
+        if (Time < pTimes[i + 1]) {
+            return i;
+        }
+    }
+    return NumKeys - 2;
+}
+
+
+struct KeyframeData
+{
+    vector<vector<float> > Channels;
+    vector<float> SampleTimes;
+};
+
+
+static void InitKeyframeData(uint NumKeys, bool Seek, KeyframeData& Data)
+{
+    // One key per tick with a little jitter so channels don't share a timeline
+    srand(NumKeys);
+    Data.Channels.assign(NUM_CHANNELS, vector<float>(NumKeys));
+
+    for (uint j = 0 ; j < NUM_CHANNELS ; j++) {
+        for (uint k = 0 ; k < NumKeys ; k++) {
+            Data.Channels[j][k] = k + (k > 0 ? 0.5f * rand() / RAND_MAX : 0.0f);
+        }
+    }
+
+    const float Duration = float(NumKeys - 1);
+    Data.SampleTimes.resize(ScaledIterations(NUM_SAMPLES));
+
+    for (uint i = 0 ; i < Data.SampleTimes.size() ; i++) {
+        // 60 fps playback of a 30 ticks/s clip, starting close enough to the
+        // end to wrap around at least once, or random seeks
+        Data.SampleTimes[i] = Seek ? Duration * rand() / RAND_MAX
+                                   : fmod(max(Duration - 500.0f, 0.0f) + 0.5f * i, Duration);
+    }
+}
+
+
+// Same result as FindKeyLinear, by binary search
+static uint FindKeyReference(const vector<float>& Times, float Time)
+{
+    const uint Key = upper_bound(Times.begin() + 1, Times.end(), Time) - (Times.begin() + 1);
+    return min(Key, (uint)Times.size() - 2);
+}
+
+
+// ns per lookup; every result is checked against the reference search
+template <typename Search>
+static double TimeSearch(uint NumKeys, bool Seek, Search search)
+{
+    KeyframeData Data;
+    InitKeyframeData(NumKeys, Seek, Data);
+
+    const uint NumSamples = Data.SampleTimes.size();
+    vector<uint> Found(NumSamples * NUM_CHANNELS);
+    const uint Rounds = NumKeys >= 3000 ? 1 : 20;
+
+    Stopwatch Timer;
+
+    for (uint r = 0 ; r < Rounds ; r++) {
+        for (uint i = 0 ; i < NumSamples ; i++) {
+            for (uint j = 0 ; j < NUM_CHANNELS ; j++) {
+                Found[i * NUM_CHANNELS + j] = search(Data.Channels[j], j, Data.SampleTimes[i]);
+            }
+        }
+    }
+
+    const double Ns = Timer.ElapsedNs() / (double(Rounds) * NumSamples * NUM_CHANNELS);
+
+    uint Mismatches = 0;
+
+    for (uint i = 0 ; i < NumSamples ; i++) {
+        for (uint j = 0 ; j < NUM_CHANNELS ; j++) {
+            Mismatches += Found[i * NUM_CHANNELS + j] != FindKeyReference(Data.Channels[j], Data.SampleTimes[i]);
+        }
+    }
+    CHECK_EQUAL(0u, Mismatches);
+
+    return Ns;
+}
+
+
+static void RegisterKeyframeBenchmarks()
+{
+    const uint KeyCounts[] = { 30, 300, 3000, 30000 };
+
+    for (uint i = 0 ; i < sizeof(KeyCounts) / sizeof(KeyCounts[0]) ; i++) {
+        for (uint s = 0 ; s < 2 ; s++) {
+            const uint NumKeys = KeyCounts[i];
+            const bool Seek = s == 1;
+            char Name[64];
+
+            snprintf(Name, sizeof(Name), "%s keys=%u linear", Seek ? "seek" : "playback", NumKeys);
+            AddBenchmark("KeyframeSearch", Name, "ns/lookup", false, [=]() {
+                return TimeSearch(NumKeys, Seek, [=](const vector<float>& Times, uint, float Time) {
+                    return FindKeyLinear(&Times[0], NumKeys, Time);
+                });
+            });
+
+            snprintf(Name, sizeof(Name), "%s keys=%u cursor", Seek ? "seek" : "playback", NumKeys);
+            AddBenchmark("KeyframeSearch", Name, "ns/lookup", false, [=]() {
+                vector<KeyframeCursor> Cursors(NUM_CHANNELS);
+
+                return TimeSearch(NumKeys, Seek, [&](const vector<float>& Times, uint Channel, float Time) {
+                    return FindKey(&Times[0], NumKeys, Time, Cursors[Channel].Position);
+                });
+            });
+        }
+    }
+}
+
+static BenchmarkRegistrar s_Registrar(RegisterKeyframeBenchmarks);
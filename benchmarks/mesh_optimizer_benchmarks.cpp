@@ -0,0 +1,143 @@
+// Mesh optimization: post-transform cache efficiency before and after, and
+// the cost of running it at load
+#include <stdio.h>
+#include <algorithm>
+#include <array>
+#include <random>
+
+#include "benchmark.h"
+#include "mesh_optimizer.h"
+
+// A Size x Size grid exported the worst way: every triangle with vertices
+// of its own, in random order
+static void CreateTriangleSoup(uint Size, vector<SkinnedVertex>& Vertices, vector<uint>& Indices)
+{
+    vector<array<uint, 3> > Triangles;
+
+    for (uint y = 0 ; y + 1 < Size ; y++) {
+        for (uint x = 0 ; x + 1 < Size ; x++) {
+            const uint a = y * Size + x, b = a + 1, c = a + Size, d = c + 1;
+            Triangles.push_back({ { a, b, d } });
+            Triangles.push_back({ { a, d, c } });
+        }
+    }
+
+    shuffle(Triangles.begin(), Triangles.end(), mt19937(Size));
+
+    Vertices.resize(Triangles.size() * 3);
+    Indices.resize(Triangles.size() * 3);
+
+    for (uint i = 0 ; i < Indices.size() ; i++) {
+        const uint GridVertex = Triangles[i / 3][i % 3];
+        SkinnedVertex& Vertex = Vertices[i];
+
+        Vertex.Position = aiVector3D(float(GridVertex % Size), float(GridVertex / Size), 0.0f);
+        Vertex.Normal = aiVector3D(0.0f, 0.0f, 1.0f);
+        Vertex.TexCoord = aiVector2D(Vertex.Position.x / Size, Vertex.Position.y / Size);
+        Vertex.Bones.AddBoneData(GridVertex % 7, 0.75f);
+        Vertex.Bones.AddBoneData(GridVertex % 5 + 7, 0.25f);
+        Indices[i] = i;
+    }
+}
+
+
+// Triangles as position triples starting at the smallest, to compare
+// meshes whatever the order of their triangles and vertices
+static vector<array<float, 9> > Triangles(const vector<SkinnedVertex>& Vertices, const vector<uint>& Indices)
+{
+    vector<array<float, 9> > Result(Indices.size() / 3);
+
+    for (uint t = 0 ; t < Result.size() ; t++) {
+        array<float, 9> Triangle;
+
+        for (uint k = 0 ; k < 3 ; k++) {
+            const aiVector3D& p = Vertices[Indices[3 * t + k]].Position;
+            Triangle[3 * k] = p.x;
+            Triangle[3 * k + 1] = p.y;
+            Triangle[3 * k + 2] = p.z;
+        }
+
+        // Rotating keeps the winding
+        const uint First = min_element(Triangle.begin(), Triangle.end()) - Triangle.begin();
+        rotate(Triangle.begin(), Triangle.begin() + First / 3 * 3, Triangle.end());
+        Result[t] = Triangle;
+    }
+
+    sort(Result.begin(), Result.end());
+
+    return Result;
+}
+
+
+// ACMR after OptimizeMesh
+static double OptimizedACMR(uint Size)
+{
+    vector<SkinnedVertex> Vertices;
+    vector<uint> Indices;
+    CreateTriangleSoup(Size, Vertices, Indices);
+
+    const VertexCacheStats Before = AnalyzeVertexCache(&Indices[0], Indices.size(), Vertices.size());
+    const vector<array<float, 9> > Expected = Triangles(Vertices, Indices);
+
+    Vertices.resize(OptimizeMesh(&Vertices[0], Vertices.size(), &Indices[0], Indices.size()));
+
+    const VertexCacheStats After = AnalyzeVertexCache(&Indices[0], Indices.size(), Vertices.size());
+
+    // Welding leaves one vertex per grid point, and the same triangles
+    CHECK_EQUAL(Size * Size, (uint)Vertices.size());
+    CHECK(Triangles(Vertices, Indices) == Expected);
+
+    // Vertex fetch order follows the triangles
+    for (uint i = 0, Next = 0 ; i < Indices.size() ; i++) {
+        CHECK(Indices[i] <= Next);
+        Next = max(Next, Indices[i] + 1);
+    }
+
+    CHECK(Before.ACMR == 3.0f);
+    CHECK(After.ACMR < 0.8f);
+    CHECK(After.ATVR < 1.6f);
+
+    return After.ACMR;
+}
+
+
+// ms per mesh
+static double TimeOptimization(uint Size)
+{
+    vector<SkinnedVertex> Source, Vertices;
+    vector<uint> SourceIndices, Indices;
+    CreateTriangleSoup(Size, Source, SourceIndices);
+
+    const uint Iterations = ScaledIterations(10);
+    double Ns = 0.0;
+
+    for (uint i = 0 ; i < Iterations ; i++) {
+        Vertices = Source;
+        Indices = SourceIndices;
+
+        Stopwatch Timer;
+        OptimizeMesh(&Vertices[0], Vertices.size(), &Indices[0], Indices.size());
+        Ns += Timer.ElapsedNs();
+    }
+
+    return Ns * 1e-6 / Iterations;
+}
+
+
+static void RegisterMeshOptimizerBenchmarks()
+{
+    char Name[64];
+    const uint Sizes[] = { 32, 256 };
+
+    for (uint i = 0 ; i < sizeof(Sizes) / sizeof(Sizes[0]) ; i++) {
+        const uint Size = Sizes[i];
+
+        snprintf(Name, sizeof(Name), "grid=%ux%u ACMR", Size, Size);
+        AddBenchmark("MeshOptimizer", Name, "ACMR", false, [=]() { return OptimizedACMR(Size); });
+
+        snprintf(Name, sizeof(Name), "grid=%ux%u optimize", Size, Size);
+        AddBenchmark("MeshOptimizer", Name, "ms/mesh", false, [=]() { return TimeOptimization(Size); });
+    }
+}
+
+static BenchmarkRegistrar s_Registrar(RegisterMeshOptimizerBenchmarks);
@@ -0,0 +1,155 @@
+// Level of detail generation: how close the simplified levels stay to the
+// full mesh, and what building them costs at load
+#include <math.h>
+#include <stdio.h>
+
+#include "benchmark.h"
+#include "mesh_simplifier.h"
+
+// Largest error a level may have, as a fraction of the radius
+#define MAX_RELATIVE_ERROR 0.05f
+
+// Closed unit sphere of Rings x Segments quads with single vertices at the
+// poles, skinned to two bones blended from bottom to top
+static void CreateSphere(uint Rings, uint Segments, vector<SkinnedVertex>& Vertices, vector<uint>& Indices)
+{
+    Vertices.clear();
+    Indices.clear();
+
+    for (uint r = 0 ; r <= Rings ; r++) {
+        const float Theta = (float)M_PI * r / Rings;
+        const uint Count = (r == 0 || r == Rings) ? 1 : Segments;
+
+        for (uint s = 0 ; s < Count ; s++) {
+            const float Phi = 2.0f * (float)M_PI * s / Segments;
+            SkinnedVertex Vertex;
+
+            Vertex.Position = aiVector3D(sinf(Theta) * cosf(Phi), cosf(Theta), sinf(Theta) * sinf(Phi));
+            Vertex.Normal = Vertex.Position;
+            Vertex.Bones.AddBoneData(0, 0.5f + 0.5f * Vertex.Position.y);
+            Vertex.Bones.AddBoneData(1, 0.5f - 0.5f * Vertex.Position.y);
+            Vertices.push_back(Vertex);
+        }
+    }
+
+    // Ring r > 0 starts at 1 + (r - 1) * Segments, the bottom pole is last
+    const uint Bottom = Vertices.size() - 1;
+
+    for (uint r = 0 ; r < Rings ; r++) {
+        for (uint s = 0 ; s < Segments ; s++) {
+            const uint t = (s + 1) % Segments;
+            const uint a = r == 0 ? 0 : 1 + (r - 1) * Segments + s;
+            const uint b = r == 0 ? 0 : 1 + (r - 1) * Segments + t;
+            const uint c = r + 1 == Rings ? Bottom : 1 + r * Segments + s;
+            const uint d = r + 1 == Rings ? Bottom : 1 + r * Segments + t;
+
+            // Counter-clockwise from the outside
+            if (r > 0) {
+                Indices.push_back(a);
+                Indices.push_back(b);
+                Indices.push_back(c);
+            }
+
+            if (r + 1 < Rings) {
+                Indices.push_back(b);
+                Indices.push_back(d);
+                Indices.push_back(c);
+            }
+        }
+    }
+}
+
+
+// One vertex per triangle corner, the way a mesh imported without joining
+// identical vertices comes in
+static void Unweld(vector<SkinnedVertex>& Vertices, vector<uint>& Indices)
+{
+    vector<SkinnedVertex> Corners(Indices.size());
+
+    for (uint i = 0 ; i < Indices.size() ; i++) {
+        Corners[i] = Vertices[Indices[i]];
+        Indices[i] = i;
+    }
+
+    Vertices.swap(Corners);
+}
+
+
+// Error of the level with 1 / 2^Lod of the triangles, relative to the radius
+static double SimplifiedError(uint Rings, uint Segments, uint Lod, bool Unwelded)
+{
+    vector<SkinnedVertex> Vertices;
+    vector<uint> Indices;
+    CreateSphere(Rings, Segments, Vertices, Indices);
+
+    if (Unwelded) {
+        Unweld(Vertices, Indices);
+    }
+
+    const uint Target = (Indices.size() >> Lod) / 3 * 3;
+    vector<uint> Simplified(Indices.size());
+    float Error = 0.0f;
+    const uint Count = SimplifyMesh(&Vertices[0], Vertices.size(), &Indices[0], Indices.size(), Target,
+                                    MAX_RELATIVE_ERROR, &Simplified[0], &Error);
+
+    CHECK(Count > 0 && Count <= Target);
+    CHECK(Error <= MAX_RELATIVE_ERROR);
+
+    // Valid triangles, all still facing outwards
+    for (uint i = 0 ; i + 2 < Count ; i += 3) {
+        const uint a = Simplified[i], b = Simplified[i + 1], c = Simplified[i + 2];
+        CHECK(a < Vertices.size() && b < Vertices.size() && c < Vertices.size());
+        CHECK(a != b && b != c && c != a);
+
+        const aiVector3D& p = Vertices[a].Position;
+        const aiVector3D Normal = (Vertices[b].Position - p) ^ (Vertices[c].Position - p);
+        CHECK(Normal * (p + Vertices[b].Position + Vertices[c].Position) > 0.0f);
+    }
+
+    return Error;
+}
+
+
+// ms per level
+static double TimeSimplification(uint Rings, uint Segments)
+{
+    vector<SkinnedVertex> Vertices;
+    vector<uint> Indices;
+    CreateSphere(Rings, Segments, Vertices, Indices);
+
+    vector<uint> Simplified(Indices.size());
+    const uint Iterations = ScaledIterations(10);
+
+    Stopwatch Timer;
+
+    for (uint i = 0 ; i < Iterations ; i++) {
+        SimplifyMesh(&Vertices[0], Vertices.size(), &Indices[0], Indices.size(), Indices.size() / 2 / 3 * 3,
+                     MAX_RELATIVE_ERROR, &Simplified[0], NULL);
+    }
+
+    return Timer.ElapsedNs() * 1e-6 / Iterations;
+}
+
+
+static void RegisterMeshSimplifierBenchmarks()
+{
+    char Name[64];
+    const uint Sizes[][2] = { { 32, 64 }, { 128, 256 } };
+
+    for (uint i = 0 ; i < sizeof(Sizes) / sizeof(Sizes[0]) ; i++) {
+        const uint Rings = Sizes[i][0], Segments = Sizes[i][1];
+
+        for (uint Lod = 1 ; Lod <= 3 ; Lod++) {
+            snprintf(Name, sizeof(Name), "sphere=%ux%u lod=%u error", Rings, Segments, Lod);
+            AddBenchmark("MeshSimplifier", Name, "radius", false, [=]() { return SimplifiedError(Rings, Segments, Lod, false); });
+        }
+
+        snprintf(Name, sizeof(Name), "sphere=%ux%u unwelded lod=1 error", Rings, Segments);
+        AddBenchmark("MeshSimplifier", Name, "radius", false, [=]() { return SimplifiedError(Rings, Segments, 1, true); });
+
+        snprintf(Name, sizeof(Name), "sphere=%ux%u simplify", Rings, Segments);
+        AddBenchmark("MeshSimplifier", Name, "ms/level", false, [=]() { return TimeSimplification(Rings, Segments); });
+    }
+}
+
+static BenchmarkRegistrar s_Registrar(RegisterMeshSimplifierBenchmarks);
@@ -0,0 +1,481 @@
+// Pose evaluation: the hierarchy pass on its own, Scene::BoneTransform on
+// synthetic skeletons, blended layers, batched evaluation of many
+// instances and animation level of detail
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <memory>
+#include <vector>
+
+#include "benchmark.h"
+#include "cpu_skinning.h"
+#include "scene.h"
+#include "synthetic_scene.h"
+
+struct HierarchyData
+{
+    vector<int> Parents;
+    vector<aiVector3D> Positions, Scalings;
+    vector<aiQuaternion> Rotations;
+    vector<aiMatrix4x4> Offsets;
+};
+
+
+static void InitHierarchyData(uint NumBones, HierarchyData& Data)
+{
+    srand(NumBones);
+    Data.Parents.resize(NumBones);
+    Data.Positions.resize(NumBones);
+    Data.Scalings.resize(NumBones);
+    Data.Rotations.resize(NumBones);
+    Data.Offsets.resize(NumBones);
+
+    for (uint i = 0 ; i < NumBones ; i++) {
+        Data.Parents[i]   = i > 0 ? rand() % i : -1;
+        Data.Positions[i] = aiVector3D(rand() % 10, rand() % 10, rand() % 10);
+        Data.Scalings[i]  = aiVector3D(1.0f, 1.0f, 1.0f);
+        Data.Rotations[i] = aiQuaternion(aiVector3D(0.0f, 1.0f, 0.0f), 0.001f * (rand() % 1000));
+        aiMatrix4x4::Translation(aiVector3D(1.0f, 2.0f, 3.0f), Data.Offsets[i]);
+    }
+}
+
+
+// The 4x4 pipeline Scene used before: quaternion -> matrix, T * R * S,
+// parent and offset multiplies
+static void CalcPaletteMatrix4x4(const HierarchyData& Data, vector<aiMatrix4x4>& Globals, vector<aiMatrix4x4>& Palette)
+{
+    for (uint i = 0 ; i < Data.Parents.size() ; i++) {
+        aiMatrix4x4 ScalingM, TranslationM;
+        aiMatrix4x4::Scaling(Data.Scalings[i], ScalingM);
+        aiMatrix4x4::Translation(Data.Positions[i], TranslationM);
+        aiMatrix4x4 Local = TranslationM * aiMatrix4x4(Data.Rotations[i].GetMatrix()) * ScalingM;
+
+        Globals[i] = Data.Parents[i] >= 0 ? Globals[Data.Parents[i]] * Local : Local;
+        Palette[i] = Globals[i] * Data.Offsets[i];
+    }
+}
+
+
+static void CalcPaletteAffine(const HierarchyData& Data, const vector<AffineMatrix>& Offsets,
+                              vector<AffineMatrix>& Globals, vector<AffineMatrix>& Palette)
+{
+    for (uint i = 0 ; i < Data.Parents.size() ; i++) {
+        AffineMatrix Local;
+        ComposeTRS(Local, Data.Positions[i], Data.Rotations[i], Data.Scalings[i]);
+
+        if (Data.Parents[i] >= 0) {
+            MultiplyAffine(Globals[i], Globals[Data.Parents[i]], Local);
+        }
+        else {
+            Globals[i] = Local;
+        }
+        MultiplyAffine(Palette[i], Globals[i], Offsets[i]);
+    }
+}
+
+
+// ns per bone
+static double TimeHierarchy(uint NumBones, bool Affine)
+{
+    HierarchyData Data;
+    InitHierarchyData(NumBones, Data);
+
+    vector<aiMatrix4x4> Globals(NumBones), Palette(NumBones);
+    vector<AffineMatrix> AffineOffsets(NumBones), AffineGlobals(NumBones), AffinePalette(NumBones);
+
+    for (uint i = 0 ; i < NumBones ; i++) {
+        AffineOffsets[i] = AffineMatrix(Data.Offsets[i]);
+    }
+
+    const uint Iterations = ScaledIterations(2000000 / NumBones);
+    Stopwatch Timer;
+
+    for (uint n = 0 ; n < Iterations ; n++) {
+        if (Affine) {
+            CalcPaletteAffine(Data, AffineOffsets, AffineGlobals, AffinePalette);
+        }
+        else {
+            CalcPaletteMatrix4x4(Data, Globals, Palette);
+        }
+    }
+
+    const double Ns = Timer.ElapsedNs() / (double(Iterations) * NumBones);
+
+    if (Affine) {
+        CalcPaletteMatrix4x4(Data, Globals, Palette);
+        float MaxError = 0.0f;
+
+        for (uint i = 0 ; i < NumBones ; i++) {
+            aiMatrix4x4 m = AffinePalette[i].ToMatrix4x4();
+
+            for (uint j = 0 ; j < 3 ; j++) {
+                for (uint k = 0 ; k < 4 ; k++) {
+                    MaxError = max(MaxError, fabsf(m[j][k] - Palette[i][j][k]));
+                }
+            }
+        }
+        CHECK(MaxError < 1e-3f);
+    }
+
+    return Ns;
+}
+
+
+static bool IsFinite(const glm::vec4& v)
+{
+    return isfinite(v.x) && isfinite(v.y) && isfinite(v.z) && isfinite(v.w);
+}
+
+
+static bool IsFinite(const AffineMatrix& m)
+{
+    return IsFinite(m.Row(0)) && IsFinite(m.Row(1)) && IsFinite(m.Row(2));
+}
+
+
+static bool IsFinite(const DualQuaternion& q)
+{
+    return IsFinite(q.Real) && IsFinite(q.Dual);
+}
+
+
+// ns per call, writing matrices or dual quaternions
+template <class T>
+static double TimePalette(const Scene& S)
+{
+    AnimationInstance Instance;
+    S.InitInstance(Instance);
+
+    vector<T> Palette(max(S.NumBones(), 1u));
+    const uint Calls = ScaledIterations(max(200000 / max(S.NumBones(), 1u), 100u));
+
+    Stopwatch Timer;
+
+    for (uint i = 0 ; i < Calls ; i++) {
+        S.BoneTransform(Instance, i / 60.0f, &Palette[0]);
+    }
+
+    const double Ns = Timer.ElapsedNs() / Calls;
+
+    bool Finite = true;
+
+    for (uint i = 0 ; i < S.NumBones() ; i++) {
+        Finite = Finite && IsFinite(Palette[i]);
+    }
+    CHECK(Finite);
+
+    return Ns;
+}
+
+
+double TimeBoneTransform(const Scene& S)
+{
+    return TimePalette<AffineMatrix>(S);
+}
+
+
+// ns per instance
+static double TimeBatch(const Scene& S, uint NumInstances, ThreadPool& Pool)
+{
+    vector<AnimationInstance> Instances(NumInstances);
+    vector<AnimationJob> Jobs(NumInstances);
+    vector<AffineMatrix> Palettes(NumInstances * S.NumBones());
+
+    for (uint i = 0 ; i < NumInstances ; i++) {
+        S.InitInstance(Instances[i]);
+        Jobs[i].pInstance = &Instances[i];
+        Jobs[i].AnimationIndex = 0;
+    }
+
+    const uint Frames = ScaledIterations(max(20000 / NumInstances, 10u));
+    Stopwatch Timer;
+
+    for (uint f = 0 ; f < Frames ; f++) {
+        for (uint i = 0 ; i < NumInstances ; i++) {
+            // Characters out of phase, as in a crowd
+            Jobs[i].TimeInSeconds = f / 60.0f + i * 0.37f;
+        }
+        S.BoneTransformBatch(&Jobs[0], NumInstances, &Palettes[0], Pool);
+    }
+
+    return Timer.ElapsedNs() / (double(Frames) * NumInstances);
+}
+
+
+// ns per call, blending NumLayers layers of one clip at different times:
+// override layers at falling weights and every third layer additive, with
+// a mask on every other layer
+static double TimeLayers(const Scene& S, uint NumLayers)
+{
+    AnimationInstance Instance;
+    S.InitInstance(Instance);
+
+    // Half weight on every node but the root
+    BoneMask Mask;
+    Mask.assign(Instance.GlobalTransforms.size(), 0.0f);
+    fill(Mask.begin() + 1, Mask.end(), 0.5f);
+
+    vector<AnimationLayer> Layers(NumLayers);
+
+    for (uint i = 0 ; i < NumLayers ; i++) {
+        Layers[i].Weight = 1.0f / (i + 1);
+        Layers[i].Mode   = i % 3 == 2 ? ANIMATION_BLEND_ADDITIVE : ANIMATION_BLEND_OVERRIDE;
+        Layers[i].pMask  = i % 2 ? &Mask : NULL;
+    }
+
+    vector<AffineMatrix> Palette(max(S.NumBones(), 1u));
+    const uint Calls = ScaledIterations(max(200000 / max(S.NumBones(), 1u), 100u));
+
+    Stopwatch Timer;
+
+    for (uint i = 0 ; i < Calls ; i++) {
+        for (uint j = 0 ; j < NumLayers ; j++) {
+            Layers[j].TimeInSeconds = i / 60.0f + j * 0.37f;
+        }
+        S.BoneTransform(Instance, &Layers[0], NumLayers, &Palette[0]);
+    }
+
+    const double Ns = Timer.ElapsedNs() / Calls;
+
+    // A single full layer is plain playback
+    AnimationInstance Reference;
+    S.InitInstance(Reference);
+    vector<AffineMatrix> Expected(Palette.size());
+    S.BoneTransform(Reference, 1.0f, &Expected[0]);
+
+    AnimationLayer Layer;
+    Layer.TimeInSeconds = 1.0f;
+    S.BoneTransform(Instance, &Layer, 1, &Palette[0]);
+
+    float MaxError = 0.0f;
+
+    for (uint i = 0 ; i < S.NumBones() ; i++) {
+        for (uint j = 0 ; j < 3 ; j++) {
+            const glm::vec4 d = Palette[i].Row(j) - Expected[i].Row(j);
+            MaxError = max(MaxError, max(max(fabsf(d.x), fabsf(d.y)), max(fabsf(d.z), fabsf(d.w))));
+        }
+    }
+    CHECK(MaxError < 1e-4f);
+
+    return Ns;
+}
+
+
+// MinNodeReach that prunes the given fraction of the nodes of S
+static float PrunedReach(const Scene& S, float Fraction)
+{
+    AnimationInstance Instance;
+    S.InitInstance(Instance);
+
+    vector<float> Reach(Instance.GlobalTransforms.size());
+
+    for (uint i = 0 ; i < Reach.size() ; i++) {
+        Reach[i] = S.NodeReach(i);
+    }
+
+    if (Fraction <= 0.0f || Reach.empty()) {
+        return 0.0f;
+    }
+
+    sort(Reach.begin(), Reach.end());
+    return Reach[min((size_t)(Fraction * Reach.size()), Reach.size() - 1)];
+}
+
+
+// ns per instance and frame with every instance updated every Interval
+// frames and a fraction of the nodes pruned. Checks that the instances
+// waiting for their turn keep their bones.
+static double TimeAnimationLod(const Scene& S, uint NumInstances, uint Interval, float PrunedFraction, ThreadPool& Pool)
+{
+    vector<AnimationInstance> Instances(NumInstances);
+    vector<AnimationJob> Jobs(NumInstances);
+    vector<AffineMatrix> Palettes(NumInstances * S.NumBones());
+    const float MinNodeReach = PrunedReach(S, PrunedFraction);
+
+    for (uint i = 0 ; i < NumInstances ; i++) {
+        S.InitInstance(Instances[i]);
+        Jobs[i].pInstance = &Instances[i];
+        Jobs[i].UpdateInterval = Interval;
+        Jobs[i].MinNodeReach = MinNodeReach;
+    }
+
+    // The first batch evaluates everything, the second only the instances
+    // whose turn it is: 0, Interval, 2 Interval...
+    S.BoneTransformBatch(&Jobs[0], NumInstances, &Palettes[0], Pool);
+
+    vector<AffineMatrix> First(Palettes);
+    uint Changed = 0, Expected = 0;
+
+    for (uint i = 0 ; i < NumInstances ; i++) {
+        Jobs[i].TimeInSeconds = 0.5f;
+    }
+
+    S.BoneTransformBatch(&Jobs[0], NumInstances, &Palettes[0], Pool);
+
+    for (uint i = 0 ; i < NumInstances ; i++) {
+        const glm::vec4 a = First[i * S.NumBones()].Row(0), b = Palettes[i * S.NumBones()].Row(0);
+        const glm::vec4 c = First[i * S.NumBones()].Row(1), d = Palettes[i * S.NumBones()].Row(1);
+        Changed += a != b || c != d;
+        Expected += i % Interval == 0;
+    }
+    CHECK_EQUAL(Expected, Changed);
+
+    const uint Frames = ScaledIterations(max(20000 / NumInstances, 10u));
+    Stopwatch Timer;
+
+    for (uint f = 0 ; f < Frames ; f++) {
+        for (uint i = 0 ; i < NumInstances ; i++) {
+            Jobs[i].TimeInSeconds = f / 60.0f + i * 0.37f;
+        }
+        S.BoneTransformBatch(&Jobs[0], NumInstances, &Palettes[0], Pool);
+    }
+
+    return Timer.ElapsedNs() / (double(Frames) * NumInstances);
+}
+
+
+// Largest distance a vertex moves when a fraction of the nodes is pruned,
+// relative to MinNodeReach, over a few poses. Within 2 when the pruned
+// nodes only rotate.
+static double PrunedError(uint NumBones, float PrunedFraction)
+{
+    unique_ptr<aiScene> pScene(CreateSyntheticScene(NumBones, 30, 16 * NumBones));
+
+    Scene S;
+    S.SetKeepVertices(true);
+    S.LoadSkeleton(pScene.get());
+
+    const float MinNodeReach = PrunedReach(S, PrunedFraction);
+    CpuSkinning Skinning;
+    Skinning.Init(&S.Vertices()[0], S.Vertices().size());
+
+    ThreadPool Pool(0);
+    AnimationInstance Instance;
+    AnimationJob Job;
+    Job.pInstance = &Instance;
+    Job.MinNodeReach = MinNodeReach;
+
+    vector<AffineMatrix> Full(S.NumBones()), Pruned(S.NumBones());
+    vector<CpuSkinnedVertex> FullVertices(S.Vertices().size()), PrunedVertices(S.Vertices().size());
+    float MaxError = 0.0f;
+
+    for (uint Pose = 0 ; Pose < 8 ; Pose++) {
+        Job.TimeInSeconds = 0.13f * Pose;
+        S.BoneTransformBatch(&Job, 1, &Pruned[0], Pool);
+        S.BoneTransform(Instance, Job.TimeInSeconds, &Full[0]);
+
+        Skinning.Skin(&Full[0], &FullVertices[0], Pool);
+        Skinning.Skin(&Pruned[0], &PrunedVertices[0], Pool);
+
+        for (uint i = 0 ; i < FullVertices.size() ; i++) {
+            const aiVector3D a(FullVertices[i].Position[0], FullVertices[i].Position[1], FullVertices[i].Position[2]);
+            const aiVector3D b(PrunedVertices[i].Position[0], PrunedVertices[i].Position[1], PrunedVertices[i].Position[2]);
+            MaxError = max(MaxError, (a - b).Length());
+        }
+    }
+
+    // Nothing pruned, nothing moved
+    CHECK(MinNodeReach > 0.0f || MaxError == 0.0f);
+
+    return MinNodeReach > 0.0f ? MaxError / MinNodeReach : 0.0;
+}
+
+// Scenes are loaded when the benchmark runs, not at registration
+static shared_ptr<Scene> LoadSyntheticSkeleton(uint NumBones, uint NumKeys)
+{
+    unique_ptr<aiScene> pScene(CreateSyntheticScene(NumBones, NumKeys, 4 * NumBones));
+    shared_ptr<Scene> pSkeleton(new Scene);
+    pSkeleton->LoadSkeleton(pScene.get());
+    return pSkeleton;
+}
+
+
+static void RegisterPoseBenchmarks()
+{
+    char Name[64];
+    const uint HierarchyBones[] = { 16, 64, 256, 1024 };
+
+    for (uint i = 0 ; i < sizeof(HierarchyBones) / sizeof(HierarchyBones[0]) ; i++) {
+        const uint NumBones = HierarchyBones[i];
+
+        snprintf(Name, sizeof(Name), "bones=%u mat4", NumBones);
+        AddBenchmark("Hierarchy", Name, "ns/bone", false, [=]() { return TimeHierarchy(NumBones, false); });
+
+#ifdef POSE_MATH_SIMD
+        snprintf(Name, sizeof(Name), "bones=%u affine simd", NumBones);
+#else
+        snprintf(Name, sizeof(Name), "bones=%u affine scalar", NumBones);
+#endif
+        AddBenchmark("Hierarchy", Name, "ns/bone", false, [=]() { return TimeHierarchy(NumBones, true); });
+    }
+
+    const uint Bones[] = { 32, 128, 512 };
+    const uint Keys[] = { 30, 3000 };
+
+    for (uint i = 0 ; i < sizeof(Bones) / sizeof(Bones[0]) ; i++) {
+        for (uint j = 0 ; j < sizeof(Keys) / sizeof(Keys[0]) ; j++) {
+            const uint NumBones = Bones[i], NumKeys = Keys[j];
+
+            snprintf(Name, sizeof(Name), "bones=%u keys=%u", NumBones, NumKeys);
+            AddBenchmark("BoneTransform", Name, "ns/call", false, [=]() {
+                return TimeBoneTransform(*LoadSyntheticSkeleton(NumBones, NumKeys));
+            });
+        }
+
+        // The extra cost of converting the palette to dual quaternions
+        const uint NumBones = Bones[i];
+
+        snprintf(Name, sizeof(Name), "bones=%u keys=30 dual quaternion", NumBones);
+        AddBenchmark("BoneTransform", Name, "ns/call", false, [=]() {
+            return TimePalette<DualQuaternion>(*LoadSyntheticSkeleton(NumBones, 30));
+        });
+    }
+
+    const uint Layers[] = { 1, 2, 4, 8 };
+
+    for (uint i = 0 ; i < sizeof(Layers) / sizeof(Layers[0]) ; i++) {
+        const uint NumLayers = Layers[i];
+
+        snprintf(Name, sizeof(Name), "bones=128 keys=300 layers=%u", NumLayers);
+        AddBenchmark("BlendLayers", Name, "ns/call", false, [=]() {
+            return TimeLayers(*LoadSyntheticSkeleton(128, 300), NumLayers);
+        });
+    }
+
+    const uint Instances[] = { 1, 16, 256 };
+
+    for (uint i = 0 ; i < sizeof(Instances) / sizeof(Instances[0]) ; i++) {
+        const uint NumInstances = Instances[i];
+
+        snprintf(Name, sizeof(Name), "bones=64 keys=300 instances=%u", NumInstances);
+        AddBenchmark("BoneTransformBatch", Name, "ns/instance", false, [=]() {
+            ThreadPool Pool;
+            return TimeBatch(*LoadSyntheticSkeleton(64, 300), NumInstances, Pool);
+        });
+    }
+
+    const uint Intervals[] = { 1, 4 };
+    const float Pruned[] = { 0.0f, 0.5f };
+
+    for (uint i = 0 ; i < sizeof(Intervals) / sizeof(Intervals[0]) ; i++) {
+        for (uint j = 0 ; j < sizeof(Pruned) / sizeof(Pruned[0]) ; j++) {
+            const uint Interval = Intervals[i];
+            const float PrunedFraction = Pruned[j];
+
+            snprintf(Name, sizeof(Name), "bones=64 keys=300 instances=256 interval=%u pruned=%g", Interval, PrunedFraction);
+            AddBenchmark("AnimationLod", Name, "ns/instance", false, [=]() {
+                ThreadPool Pool;
+                return TimeAnimationLod(*LoadSyntheticSkeleton(64, 300), 256, Interval, PrunedFraction, Pool);
+            });
+        }
+    }
+
+    for (uint j = 0 ; j < sizeof(Pruned) / sizeof(Pruned[0]) ; j++) {
+        const float PrunedFraction = Pruned[j];
+
+        snprintf(Name, sizeof(Name), "bones=64 pruned=%g vertex error", PrunedFraction);
+        AddBenchmark("AnimationLod", Name, "reach", false, [=]() { return PrunedError(64, PrunedFraction); });
+    }
+}
+
+static BenchmarkRegistrar s_Registrar(RegisterPoseBenchmarks);
@@ -0,0 +1,196 @@
+// Profiler: cost of a scope while recording and while disabled, and a
+// profiled crowd update whose worker scopes must reach the summary and
+// the trace, and threads coming and going that must reuse their rings
+#include <stdio.h>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "benchmark.h"
+#include "profiler.h"
+#include "scene.h"
+#include "synthetic_scene.h"
+
+// ns per scope, with a frame ended every 1000 scopes like a busy frame would
+static double TimeScope(bool Enabled)
+{
+    Profiler& P = Profiler::Get();
+    P.Enable(Enabled);
+
+    const uint Frames = ScaledIterations(2000);
+    Stopwatch Timer;
+
+    for (uint f = 0 ; f < Frames ; f++) {
+        P.BeginFrame();
+
+        for (uint i = 0 ; i < 1000 ; i++) {
+            PROFILE_SCOPE("benchmark scope");
+        }
+
+        P.EndFrame();
+    }
+
+    const double Ns = Timer.ElapsedNs() / (double(Frames) * 1000);
+    P.Enable(false);
+
+    return Ns;
+}
+
+
+static bool FileContains(FILE* f, const char* pText)
+{
+    rewind(f);
+    string Contents;
+    char Buffer[4096];
+    size_t Size;
+
+    while ((Size = fread(Buffer, 1, sizeof(Buffer), f)) > 0) {
+        Contents.append(Buffer, Size);
+    }
+
+    return Contents.find(pText) != string::npos;
+}
+
+
+// ns per profiled frame of a crowd update, checking that the scopes of the
+// pool's workers show up in the summary and in the trace
+static double TimeProfiledBatch(uint NumInstances)
+{
+    unique_ptr<aiScene> pScene(CreateSyntheticScene(64, 30, 1000, 1));
+
+    Scene S;
+    S.LoadSkeleton(pScene.get());
+
+    vector<AnimationInstance> Instances(NumInstances);
+    vector<AnimationJob> Jobs(NumInstances);
+
+    for (uint i = 0 ; i < NumInstances ; i++) {
+        S.InitInstance(Instances[i]);
+        Jobs[i].pInstance = &Instances[i];
+    }
+
+    vector<AffineMatrix> Palette(S.NumBones() * NumInstances);
+    ThreadPool Pool;
+
+    Profiler& P = Profiler::Get();
+    P.StartTrace(1 << 16);
+    P.Enable(true);
+
+    const uint Frames = ScaledIterations(200);
+    Stopwatch Timer;
+
+    for (uint f = 0 ; f < Frames ; f++) {
+        P.BeginFrame();
+
+        for (uint i = 0 ; i < NumInstances ; i++) {
+            Jobs[i].TimeInSeconds = f / 60.0f + 0.37f * i;
+        }
+        S.BoneTransformBatch(&Jobs[0], NumInstances, &Palette[0], Pool);
+
+        P.EndFrame();
+    }
+
+    const double Ns = Timer.ElapsedNs() / Frames;
+    P.Enable(false);
+
+    FILE* pReport = tmpfile();
+    CHECK(pReport != NULL);
+
+    if (pReport) {
+        P.Report(pReport);
+        CHECK(FileContains(pReport, "Scene::EvaluateBatch"));
+        CHECK(FileContains(pReport, "evaluate chunk"));
+        fclose(pReport);
+    }
+
+    // Written next to the reports, and removed again
+    const char* pTraceName = "profiler_benchmark_trace.json";
+    CHECK(P.WriteTrace(pTraceName));
+
+    FILE* pTrace = fopen(pTraceName, "r");
+    CHECK(pTrace != NULL);
+
+    if (pTrace) {
+        CHECK(FileContains(pTrace, "\"name\":\"evaluate chunk\",\"cat\":\"cpu\",\"ph\":\"X\""));
+        CHECK(FileContains(pTrace, "\"traceEvents\""));
+        fclose(pTrace);
+    }
+    remove(pTraceName);
+
+    P.StartTrace(0);
+
+    return Ns;
+}
+
+
+// Two threads one after the other, the second reusing the ring of the
+// first, have to keep a track and a name each in the trace
+static void CheckReusedRingTracks()
+{
+    Profiler& P = Profiler::Get();
+    P.StartTrace(16);
+
+    thread([&P]() { P.SetThreadName("first short-lived thread"); PROFILE_SCOPE("short-lived thread"); }).join();
+    P.EndFrame();
+    thread([&P]() { P.SetThreadName("second short-lived thread"); PROFILE_SCOPE("short-lived thread"); }).join();
+    P.EndFrame();
+
+    const char* pTraceName = "profiler_benchmark_threads.json";
+    CHECK(P.WriteTrace(pTraceName));
+
+    FILE* pTrace = fopen(pTraceName, "r");
+    CHECK(pTrace != NULL);
+
+    if (pTrace) {
+        CHECK(FileContains(pTrace, "\"first short-lived thread\""));
+        CHECK(FileContains(pTrace, "\"second short-lived thread\""));
+        fclose(pTrace);
+    }
+    remove(pTraceName);
+
+    P.StartTrace(0);
+}
+
+
+// ns per short-lived thread recording a scope, checking that the rings of
+// exited threads are reused once drained, rather than a new one allocated
+// per thread
+static double TimeShortLivedThreads()
+{
+    Profiler& P = Profiler::Get();
+    P.Enable(true);
+    P.EndFrame();
+    CheckReusedRingTracks();
+
+    const uint Before = P.NumThreadRings();
+    const uint Threads = ScaledIterations(500);
+    const uint ThreadsPerFrame = 64;
+    Stopwatch Timer;
+
+    for (uint t = 0 ; t < Threads ; t++) {
+        thread([]() { PROFILE_SCOPE("short-lived thread"); }).join();
+
+        if (t % ThreadsPerFrame == ThreadsPerFrame - 1) {
+            P.EndFrame();
+        }
+    }
+
+    const double Ns = Timer.ElapsedNs() / Threads;
+    P.EndFrame();
+    P.Enable(false);
+
+    CHECK(P.NumThreadRings() <= Before + ThreadsPerFrame);
+
+    return Ns;
+}
+
+
+static void RegisterProfilerBenchmarks()
+{
+    AddBenchmark("Profiler", "scope enabled", "ns", false, []() { return TimeScope(true); });
+    AddBenchmark("Profiler", "scope disabled", "ns", false, []() { return TimeScope(false); });
+    AddBenchmark("Profiler", "instances=256 profiled batch", "ns", false, []() { return TimeProfiledBatch(256); });
+    AddBenchmark("Profiler", "short-lived thread", "ns", false, []() { return TimeShortLivedThreads(); });
+}
+
+static BenchmarkRegistrar s_Registrar(RegisterProfilerBenchmarks);
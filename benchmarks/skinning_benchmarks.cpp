@@ -0,0 +1,92 @@
+// CPU skinning throughput, scalar against SSE kernel and one thread against
+// the whole pool, the SSE results checked against the scalar kernel
+#include <math.h>
+#include <stdio.h>
+#include <memory>
+#include <vector>
+
+#include "benchmark.h"
+#include "cpu_skinning.h"
+#include "synthetic_scene.h"
+
+// Vertices per second
+static double TimeSkinning(uint NumVertices, bool Simd, int NumWorkers)
+{
+    unique_ptr<aiScene> pScene(CreateSyntheticScene(64, 30, NumVertices));
+
+    Scene S;
+    S.SetKeepVertices(true);
+    S.LoadSkeleton(pScene.get());
+
+    CpuSkinning Skinning;
+    Skinning.Init(&S.Vertices()[0], S.Vertices().size());
+    Skinning.SetSimd(Simd);
+
+    AnimationInstance Instance;
+    S.InitInstance(Instance);
+
+    vector<AffineMatrix> Palette(S.NumBones());
+    S.BoneTransform(Instance, 0.5f, &Palette[0]);
+
+    ThreadPool Pool(NumWorkers);
+    vector<CpuSkinnedVertex> Skinned(NumVertices);
+
+    const uint Passes = ScaledIterations(max(20000000 / NumVertices, 2u));
+    Stopwatch Timer;
+
+    for (uint i = 0 ; i < Passes ; i++) {
+        Skinning.Skin(&Palette[0], &Skinned[0], Pool);
+    }
+
+    const double VerticesPerSecond = double(Passes) * NumVertices / (Timer.ElapsedNs() * 1e-9);
+
+    // Both kernels have to agree; the scalar one is the reference
+    if (Simd) {
+        CpuSkinning Reference;
+        Reference.Init(&S.Vertices()[0], S.Vertices().size());
+        Reference.SetSimd(false);
+
+        vector<CpuSkinnedVertex> Expected(NumVertices);
+        Reference.Skin(&Palette[0], &Expected[0], Pool);
+
+        float MaxError = 0.0f;
+
+        for (uint i = 0 ; i < NumVertices ; i++) {
+            for (uint j = 0 ; j < 3 ; j++) {
+                MaxError = max(MaxError, fabsf(Skinned[i].Position[j] - Expected[i].Position[j]));
+                MaxError = max(MaxError, fabsf(Skinned[i].Normal[j] - Expected[i].Normal[j]));
+            }
+        }
+        CHECK(MaxError < 1e-3f);
+    }
+
+    return VerticesPerSecond;
+}
+
+
+static void RegisterSkinningBenchmarks()
+{
+    char Name[64];
+    const uint Vertices[] = { 10000, 100000 };
+
+    for (uint i = 0 ; i < sizeof(Vertices) / sizeof(Vertices[0]) ; i++) {
+        const uint NumVertices = Vertices[i];
+
+        for (uint Simd = 0 ; Simd < 2 ; Simd++) {
+#ifndef POSE_MATH_SIMD
+            if (Simd) {
+                continue;
+            }
+#endif
+            const char* pKernel = Simd ? "sse" : "scalar";
+
+            snprintf(Name, sizeof(Name), "vertices=%u %s threads=1", NumVertices, pKernel);
+            AddBenchmark("CpuSkinning", Name, "vertices/s", true, [=]() { return TimeSkinning(NumVertices, Simd, 0); });
+
+            snprintf(Name, sizeof(Name), "vertices=%u %s threads=all", NumVertices, pKernel);
+            AddBenchmark("CpuSkinning", Name, "vertices/s", true, [=]() { return TimeSkinning(NumVertices, Simd, -1); });
+        }
+    }
+}
+
+static BenchmarkRegistrar s_Registrar(RegisterSkinningBenchmarks);
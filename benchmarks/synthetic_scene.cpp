@@ -0,0 +1,201 @@
+#include <math.h>
+#include <stdio.h>
+#include <vector>
+
+#include "synthetic_scene.h"
+
+using namespace std;
+
+// Small LCG so the scenes don't depend on the C library's rand()
+class Random
+{
+public:
+    explicit Random(unsigned Seed) : m_State(Seed) {}
+
+    unsigned Next()
+    {
+        m_State = m_State * 1664525u + 1013904223u;
+        return m_State >> 8;
+    }
+
+    float Uniform(float Min, float Max)
+    {
+        return Min + (Max - Min) * (Next() & 0xFFFF) / 65535.0f;
+    }
+
+private:
+    unsigned m_State;
+};
+
+
+// A strip of quads, every vertex weighted to four neighbouring bones
+static aiMesh* CreateStrip(unsigned NumVertices, const vector<aiNode*>& Nodes, const vector<aiVector3D>& BindGlobals)
+{
+    const unsigned NumBones = Nodes.size();
+    aiMesh* pMesh = new aiMesh;
+    pMesh->mNumVertices = NumVertices;
+    pMesh->mVertices = new aiVector3D[NumVertices];
+    pMesh->mNormals = new aiVector3D[NumVertices];
+
+    for (unsigned i = 0 ; i < NumVertices ; i++) {
+        pMesh->mVertices[i] = aiVector3D(float(i / 2), float(i % 2), 0.0f);
+        pMesh->mNormals[i]  = aiVector3D(0.0f, 0.0f, 1.0f);
+    }
+
+    const unsigned NumQuads = NumVertices >= 4 ? NumVertices / 2 - 1 : 0;
+    pMesh->mNumFaces = NumQuads * 2;
+    pMesh->mFaces = new aiFace[pMesh->mNumFaces];
+
+    for (unsigned i = 0 ; i < NumQuads ; i++) {
+        const unsigned a = 2 * i, b = a + 1, c = a + 2, d = a + 3;
+        const unsigned Triangles[2][3] = { { a, c, b }, { b, c, d } };
+
+        for (unsigned j = 0 ; j < 2 ; j++) {
+            aiFace& Face = pMesh->mFaces[2 * i + j];
+            Face.mNumIndices = 3;
+            Face.mIndices = new unsigned[3];
+
+            for (unsigned k = 0 ; k < 3 ; k++) {
+                Face.mIndices[k] = Triangles[j][k];
+            }
+        }
+    }
+
+    vector<vector<aiVertexWeight> > Weights(NumBones);
+    const unsigned Influences = NumBones < 4 ? NumBones : 4;
+
+    for (unsigned i = 0 ; i < NumVertices ; i++) {
+        const unsigned First = (unsigned long long)i * NumBones / NumVertices;
+
+        for (unsigned j = 0 ; j < Influences ; j++) {
+            aiVertexWeight Weight;
+            Weight.mVertexId = i;
+            Weight.mWeight   = 1.0f / Influences;
+            Weights[(First + j) % NumBones].push_back(Weight);
+        }
+    }
+
+    pMesh->mNumBones = NumBones;
+    pMesh->mBones = new aiBone*[NumBones];
+
+    for (unsigned i = 0 ; i < NumBones ; i++) {
+        aiBone* pBone = new aiBone;
+        pBone->mName = Nodes[i]->mName;
+        aiMatrix4x4::Translation(-BindGlobals[i], pBone->mOffsetMatrix);
+        pBone->mNumWeights = Weights[i].size();
+
+        if (!Weights[i].empty()) {
+            pBone->mWeights = new aiVertexWeight[Weights[i].size()];
+
+            for (unsigned j = 0 ; j < Weights[i].size() ; j++) {
+                pBone->mWeights[j] = Weights[i][j];
+            }
+        }
+
+        pMesh->mBones[i] = pBone;
+    }
+
+    return pMesh;
+}
+
+
+aiScene* CreateSyntheticScene(unsigned NumBones, unsigned NumKeys, unsigned NumVertices, unsigned NumMeshes)
+{
+    Random Rng(NumBones * 7919u + NumKeys * 31u + NumVertices);
+    aiScene* pScene = new aiScene;
+
+    // Bind pose: pure translations, so a node's offset matrix is the
+    // negated sum of the translations along its path
+    vector<aiNode*> Nodes(NumBones);
+    vector<vector<aiNode*> > Children(NumBones);
+    vector<aiVector3D> BindGlobals(NumBones);
+
+    for (unsigned i = 0 ; i < NumBones ; i++) {
+        char Name[32];
+        snprintf(Name, sizeof(Name), "bone%u", i);
+
+        Nodes[i] = new aiNode;
+        Nodes[i]->mName.Set(Name);
+
+        const aiVector3D Translation(Rng.Uniform(-1.0f, 1.0f), Rng.Uniform(0.5f, 1.5f), Rng.Uniform(-1.0f, 1.0f));
+        aiMatrix4x4::Translation(Translation, Nodes[i]->mTransformation);
+        BindGlobals[i] = Translation;
+
+        if (i > 0) {
+            // Mostly chains, like limbs, with some branching
+            const unsigned Parent = (Rng.Next() % 4 != 0) ? i - 1 : Rng.Next() % i;
+            Nodes[i]->mParent = Nodes[Parent];
+            Children[Parent].push_back(Nodes[i]);
+            BindGlobals[i] = BindGlobals[i] + BindGlobals[Parent];
+        }
+    }
+
+    for (unsigned i = 0 ; i < NumBones ; i++) {
+        Nodes[i]->mNumChildren = Children[i].size();
+
+        if (!Children[i].empty()) {
+            Nodes[i]->mChildren = new aiNode*[Children[i].size()];
+
+            for (unsigned j = 0 ; j < Children[i].size() ; j++) {
+                Nodes[i]->mChildren[j] = Children[i][j];
+            }
+        }
+    }
+
+    pScene->mRootNode = Nodes[0];
+
+    // The vertices are split evenly into NumMeshes strips
+    pScene->mNumMeshes = NumMeshes;
+    pScene->mMeshes = new aiMesh*[NumMeshes];
+
+    for (unsigned i = 0 ; i < NumMeshes ; i++) {
+        const unsigned First = (unsigned long long)i * NumVertices / NumMeshes;
+        const unsigned Last  = (unsigned long long)(i + 1) * NumVertices / NumMeshes;
+        pScene->mMeshes[i] = CreateStrip(Last - First, Nodes, BindGlobals);
+    }
+
+    // One clip of NumKeys ticks at 30 ticks per second: every node swings
+    // around its own axis and bobs a little
+    aiAnimation* pAnimation = new aiAnimation;
+    pAnimation->mDuration = NumKeys > 1 ? NumKeys - 1 : 1;
+    pAnimation->mTicksPerSecond = 30.0;
+    pAnimation->mNumChannels = NumBones;
+    pAnimation->mChannels = new aiNodeAnim*[NumBones];
+
+    for (unsigned i = 0 ; i < NumBones ; i++) {
+        aiNodeAnim* pChannel = new aiNodeAnim;
+        pChannel->mNodeName = Nodes[i]->mName;
+
+        aiVector3D Axis(Rng.Uniform(-1.0f, 1.0f), Rng.Uniform(-1.0f, 1.0f), Rng.Uniform(-1.0f, 1.0f));
+        Axis.Normalize();
+        const float Phase = Rng.Uniform(0.0f, 6.28f);
+        const aiVector3D Bind(Nodes[i]->mTransformation.a4, Nodes[i]->mTransformation.b4, Nodes[i]->mTransformation.c4);
+
+        pChannel->mNumPositionKeys = NumKeys;
+        pChannel->mPositionKeys = new aiVectorKey[NumKeys];
+        pChannel->mNumRotationKeys = NumKeys;
+        pChannel->mRotationKeys = new aiQuatKey[NumKeys];
+        pChannel->mNumScalingKeys = 1;
+        pChannel->mScalingKeys = new aiVectorKey[1];
+
+        for (unsigned k = 0 ; k < NumKeys ; k++) {
+            const float t = k * 0.1f + Phase;
+
+            pChannel->mPositionKeys[k].mTime  = k;
+            pChannel->mPositionKeys[k].mValue = Bind + aiVector3D(0.0f, 0.1f * sinf(t), 0.0f);
+            pChannel->mRotationKeys[k].mTime  = k;
+            pChannel->mRotationKeys[k].mValue = aiQuaternion(Axis, 0.5f * sinf(t));
+        }
+
+        pChannel->mScalingKeys[0].mTime  = 0.0;
+        pChannel->mScalingKeys[0].mValue = aiVector3D(1.0f, 1.0f, 1.0f);
+
+        pAnimation->mChannels[i] = pChannel;
+    }
+
+    pScene->mNumAnimations = 1;
+    pScene->mAnimations = new aiAnimation*[1];
+    pScene->mAnimations[0] = pAnimation;
+
+    return pScene;
+}
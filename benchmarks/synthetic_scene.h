@@ -0,0 +1,13 @@
+#ifndef SYNTHETIC_SCENE_H
+#define	SYNTHETIC_SCENE_H
+
+#include <assimp/scene.h>
+
+// Builds an in-memory scene: a random tree of NumBones nodes (every node a
+// bone), NumVertices vertices with four weights each split into NumMeshes
+// meshes, and one animation with NumKeys position and rotation keys on
+// every node. The result is deterministic for given parameters; delete it
+// when done.
+aiScene* CreateSyntheticScene(unsigned NumBones, unsigned NumKeys, unsigned NumVertices, unsigned NumMeshes = 1);
+
+#endif	/* SYNTHETIC_SCENE_H */
@@ -0,0 +1,258 @@
+#include <assert.h>
+#include <algorithm>
+#include <cmath>
+
+#include "animation.h"
+
+float AnimationClip::AnimationTime(float TimeInSeconds) const
+{
+    if (Duration <= 0.0f) {
+        return 0.0f;
+    }
+
+    float AnimationTime = fmod(TimeInSeconds * TicksPerSecond, Duration);
+
+    // fmod keeps the sign of negative times
+    return AnimationTime < 0.0f ? AnimationTime + Duration : AnimationTime;
+}
+
+
+template <typename Key, typename Value>
+static void LoadTrack(const Key* pKeys, uint NumKeys, vector<float>& Times, vector<Value>& Values)
+{
+    Times.resize(NumKeys);
+    Values.resize(NumKeys);
+
+    for (uint i = 0 ; i < NumKeys ; i++) {
+        Times[i]  = (float)pKeys[i].mTime;
+        Values[i] = pKeys[i].mValue;
+    }
+}
+
+
+void LoadAnimationClip(const aiAnimation* pAnimation, AnimationClip& Clip)
+{
+    Clip.Duration       = (float)pAnimation->mDuration;
+    Clip.TicksPerSecond = (float)(pAnimation->mTicksPerSecond != 0 ? pAnimation->mTicksPerSecond : 25.0f);
+    Clip.Channels.resize(pAnimation->mNumChannels);
+
+    for (uint i = 0 ; i < pAnimation->mNumChannels ; i++) {
+        const aiNodeAnim* pNodeAnim = pAnimation->mChannels[i];
+        AnimationChannel& Channel = Clip.Channels[i];
+
+        assert(pNodeAnim->mNumPositionKeys > 0);
+        assert(pNodeAnim->mNumRotationKeys > 0);
+        assert(pNodeAnim->mNumScalingKeys > 0);
+
+        LoadTrack(pNodeAnim->mPositionKeys, pNodeAnim->mNumPositionKeys, Channel.PositionTimes, Channel.Positions);
+        LoadTrack(pNodeAnim->mRotationKeys, pNodeAnim->mNumRotationKeys, Channel.RotationTimes, Channel.Rotations);
+        LoadTrack(pNodeAnim->mScalingKeys, pNodeAnim->mNumScalingKeys, Channel.ScalingTimes, Channel.Scalings);
+    }
+}
+
+
+static float CalcFactor(const vector<float>& Times, uint Index, float AnimationTime)
+{
+    float DeltaTime = Times[Index + 1] - Times[Index];
+    float Factor = DeltaTime > 0.0f ? (AnimationTime - Times[Index]) / DeltaTime : 0.0f;
+
+    return Factor < 0.0f ? 0.0f : (Factor > 1.0f ? 1.0f : Factor);
+}
+
+
+static void CalcInterpolatedVector(aiVector3D& Out, float AnimationTime, const vector<float>& Times,
+                                   const vector<aiVector3D>& Values, uint& Cursor)
+{
+    if (Values.size() == 1) {
+        Out = Values[0];
+        return;
+    }
+
+    uint Index = FindKey(&Times[0], Times.size(), AnimationTime, Cursor);
+    float Factor = CalcFactor(Times, Index, AnimationTime);
+    const aiVector3D& Start = Values[Index];
+    const aiVector3D& End   = Values[Index + 1];
+    Out = Start + Factor * (End - Start);
+}
+
+
+static void CalcInterpolatedRotation(aiQuaternion& Out, float AnimationTime, const vector<float>& Times,
+                                     const vector<aiQuaternion>& Values, uint& Cursor)
+{
+	// we need at least two values to interpolate...
+    if (Values.size() == 1) {
+        Out = Values[0];
+        return;
+    }
+
+    uint Index = FindKey(&Times[0], Times.size(), AnimationTime, Cursor);
+    float Factor = CalcFactor(Times, Index, AnimationTime);
+    aiQuaternion::Interpolate(Out, Values[Index], Values[Index + 1], Factor);
+    Out = Out.Normalize();
+}
+
+
+void SampleChannel(const AnimationChannel& Channel, float AnimationTime, KeyframeCursor& Cursor,
+                   aiVector3D& Position, aiQuaternion& Rotation, aiVector3D& Scaling)
+{
+    CalcInterpolatedVector(Position, AnimationTime, Channel.PositionTimes, Channel.Positions, Cursor.Position);
+    CalcInterpolatedRotation(Rotation, AnimationTime, Channel.RotationTimes, Channel.Rotations, Cursor.Rotation);
+    CalcInterpolatedVector(Scaling, AnimationTime, Channel.ScalingTimes, Channel.Scalings, Cursor.Scaling);
+}
+
+
+size_t AnimationClip::RawSize() const
+{
+    size_t Size = 0;
+
+    for (uint i = 0 ; i < Channels.size() ; i++) {
+        const AnimationChannel& Channel = Channels[i];
+        Size += Channel.PositionTimes.size() * (sizeof(float) + sizeof(aiVector3D));
+        Size += Channel.RotationTimes.size() * (sizeof(float) + sizeof(aiQuaternion));
+        Size += Channel.ScalingTimes.size() * (sizeof(float) + sizeof(aiVector3D));
+    }
+
+    return Size;
+}
+
+
+size_t CompressedClip::Size() const
+{
+    return Times.size() * sizeof(float) +
+           (Frames.size() + VectorKeys.size() + RotationKeys.size()) * sizeof(uint16_t) +
+           Channels.size() * sizeof(CompressedChannel);
+}
+
+
+// Largest magnitude of the three stored components of a unit quaternion
+#define ROTATION_RANGE 0.70710678f
+#define ROTATION_STEPS 32767.0f
+
+void EncodeRotation(const aiQuaternion& q, uint16_t* pKey)
+{
+    float c[4] = { q.x, q.y, q.z, q.w };
+    uint Largest = 0;
+
+    for (uint i = 1 ; i < 4 ; i++) {
+        if (fabsf(c[i]) > fabsf(c[Largest])) {
+            Largest = i;
+        }
+    }
+
+    // q and -q are the same rotation, the dropped component is always positive
+    const float Sign = c[Largest] < 0.0f ? -1.0f : 1.0f;
+
+    for (uint i = 0, j = 0 ; i < 4 ; i++) {
+        if (i == Largest) {
+            continue;
+        }
+
+        float v = (Sign * c[i] / ROTATION_RANGE) * 0.5f + 0.5f;
+        v = v < 0.0f ? 0.0f : (v > 1.0f ? 1.0f : v);
+        pKey[j++] = (uint16_t)(v * ROTATION_STEPS + 0.5f);
+    }
+
+    pKey[0] |= (Largest & 1) << 15;
+    pKey[1] |= (Largest >> 1) << 15;
+}
+
+
+aiQuaternion DecodeRotation(const uint16_t* pKey)
+{
+    const uint Largest = (pKey[0] >> 15) | ((pKey[1] >> 15) << 1);
+    float c[4];
+    float Sum = 0.0f;
+
+    for (uint i = 0, j = 0 ; i < 4 ; i++) {
+        if (i == Largest) {
+            continue;
+        }
+
+        const float v = (pKey[j++] & 0x7fff) / ROTATION_STEPS;
+        c[i] = (v * 2.0f - 1.0f) * ROTATION_RANGE;
+        Sum += c[i] * c[i];
+    }
+
+    c[Largest] = sqrtf(Sum < 1.0f ? 1.0f - Sum : 0.0f);
+
+    return aiQuaternion(c[3], c[0], c[1], c[2]);
+}
+
+
+uint FindCompressedFrame(const CompressedClip& Clip, float AnimationTime)
+{
+    const vector<float>& Times = Clip.Times;
+    uint Frame = upper_bound(Times.begin(), Times.end(), AnimationTime) - Times.begin();
+
+    return Frame > 0 ? Frame - 1 : 0;
+}
+
+
+static inline aiVector3D DecodeVector(const CompressedClip& Clip, const CompressedTrack& Track, uint Key)
+{
+    const uint16_t* pKey = &Clip.VectorKeys[3 * (Track.FirstValue + Key)];
+
+    return aiVector3D(Track.Min.x + Track.Scale.x * pKey[0],
+                      Track.Min.y + Track.Scale.y * pKey[1],
+                      Track.Min.z + Track.Scale.z * pKey[2]);
+}
+
+
+// Key of Track at or before timeline Frame and the factor towards the next
+static uint FindCompressedKey(const CompressedClip& Clip, const CompressedTrack& Track, uint Frame,
+                              float AnimationTime, uint& Cursor, float& Factor)
+{
+    const uint16_t* pFrames = &Clip.Frames[Track.FirstFrame];
+    uint Index = FindKey(pFrames, Track.NumKeys, (uint16_t)Frame, Cursor);
+
+    float StartTime = Clip.Times[pFrames[Index]];
+    float DeltaTime = Clip.Times[pFrames[Index + 1]] - StartTime;
+    Factor = DeltaTime > 0.0f ? (AnimationTime - StartTime) / DeltaTime : 0.0f;
+    Factor = Factor < 0.0f ? 0.0f : (Factor > 1.0f ? 1.0f : Factor);
+
+    return Index;
+}
+
+
+static void DecodeInterpolatedVector(aiVector3D& Out, const CompressedClip& Clip, const CompressedTrack& Track,
+                                     uint Frame, float AnimationTime, uint& Cursor)
+{
+    if (Track.NumKeys == 1) {
+        Out = Track.Min;
+        return;
+    }
+
+    float Factor;
+    uint Index = FindCompressedKey(Clip, Track, Frame, AnimationTime, Cursor, Factor);
+    const aiVector3D Start = DecodeVector(Clip, Track, Index);
+    const aiVector3D End   = DecodeVector(Clip, Track, Index + 1);
+    Out = Start + Factor * (End - Start);
+}
+
+
+static void DecodeInterpolatedRotation(aiQuaternion& Out, const CompressedClip& Clip, const CompressedTrack& Track,
+                                       uint Frame, float AnimationTime, uint& Cursor)
+{
+    const uint16_t* pKeys = &Clip.RotationKeys[3 * Track.FirstValue];
+
+    if (Track.NumKeys == 1) {
+        Out = DecodeRotation(pKeys);
+        return;
+    }
+
+    float Factor;
+    uint Index = FindCompressedKey(Clip, Track, Frame, AnimationTime, Cursor, Factor);
+    aiQuaternion::Interpolate(Out, DecodeRotation(pKeys + 3 * Index), DecodeRotation(pKeys + 3 * (Index + 1)), Factor);
+    Out = Out.Normalize();
+}
+
+
+void SampleCompressedChannel(const CompressedClip& Clip, uint Channel, uint Frame, float AnimationTime,
+                             KeyframeCursor& Cursor, aiVector3D& Position, aiQuaternion& Rotation, aiVector3D& Scaling)
+{
+    const CompressedChannel& c = Clip.Channels[Channel];
+
+    DecodeInterpolatedVector(Position, Clip, c.Position, Frame, AnimationTime, Cursor.Position);
+    DecodeInterpolatedRotation(Rotation, Clip, c.Rotation, Frame, AnimationTime, Cursor.Rotation);
+    DecodeInterpolatedVector(Scaling, Clip, c.Scaling, Frame, AnimationTime, Cursor.Scaling);
+}
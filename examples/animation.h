@@ -0,0 +1,160 @@
+#ifndef ANIMATION_H
+#define	ANIMATION_H
+
+#include <stdint.h>
+#include <vector>
+#include <assimp/scene.h>
+
+using namespace std;
+
+// Keys of one animated node, converted from aiNodeAnim. Times are in ticks
+// and stored apart from the values so a key search only touches the times.
+struct AnimationChannel
+{
+    vector<float> PositionTimes;
+    vector<aiVector3D> Positions;
+    vector<float> RotationTimes;
+    vector<aiQuaternion> Rotations;
+    vector<float> ScalingTimes;
+    vector<aiVector3D> Scalings;
+};
+
+// Keys of one position, rotation or scaling track of a CompressedClip
+struct CompressedTrack
+{
+    uint FirstFrame;        // keys in CompressedClip::Frames
+    uint FirstValue;        // keys in VectorKeys or RotationKeys
+    uint NumKeys;           // 1 for constant tracks
+    aiVector3D Min;         // vector tracks: value = Min + Scale * quantized key,
+    aiVector3D Scale;       // constant tracks are exactly Min
+};
+
+struct CompressedChannel
+{
+    CompressedTrack Position;
+    CompressedTrack Rotation;
+    CompressedTrack Scaling;
+};
+
+// Compact form of a clip, built by CompressAnimationClip. The key times of
+// all tracks are merged into one float timeline that the tracks index with
+// 16-bit frame numbers, so a sample searches the times once and each track
+// only compares frame numbers. Vector keys are quantized to 16 bits per
+// component within the range of their track, rotations to 48-bit smallest
+// three quaternions.
+struct CompressedClip
+{
+    vector<float> Times;
+    vector<uint16_t> Frames;
+    vector<uint16_t> VectorKeys;    // 3 per key
+    vector<uint16_t> RotationKeys;  // 3 per key
+    vector<CompressedChannel> Channels;
+
+    // Bytes used by the keys and tracks
+    size_t Size() const;
+};
+
+struct AnimationClip
+{
+    float Duration;         // in ticks
+    float TicksPerSecond;
+    vector<AnimationChannel> Channels;  // empty once the clip is compressed
+    CompressedClip Compressed;
+    vector<int> NodeChannels;  // skeleton node -> channel index, -1 if not animated
+
+    AnimationClip()
+    {
+        Duration       = 0.0f;
+        TicksPerSecond = 25.0f;
+    }
+
+    // Wraps a time in seconds into the clip, in ticks
+    float AnimationTime(float TimeInSeconds) const;
+
+    bool IsCompressed() const
+    {
+        return !Compressed.Channels.empty();
+    }
+
+    uint NumChannels() const
+    {
+        return IsCompressed() ? Compressed.Channels.size() : Channels.size();
+    }
+
+    // Bytes used by the keys of the uncompressed channels
+    size_t RawSize() const;
+};
+
+// The key each track of a channel was found at by the previous sample
+struct KeyframeCursor
+{
+    uint Position;
+    uint Rotation;
+    uint Scaling;
+
+    KeyframeCursor()
+    {
+        Position = 0;
+        Rotation = 0;
+        Scaling  = 0;
+    }
+};
+
+void LoadAnimationClip(const aiAnimation* pAnimation, AnimationClip& Clip);
+
+// Returns the key i with Times[i] <= Time < Times[i + 1] (clamped to the
+// first/last pair) for a track with at least two keys. The search starts at
+// Cursor: during forward playback the answer is the same or the next key,
+// anything else (seeks, loops, reverse playback) falls back to a binary
+// search. Cursor is updated to the result.
+template <typename T>
+inline uint FindKey(const T* pTimes, uint NumKeys, T Time, uint& Cursor)
+{
+    uint i = Cursor;
+
+    if (i + 1 < NumKeys && pTimes[i] <= Time) {
+        if (Time < pTimes[i + 1]) {
+            return i;
+        }
+        if (i + 2 < NumKeys && Time < pTimes[i + 2]) {
+            Cursor = i + 1;
+            return i + 1;
+        }
+    }
+
+    uint Lo = 1, Hi = NumKeys - 1;  // first key after Time lies in [1, NumKeys - 1]
+
+    while (Lo < Hi) {
+        uint Mid = (Lo + Hi) / 2;
+
+        if (Time < pTimes[Mid]) {
+            Hi = Mid;
+        }
+        else {
+            Lo = Mid + 1;
+        }
+    }
+
+    Cursor = Lo - 1;
+    return Cursor;
+}
+
+void SampleChannel(const AnimationChannel& Channel, float AnimationTime, KeyframeCursor& Cursor,
+                   aiVector3D& Position, aiQuaternion& Rotation, aiVector3D& Scaling);
+
+// Index of the last timeline entry at or before AnimationTime (0 before the
+// first). Computed once per clip sample and shared by all its channels.
+uint FindCompressedFrame(const CompressedClip& Clip, float AnimationTime);
+
+// SampleChannel for compressed clips, decoding the keys it interpolates
+void SampleCompressedChannel(const CompressedClip& Clip, uint Channel, uint Frame, float AnimationTime,
+                             KeyframeCursor& Cursor, aiVector3D& Position, aiQuaternion& Rotation, aiVector3D& Scaling);
+
+// Smallest three encoding: the largest component is dropped (and made
+// positive), the other three are stored in 15 bits each and the index of
+// the dropped one in the two remaining bits
+void EncodeRotation(const aiQuaternion& q, uint16_t* pKey);
+
+aiQuaternion DecodeRotation(const uint16_t* pKey);
+
+#endif	/* ANIMATION_H */
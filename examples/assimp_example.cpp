@@ -1,7 +1,17 @@
 #include "utils.hpp"
 
+#include "TutorialConfig.h"
+
 #include <GLFW/glfw3.h>
 #include "scene.h"
+#include "bone_palette.h"
+#include "thread_pool.h"
+#include "frame_timer.h"
+#include "profiler.h"
+#include "async_loader.h"
+#ifdef USE_EGL
+#include "headless.h"
+#endif
 
 #include <assimp/Importer.hpp>
 #include <assimp/postprocess.h>
@@ -12,6 +22,8 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+#include <cmath>
+#include <cstdlib>
 #include <iostream>
 #include <stdexcept>
 #include <sstream>
@@ -21,10 +33,9 @@
 //utility function to count elements in array
 #define ARRAY_SIZE_IN_ELEMENTS(a) (sizeof(a)/sizeof(a[0]))
 #define SNPRINTF snprintf
-#define MAX_BONES 1000
 
 bool hasAnimations = false;
-void updateBoneTransforms();
+void updateBoneTransforms(float time);
 ///////////////////////////////////////////////////////////////////////////////////////
 
 //std::vector<struct MyMesh> myMeshes;
@@ -32,37 +43,183 @@ void updateBoneTransforms();
 // Vertex Attribute Locations
 GLuint vertexLoc=0, normalLoc=1, texCoordLoc=2;
 
-//handles for shader
-GLuint program = 0;
-GLuint modelMatrixUniformLocation = 0;
-GLuint viewMatrixUniformLocation = 0;
-GLuint projMatrixUniformLocation = 0;
+//handles for shader, one program per skinning variant (see SkinningVariant)
+GLuint programs[NUM_SKINNING_VARIANTS] = {};
+GLint modelMatrixUniformLocations[NUM_SKINNING_VARIANTS];
+GLint paletteOffsetUniformLocations[NUM_SKINNING_VARIANTS];
 
 glm::mat4 modelMatrix;
+glm::mat4 viewProjMatrix;
+glm::vec3 cameraPosition;
+
+// levels of detail are picked from the error they show on screen
+float pixelsPerUnit = 0.0f;
+float lodPixelError = 1.0f;
+
+// skip the characters and mesh entries whose skinned bounds are off-screen
+bool frustumCulling = false;
+
+// animate small characters less often and without their smallest bones
+bool animationLod = false;
+std::vector<BoundingBox> entryBounds;
+
+// time the stages of every frame on the CPU and the GPU, print a summary
+// every PROFILE_WINDOW frames and optionally write a Chrome trace at exit
+bool profile = false;
+std::string traceFileName;
 
 GLFWwindow* window;
+#ifdef USE_EGL
+HeadlessContext headlessContext;
+#endif
+int windowWidth = 1024;
+int windowHeight = 800;
 
 Scene scene;
+AnimationInstance instance;
+BonePaletteBuffer bonePalette;
+
+// crowd of numInstances characters, drawn with one instanced draw per mesh entry
+int numInstances = 1;
+const float crowdSpacing = 80.0f;
+ThreadPool threadPool;
+std::vector<AnimationInstance> crowdInstances;
+std::vector<AnimationJob> crowdJobs;
+std::vector<RenderInstance> crowdRenderInstances;
+
+// skin with dual quaternions (2 texels per bone) instead of matrices (3 texels)
+bool dualQuaternionSkinning = false;
 
 const std::string vertShaderPath = "../shaders/vertexShader.vs";
 const std::string fragShaderPath = "../shaders/fragmentShader.fs";
 
-GLuint m_boneLocation[MAX_BONES];
 //forward declaration
 //void genVAOsAndUniformBuffer(const aiScene*);
 bool setUpShader();
 bool setUpWindow();
-void render();
+void setUpGLState();
+void setUpCrowd();
+int crowdSide();
+void render(float time);
+const BoundingBox* updateEntryBounds();
+int runHeadless(int numFrames, int warmUpFrames, float framesPerSecond, const std::string& dumpPrefix);
+bool loadMeshAsync(const std::string& fileName, bool headless, size_t uploadBudget);
+
+void printUsage(const char* name)
+{
+    printf("usage: %s [mesh file] [--headless] [--frames N] [--warmup N] [--fps F] [--dump PREFIX] [--size WxH] [--instances N] [--no-indirect] [--packed] [--dual-quaternion] [--compress-animations] [--optimize-meshes] [--lods N] [--lod-error PX] [--cull] [--anim-lod] [--async] [--upload-budget KB] [--profile] [--trace FILE]\n", name);
+    printf("  --headless     render offscreen a fixed number of frames and report frame times\n");
+    printf("  --frames N     number of frames to render headless (default 300)\n");
+    printf("  --warmup N     untimed frames rendered first (default 10)\n");
+    printf("  --fps F        animation frames per second of the headless run (default 30)\n");
+    printf("  --dump PREFIX  write every headless frame to PREFIX<frame>.ppm\n");
+    printf("  --size WxH     framebuffer size (default 1024x800)\n");
+    printf("  --instances N  draw a crowd of N animated characters (default 1)\n");
+    printf("  --no-indirect  draw every mesh entry separately instead of with one multi-draw indirect call\n");
+    printf("  --packed       upload 32 byte packed vertices instead of the full precision 64 byte ones\n");
+    printf("  --dual-quaternion  use dual quaternion instead of linear blend skinning\n");
+    printf("  --compress-animations  play the animations from compressed keys\n");
+    printf("  --optimize-meshes  weld vertices and reorder triangles and vertices for the vertex cache at load\n");
+    printf("  --lods N       build N levels of detail per mesh at load, the full mesh included (default 1)\n");
+    printf("  --lod-error PX  largest error in pixels the levels of detail may show (default 1)\n");
+    printf("  --cull         skip characters and mesh entries outside the view\n");
+    printf("  --anim-lod     update small characters less often and keep their smallest bones in the bind pose\n");
+    printf("  --async        load the mesh on a worker thread while frames keep being presented\n");
+    printf("  --upload-budget KB  mesh data uploaded per frame by --async (default 1024)\n");
+    printf("  --profile      time animation, palette upload and draws on the CPU and the GPU and print a summary\n");
+    printf("  --trace FILE   write the profiled frames to FILE in the Chrome trace event format\n");
+}
 
 int main(int argc, char *argv[])
 {
     std::string fileName = "boblampclean.md5mesh";
-    if (argc == 2)
+    bool headless = false;
+    int numFrames = 300;
+    int warmUpFrames = 10;
+    float framesPerSecond = 30.0f;
+    std::string dumpPrefix;
+    bool multiDrawIndirect = true;
+    bool packedVertices = false;
+    bool compressAnimations = false;
+    bool optimizeMeshes = false;
+    int meshLods = 1;
+    bool async = false;
+    int uploadBudget = 1024;
+
+    for (int i = 1; i < argc; ++i)
     {
-        fileName = argv[1];
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+
+        if (arg == "--headless")
+            headless = true;
+        else if (arg == "--frames" && hasValue)
+            numFrames = atoi(argv[++i]);
+        else if (arg == "--warmup" && hasValue)
+            warmUpFrames = atoi(argv[++i]);
+        else if (arg == "--fps" && hasValue)
+            framesPerSecond = static_cast<float>(atof(argv[++i]));
+        else if (arg == "--dump" && hasValue)
+            dumpPrefix = argv[++i];
+        else if (arg == "--size" && hasValue && sscanf(argv[++i], "%dx%d", &windowWidth, &windowHeight) == 2)
+            ;
+        else if (arg == "--instances" && hasValue)
+            numInstances = atoi(argv[++i]);
+        else if (arg == "--no-indirect")
+            multiDrawIndirect = false;
+        else if (arg == "--packed")
+            packedVertices = true;
+        else if (arg == "--dual-quaternion")
+            dualQuaternionSkinning = true;
+        else if (arg == "--compress-animations")
+            compressAnimations = true;
+        else if (arg == "--optimize-meshes")
+            optimizeMeshes = true;
+        else if (arg == "--lods" && hasValue)
+            meshLods = atoi(argv[++i]);
+        else if (arg == "--lod-error" && hasValue)
+            lodPixelError = static_cast<float>(atof(argv[++i]));
+        else if (arg == "--cull")
+            frustumCulling = true;
+        else if (arg == "--anim-lod")
+            animationLod = true;
+        else if (arg == "--async")
+            async = true;
+        else if (arg == "--upload-budget" && hasValue)
+            uploadBudget = atoi(argv[++i]);
+        else if (arg == "--profile")
+            profile = true;
+        else if (arg == "--trace" && hasValue)
+            traceFileName = argv[++i];
+        else if (arg.compare(0, 2, "--") != 0)
+            fileName = arg;
+        else
+        {
+            printUsage(argv[0]);
+            return -1;
+        }
     }
 
-    if(!setUpWindow())
+    if (windowWidth <= 0 || windowHeight <= 0 || numFrames < 0 || warmUpFrames < 0 || framesPerSecond <= 0.0f || numInstances <= 0 || uploadBudget <= 0 || meshLods <= 0 || lodPixelError < 0.0f)
+    {
+        printUsage(argv[0]);
+        return -1;
+    }
+
+    if (headless)
+    {
+#ifdef USE_EGL
+        if (!headlessContext.Init(windowWidth, windowHeight))
+        {
+            return -1;
+        }
+        setUpGLState();
+#else
+        printf("Built without EGL, headless rendering is not available\n");
+        return -1;
+#endif
+    }
+    else if(!setUpWindow())
     {
         return -1;
     }
@@ -71,58 +228,263 @@ int main(int argc, char *argv[])
     {
         return -1;
     }
-    //scene = Scene();
-    if (!scene.LoadMesh(fileName)) {
+    scene.SetPackedVertices(packedVertices);
+    scene.SetMultiDrawIndirect(multiDrawIndirect);
+    scene.SetOptimizeMeshes(optimizeMeshes);
+    scene.SetMeshLods(meshLods);
+    if (!async)
+    {
+        // nothing else runs on the pool until the mesh is loaded
+        scene.SetImportPool(&threadPool);
+    }
+    if (animationLod)
+    {
+        // bones may show the same error as the meshes; characters under a
+        // quarter of the screen height are updated at most every 4th frame
+        AnimationLodSettings settings;
+        settings.MaxPixelError = lodPixelError;
+        settings.FullRatePixels = 0.25f * windowHeight;
+        settings.MaxUpdateInterval = 4;
+        scene.SetAnimationLod(settings);
+    }
+    if (async ? !loadMeshAsync(fileName, headless, uploadBudget * 1024) : !scene.LoadMesh(fileName, fileName + ".cache")) {
         printf("Mesh load failed\n");
         return -1;            
     }
+    if (compressAnimations && !scene.CompressAnimations(ClipCompressionSettings()))
+        printf("Some animations are too long to compress\n");
     //Now we can access the file's contents.
    //  std::cout << "Import of scene " << pFile.c_str() << " succeeded." << std::endl;
    //  std::cout << " contains " << scene->mNumMeshes << " meshes" << std::endl;
    // std::cout << " contains " << scene->mNumAnimations << " animations" << std::endl;
-    for (unsigned int i = 0 ; i < ARRAY_SIZE_IN_ELEMENTS(m_boneLocation) ; i++) {
-        char Name[128];
-        memset(Name, 0, sizeof(Name));
-        SNPRINTF(Name, sizeof(Name), "gBones[%d]", i);
-        m_boneLocation[i] = glGetUniformLocation(program,Name);
+    scene.InitInstance(instance);
+    setUpCrowd();
+
+    const uint boneSize = dualQuaternionSkinning ? sizeof(DualQuaternion) : sizeof(AffineMatrix);
+    if (!bonePalette.Init(scene.NumBones() * numInstances, boneSize)) {
+        printf("Bone palette buffer creation failed\n");
+        return -1;
     }
 
 
     //genVAOsAndUniformBuffer(scene);
 
+    Profiler& profiler = Profiler::Get();
+    if (profile || !traceFileName.empty())
+    {
+        profiler.SetThreadName("main");
+        if (!profiler.InitGpu())
+            printf("Timer queries are not available, only the CPU is profiled\n");
+        if (!traceFileName.empty())
+            profiler.StartTrace(1 << 20);
+    }
+
+#ifdef USE_EGL
+    if (headless)
+    {
+        return runHeadless(numFrames, warmUpFrames, framesPerSecond, dumpPrefix);
+    }
+#endif
+
+    profiler.Enable(profile || !traceFileName.empty());
+
     /* Loop until the user closes the window */
-    while (!glfwWindowShouldClose(window))
+    for (int frame = 1; !glfwWindowShouldClose(window); ++frame)
     {
-        render();
+        profiler.BeginFrame();
+        render(static_cast<float>(glfwGetTime()));
+
+        /* Swap front and back buffers */
+        glfwSwapBuffers(window);
+        profiler.EndFrame();
+
+        if (profile && frame % PROFILE_WINDOW == 0)
+            profiler.Report(stdout);
+
+        /* Poll for and process events */
+        glfwPollEvents();
     }
 
+    profiler.Finish();
+    if (!traceFileName.empty() && !profiler.WriteTrace(traceFileName))
+        printf("Unable to write %s\n", traceFileName.c_str());
+
     glfwTerminate();
 
     return 0;
     //bulshit
 }
 
-void render()
+#ifdef USE_EGL
+// Renders numFrames frames at fixed animation timestamps (frame / fps), so
+// every run draws exactly the same images, and reports the frame times.
+// The warm-up frames keep lazy shader compilation, first-use allocations
+// (and the bogus first timer query of some drivers) out of the numbers.
+int runHeadless(int numFrames, int warmUpFrames, float framesPerSecond, const std::string& dumpPrefix)
+{
+    for (int frame = 0; frame < warmUpFrames; ++frame)
+    {
+        render(0.0f);
+    }
+    glFinish();
+
+    FrameTimer timer;
+
+    if (!timer.Init())
+    {
+        printf("Timer queries are not available\n");
+        return -1;
+    }
+
+    // the warm-up frames are left out of the profile as well
+    Profiler& profiler = Profiler::Get();
+    profiler.Enable(profile || !traceFileName.empty());
+
+    for (int frame = 0; frame < numFrames; ++frame)
+    {
+        timer.BeginFrame();
+        profiler.BeginFrame();
+        render(frame / framesPerSecond);
+        profiler.EndFrame();
+        timer.EndFrame();
+
+        if (!dumpPrefix.empty())
+        {
+            char frameFileName[32];
+            SNPRINTF(frameFileName, sizeof(frameFileName), "%04d.ppm", frame);
+
+            if (!headlessContext.WritePPM(dumpPrefix + frameFileName))
+            {
+                printf("Unable to write %s%s\n", dumpPrefix.c_str(), frameFileName);
+                return -1;
+            }
+        }
+    }
+
+    timer.Finish();
+    timer.Report(stdout);
+
+    profiler.Finish();
+    if (profile)
+        profiler.Report(stdout);
+
+    if (!traceFileName.empty() && !profiler.WriteTrace(traceFileName))
+    {
+        printf("Unable to write %s\n", traceFileName.c_str());
+        return -1;
+    }
+
+    if (scene.NumLods() > 1)
+    {
+        printf("Instances per level of detail in the last frame:");
+        for (uint i = 0; i < scene.NumLods(); ++i)
+            printf(" %u", scene.LodInstances(i));
+        printf("\n");
+    }
+
+    if (frustumCulling)
+        printf("Visible instances in the last frame: %u of %d\n", scene.VisibleInstances(), numInstances);
+
+    return 0;
+}
+#endif
+
+// Streams the mesh in while empty frames keep being presented, the way a
+// game would bring in a character without stopping
+bool loadMeshAsync(const std::string& fileName, bool headless, size_t uploadBudget)
+{
+    // the frames presented meanwhile keep threadPool to themselves
+    ThreadPool importPool;
+    bool done = false;
+    bool loaded = false;
+    int frames = 0;
+
+    scene.SetImportPool(&importPool);
+    {
+        AsyncMeshLoader loader;
+        loader.Load(&scene, fileName, fileName + ".cache", [&](bool ok) { done = true; loaded = ok; });
+
+        while (!done)
+        {
+            loader.Update(uploadBudget);
+            glClear(GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT);
+            ++frames;
+
+            if (headless)
+            {
+                glFinish();
+                continue;
+            }
+
+            glfwSwapBuffers(window);
+            glfwPollEvents();
+
+            if (glfwWindowShouldClose(window))
+                break;
+        }
+    }
+    // the loader has waited for its imports, none uses the pool any more
+    scene.SetImportPool(NULL);
+
+    if (!done)
+        return false;
+
+    printf("Loaded %s in %d frames\n", fileName.c_str(), frames);
+
+    return loaded;
+}
+
+void render(float time)
 {
+    PROFILE_SCOPE("frame");
+    GPU_PROFILE_SCOPE("frame");
+
     glClear(GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT);
   
-    glUseProgram(program);
-    
-    float time = static_cast<float>(glfwGetTime());
-    
     glm::mat4 newModelMatrix = glm::rotate(modelMatrix, time*0.3f, glm::vec3(0.0f, 1.0f, 0.0f) );
-    glUniformMatrix4fv(modelMatrixUniformLocation, 1, GL_FALSE, glm::value_ptr(newModelMatrix) );
 
-    updateBoneTransforms();
+    // the instances are placed before the model matrix, so is the eye
+    const glm::vec4 eye = glm::inverse(newModelMatrix) * glm::vec4(cameraPosition, 1.0f);
+    scene.SetLodView(aiVector3D(eye.x, eye.y, eye.z), pixelsPerUnit, lodPixelError);
 
-    scene.Render();
+    {
+        PROFILE_SCOPE("animation");
+        updateBoneTransforms(time);
+    }
 
-    glUseProgram(0);
-    /* Swap front and back buffers */
-    glfwSwapBuffers(window);
+    // likewise the frustum, and the bounds follow this frame's poses
+    const BoundingBox* pEntryBounds = NULL;
+    if (frustumCulling)
+    {
+        const Frustum frustum(viewProjMatrix * newModelMatrix);
+        scene.SetCullFrustum(&frustum);
 
-    /* Poll for and process events */
-    glfwPollEvents();
+        PROFILE_SCOPE("bounds");
+        pEntryBounds = updateEntryBounds();
+    }
+
+    // the scene switches between the programs of the variants it draws
+    for (int i = 0; i < NUM_SKINNING_VARIANTS; ++i)
+    {
+        if (scene.NumEntries(static_cast<SkinningVariant>(i)) == 0)
+            continue;
+
+        glUseProgram(programs[i]);
+        glUniformMatrix4fv(modelMatrixUniformLocations[i], 1, GL_FALSE, glm::value_ptr(newModelMatrix) );
+        bonePalette.Bind(0, paletteOffsetUniformLocations[i]);
+    }
+
+    {
+        PROFILE_SCOPE("draw");
+        GPU_PROFILE_SCOPE("draw");
+
+        if (numInstances > 1)
+            scene.Render(numInstances, &crowdRenderInstances[0], pEntryBounds);
+        else
+            scene.Render(pEntryBounds);
+    }
+
+    glUseProgram(0);
 }
 
 bool setUpWindow()
@@ -138,7 +500,7 @@ bool setUpWindow()
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
     
-    window = glfwCreateWindow(1024, 800, "Animation with Assimp", NULL, NULL);
+    window = glfwCreateWindow(windowWidth, windowHeight, "Animation with Assimp", NULL, NULL);
     if (!window)
     {
         glfwTerminate();
@@ -152,10 +514,50 @@ bool setUpWindow()
     GLenum glewError = glewInit();
     std::cout << glGetError() << ", glew initeted - but createted GL_INVALID_ENUM, it works not" << std::endl;
 
+    setUpGLState();
+
+    return true;
+}
+
+void setUpGLState()
+{
     glClearColor(0.4,0.4,0.4,1.0);
     glEnable(GL_DEPTH_TEST);
+}
 
-    return true;
+int crowdSide()
+{
+    return static_cast<int>(std::ceil(std::sqrt(static_cast<float>(numInstances))));
+}
+
+// Lays the crowd out on a square grid around the origin. Every character
+// gets its own playback state and its own slice of the bone palette.
+void setUpCrowd()
+{
+    if (numInstances <= 1)
+        return;
+
+    const int side = crowdSide();
+    const float origin = -0.5f * crowdSpacing * (side - 1);
+
+    crowdInstances.resize(numInstances);
+    crowdJobs.resize(numInstances);
+    crowdRenderInstances.resize(numInstances);
+
+    for (int i = 0; i < numInstances; ++i)
+    {
+        scene.InitInstance(crowdInstances[i]);
+
+        crowdJobs[i].pInstance = &crowdInstances[i];
+        crowdJobs[i].AnimationIndex = 0;
+        crowdJobs[i].TimeInSeconds = 0.0f;
+
+        RenderInstance& renderInstance = crowdRenderInstances[i];
+        renderInstance.World = AffineMatrix();
+        renderInstance.World.Rows[0] = AffineRow(1.0f, 0.0f, 0.0f, origin + crowdSpacing * (i % side));
+        renderInstance.World.Rows[2] = AffineRow(0.0f, 0.0f, 1.0f, origin + crowdSpacing * (i / side));
+        renderInstance.PaletteBase = i * scene.NumBones();
+    }
 }
 
 bool setUpShader()
@@ -183,30 +585,53 @@ bool setUpShader()
     inFile.close();
     const std::string strFragmentShader = fShaderStream.str();//str holds the content of the file
 
-    try {
-        program = createProgram(strVertexShader, strFragmentShader);
-    } catch (std::logic_error& e) {
-        std::cerr << e.what() << std::endl;
-    }
-
-    // get uniform locations
-    glUseProgram(program);
-    modelMatrixUniformLocation = glGetUniformLocation(program, "modelMatrix");
-    viewMatrixUniformLocation  = glGetUniformLocation(program, "viewMatrix");
-    projMatrixUniformLocation  = glGetUniformLocation(program, "projMatrix");
-
     // generating view / projection / model  matrix
     //modelMatrix = glm::scale(glm::mat4(1.0), glm::vec3(0.4f) );
     //modelMatrix = glm::rotate(modelMatrix, glm::radians(-90.0f), glm::vec3(1.0f, 0.0f, 0.0f) );
 
-    glm::mat4 cameraMatrix = glm::translate(glm::mat4(1.0), glm::vec3(0.0, 30.0, 150.0));
+    // back off far enough to see the whole crowd
+    const float cameraScale = static_cast<float>(crowdSide());
+    glm::mat4 cameraMatrix = glm::translate(glm::mat4(1.0), glm::vec3(0.0, 30.0 * cameraScale, 150.0 * cameraScale));
     glm::mat4 viewMatrix = glm::inverse(cameraMatrix);
-    glm::mat4 projMatrix = glm::perspectiveFov(glm::radians(60.0f), 1024.0f, 800.0f, 1.0f, 500.0f);
+    glm::mat4 projMatrix = glm::perspectiveFov(glm::radians(60.0f), float(windowWidth), float(windowHeight), 1.0f, 500.0f * cameraScale);
+    viewProjMatrix = projMatrix * viewMatrix;
+    cameraPosition = glm::vec3(cameraMatrix[3]);
+    pixelsPerUnit = windowHeight / (2.0f * std::tan(glm::radians(30.0f)));
 
-    // upload Uniform matrices
-    glUniformMatrix4fv(modelMatrixUniformLocation, 1, GL_FALSE, glm::value_ptr(modelMatrix) );
-    glUniformMatrix4fv(viewMatrixUniformLocation , 1, GL_FALSE, glm::value_ptr(viewMatrix) );
-    glUniformMatrix4fv(projMatrixUniformLocation , 1, GL_FALSE, glm::value_ptr(projMatrix) );   
+    for (int i = 0; i < NUM_SKINNING_VARIANTS; ++i)
+    {
+        const unsigned influences = SkinningVariantInfluences(static_cast<SkinningVariant>(i));
+        std::vector<std::string> defines(1, "BONE_INFLUENCES " + std::to_string(influences));
+        std::string variantName = "rigid";
+        if (influences > 0)
+        {
+            variantName = (dualQuaternionSkinning ? "dq" : "lbs") + std::to_string(influences);
+            if (dualQuaternionSkinning)
+                defines.push_back("DUAL_QUATERNION_SKINNING");
+        }
+
+        try {
+            // cache the linked programs next to the vertex shader, like the mesh cache
+            programs[i] = createProgram(strVertexShader, strFragmentShader, defines,
+                                        vertShaderPath + "." + variantName + ".program");
+        } catch (std::logic_error& e) {
+            std::cerr << e.what() << std::endl;
+        }
+
+        // get uniform locations
+        const GLuint program = programs[i];
+        glUseProgram(program);
+        modelMatrixUniformLocations[i]   = glGetUniformLocation(program, "modelMatrix");
+        paletteOffsetUniformLocations[i] = glGetUniformLocation(program, "gPaletteOffset");
+        glUniform1i(glGetUniformLocation(program, "gBonePalette"), 0);
+
+        // upload Uniform matrices
+        glUniformMatrix4fv(modelMatrixUniformLocations[i], 1, GL_FALSE, glm::value_ptr(modelMatrix) );
+        glUniformMatrix4fv(glGetUniformLocation(program, "viewMatrix"), 1, GL_FALSE, glm::value_ptr(viewMatrix) );
+        glUniformMatrix4fv(glGetUniformLocation(program, "projMatrix"), 1, GL_FALSE, glm::value_ptr(projMatrix) );
+    }
+
+    scene.SetVariantPrograms(programs);
 
     return true;
 }
@@ -275,22 +700,52 @@ bool setUpShader()
 
 //animation
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-void updateBoneTransforms()
+template <class BoneType>
+void writeBoneTransforms(BoneType* pPalette, float time)
 {
-    vector<aiMatrix4x4> Transforms;
+    if (numInstances > 1)
+        scene.BoneTransformBatch(&crowdJobs[0], numInstances, pPalette, threadPool);
+    else
+        scene.BoneTransform(instance, time, pPalette);
+}
 
-    scene.BoneTransform(static_cast<float>(glfwGetTime()), Transforms);
+void updateBoneTransforms(float time)
+{
+    // offset every character in time so the crowd doesn't move in lockstep
+    for (int i = 0; i < static_cast<int>(crowdJobs.size()); ++i)
+    {
+        crowdJobs[i].TimeInSeconds = time + 0.37f * i;
+        if (animationLod)
+            scene.SelectAnimationLod(crowdRenderInstances[i].World, crowdJobs[i]);
+    }
 
-    for (uint i = 0 ; i < Transforms.size() ; i++) {
-        assert(i < MAX_BONES);
-        float currentTranform[4][4] = 
-        {
-            {Transforms[i].a1, Transforms[i].a2, Transforms[i].a3, Transforms[i].a4},
-            {Transforms[i].b1, Transforms[i].b2, Transforms[i].b3, Transforms[i].b4},
-            {Transforms[i].c1, Transforms[i].c2, Transforms[i].c3, Transforms[i].c4},
-            {Transforms[i].d1, Transforms[i].d2, Transforms[i].d3, Transforms[i].d4},
-        };
-        //needs pointer to 4x4 array as last parameter
-        glUniformMatrix4fv(m_boneLocation[i], 1, GL_TRUE, (const GLfloat*)currentTranform);
+    // Evaluate straight into this frame's region of the palette buffer
+    if (dualQuaternionSkinning)
+        writeBoneTransforms(bonePalette.BeginFrame<DualQuaternion>(), time);
+    else
+        writeBoneTransforms(bonePalette.BeginFrame<AffineMatrix>(), time);
+
+    PROFILE_SCOPE("palette upload");
+    GPU_PROFILE_SCOPE("palette upload");
+    bonePalette.EndFrame(scene.NumBones() * numInstances);
+}
+
+// Skinned bounds of every mesh entry of every character, from the poses
+// updateBoneTransforms left in the instances
+const BoundingBox* updateEntryBounds()
+{
+    const uint numEntries = scene.NumEntries();
+    entryBounds.resize(numEntries * numInstances);
+
+    if (numInstances > 1)
+    {
+        threadPool.ParallelFor(numInstances, 64, [numEntries](uint begin, uint end) {
+            for (uint i = begin; i < end; ++i)
+                scene.SkinnedBounds(crowdInstances[i], &entryBounds[i * numEntries]);
+        });
     }
-}
\ No newline at end of file
+    else if (numEntries > 0)
+        scene.SkinnedBounds(instance, &entryBounds[0]);
+
+    return entryBounds.empty() ? NULL : &entryBounds[0];
+}
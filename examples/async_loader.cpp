@@ -0,0 +1,133 @@
+#include "async_loader.h"
+
+AsyncMeshLoader::AsyncMeshLoader(uint NumThreads)
+{
+    m_NumPending = 0;
+    m_Quit       = false;
+
+    for (uint i = 0 ; i < max(NumThreads, 1u) ; i++) {
+        m_Workers.push_back(thread(&AsyncMeshLoader::WorkerMain, this));
+    }
+}
+
+
+AsyncMeshLoader::~AsyncMeshLoader()
+{
+    {
+        lock_guard<mutex> Lock(m_Mutex);
+        m_Quit = true;
+    }
+    m_WorkReady.notify_all();
+
+    for (uint i = 0 ; i < m_Workers.size() ; i++) {
+        m_Workers[i].join();
+    }
+}
+
+
+void AsyncMeshLoader::Load(Scene* pScene, const string& Filename, const string& CacheFilename,
+                           const function<void(bool)>& Done)
+{
+    shared_ptr<Job> pJob(new Job);
+    pJob->pScene        = pScene;
+    pJob->Filename      = Filename;
+    pJob->CacheFilename = CacheFilename;
+    pJob->Done          = Done;
+    pJob->Ok            = false;
+
+    {
+        lock_guard<mutex> Lock(m_Mutex);
+        m_Queued.push_back(pJob);
+        m_NumPending++;
+    }
+    m_WorkReady.notify_one();
+}
+
+
+uint AsyncMeshLoader::Update(size_t BudgetBytes)
+{
+    uint Completed = 0;
+
+    for (;;) {
+        if (!m_pUploading) {
+            // Creating the GL objects is cheap, but don't start a new mesh
+            // without any budget left for its data
+            if (BudgetBytes == 0) {
+                break;
+            }
+
+            {
+                lock_guard<mutex> Lock(m_Mutex);
+
+                if (m_Imported.empty()) {
+                    break;
+                }
+
+                m_pUploading = m_Imported.front();
+                m_Imported.pop_front();
+            }
+
+            if (!m_pUploading->Ok || !m_pUploading->pScene->BeginUpload(m_pUploading->Mesh)) {
+                Finish(*m_pUploading, false);
+                m_pUploading.reset();
+                Completed++;
+                continue;
+            }
+        }
+
+        if (!m_pUploading->pScene->ContinueUpload(BudgetBytes)) {
+            break;
+        }
+
+        Finish(*m_pUploading, true);
+        m_pUploading.reset();
+        Completed++;
+    }
+
+    return Completed;
+}
+
+
+uint AsyncMeshLoader::NumPending() const
+{
+    lock_guard<mutex> Lock(m_Mutex);
+    return m_NumPending;
+}
+
+
+void AsyncMeshLoader::Finish(Job& J, bool Ok)
+{
+    {
+        lock_guard<mutex> Lock(m_Mutex);
+        m_NumPending--;
+    }
+
+    if (J.Done) {
+        J.Done(Ok);
+    }
+}
+
+
+void AsyncMeshLoader::WorkerMain()
+{
+    for (;;) {
+        shared_ptr<Job> pJob;
+
+        {
+            unique_lock<mutex> Lock(m_Mutex);
+            m_WorkReady.wait(Lock, [this]() { return m_Quit || !m_Queued.empty(); });
+
+            if (m_Quit) {
+                return;
+            }
+
+            pJob = m_Queued.front();
+            m_Queued.pop_front();
+        }
+
+        pJob->Ok = pJob->pScene->ImportMesh(pJob->Filename, pJob->CacheFilename, pJob->Mesh);
+
+        lock_guard<mutex> Lock(m_Mutex);
+        m_Imported.push_back(pJob);
+    }
+}
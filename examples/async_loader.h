@@ -0,0 +1,69 @@
+#ifndef ASYNC_LOADER_H
+#define	ASYNC_LOADER_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "scene.h"
+
+using namespace std;
+
+// Loads meshes without stalling the render thread. Scene::ImportMesh (the
+// cache read or the Assimp import, flattening and skeleton compilation)
+// runs on the loader's own threads; Update, called once per frame on the
+// render thread, then creates the GL objects of finished imports and
+// uploads their mesh buffers a bounded number of bytes per frame.
+class AsyncMeshLoader
+{
+public:
+    explicit AsyncMeshLoader(uint NumThreads = 1);
+
+    // Waits for the imports in progress. Loads that haven't finished are
+    // dropped without calling Done.
+    ~AsyncMeshLoader();
+
+    // Queues loading Filename into pScene, which has to outlive the load.
+    // The Scene keeps rendering its current mesh until Update starts the
+    // upload of the new one; Done is then called from Update with the
+    // result once the upload is finished or the load failed.
+    void Load(Scene* pScene, const string& Filename, const string& CacheFilename = "",
+              const function<void(bool)>& Done = function<void(bool)>());
+
+    // Uploads at most BudgetBytes of mesh data and returns the number of
+    // loads completed by this call. Render thread only.
+    uint Update(size_t BudgetBytes);
+
+    // Loads queued, importing or uploading
+    uint NumPending() const;
+
+private:
+    struct Job
+    {
+        Scene* pScene;
+        string Filename;
+        string CacheFilename;
+        function<void(bool)> Done;
+        ImportedMesh Mesh;
+        bool Ok;
+    };
+
+    void WorkerMain();
+    void Finish(Job& J, bool Ok);
+
+    vector<thread> m_Workers;
+    mutable mutex m_Mutex;
+    condition_variable m_WorkReady;
+    deque<shared_ptr<Job> > m_Queued;      // waiting for a worker
+    deque<shared_ptr<Job> > m_Imported;    // waiting for the render thread
+    shared_ptr<Job> m_pUploading;
+    uint m_NumPending;
+    bool m_Quit;
+};
+
+#endif	/* ASYNC_LOADER_H */
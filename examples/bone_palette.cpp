@@ -0,0 +1,150 @@
+#include "bone_palette.h"
+
+BonePaletteBuffer::BonePaletteBuffer()
+{
+    m_Buffer     = 0;
+    m_Texture    = 0;
+    m_MaxBones   = 0;
+    m_TexelsPerBone = 0;
+    m_Persistent = false;
+    m_Frame      = 0;
+    m_Region     = 0;
+    m_pMapped    = NULL;
+
+    for (uint i = 0 ; i < NUM_PALETTE_REGIONS ; i++) {
+        m_Fences[i] = 0;
+    }
+}
+
+
+BonePaletteBuffer::~BonePaletteBuffer()
+{
+    Clear();
+}
+
+
+void BonePaletteBuffer::Clear()
+{
+    for (uint i = 0 ; i < NUM_PALETTE_REGIONS ; i++) {
+        if (m_Fences[i]) {
+            glDeleteSync(m_Fences[i]);
+            m_Fences[i] = 0;
+        }
+    }
+
+    if (m_pMapped) {
+        glBindBuffer(GL_TEXTURE_BUFFER, m_Buffer);
+        glUnmapBuffer(GL_TEXTURE_BUFFER);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+        m_pMapped = NULL;
+    }
+
+    if (m_Texture != 0) {
+        glDeleteTextures(1, &m_Texture);
+        m_Texture = 0;
+    }
+
+    if (m_Buffer != 0) {
+        glDeleteBuffers(1, &m_Buffer);
+        m_Buffer = 0;
+    }
+
+    m_Staging.clear();
+    m_MaxBones = 0;
+    m_Frame    = 0;
+}
+
+
+bool BonePaletteBuffer::Init(uint MaxBones, uint BoneSize)
+{
+    Clear();
+
+    assert(BoneSize > 0 && BoneSize % sizeof(glm::vec4) == 0);
+
+    m_MaxBones   = MaxBones > 0 ? MaxBones : 1;
+    m_TexelsPerBone = BoneSize / sizeof(glm::vec4);
+    m_Persistent = GLEW_ARB_buffer_storage || GLEW_VERSION_4_4;
+
+    const GLsizeiptr RegionSize = sizeof(glm::vec4) * m_TexelsPerBone * m_MaxBones;
+
+    // The texture covers the whole buffer, every region included
+    GLint MaxTexels = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &MaxTexels);
+
+    if ((GLint64)m_TexelsPerBone * m_MaxBones * (m_Persistent ? NUM_PALETTE_REGIONS : 1) > MaxTexels) {
+        m_MaxBones = 0;
+        return false;
+    }
+
+    glGenBuffers(1, &m_Buffer);
+    glBindBuffer(GL_TEXTURE_BUFFER, m_Buffer);
+
+    if (m_Persistent) {
+        const GLbitfield Flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_TEXTURE_BUFFER, RegionSize * NUM_PALETTE_REGIONS, NULL, Flags);
+        m_pMapped = (glm::vec4*)glMapBufferRange(GL_TEXTURE_BUFFER, 0, RegionSize * NUM_PALETTE_REGIONS, Flags);
+    }
+    else {
+        glBufferData(GL_TEXTURE_BUFFER, RegionSize, NULL, GL_STREAM_DRAW);
+        m_Staging.resize(m_TexelsPerBone * m_MaxBones);
+    }
+
+    glGenTextures(1, &m_Texture);
+    glBindTexture(GL_TEXTURE_BUFFER, m_Texture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, m_Buffer);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+    return glGetError() == GL_NO_ERROR && (!m_Persistent || m_pMapped);
+}
+
+
+glm::vec4* BonePaletteBuffer::MapFrame()
+{
+    if (!m_Persistent) {
+        return &m_Staging[0];
+    }
+
+    // Every draw reading the previous region has been issued by now
+    if (m_Frame > 0) {
+        m_Fences[m_Region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+
+    m_Region = m_Frame % NUM_PALETTE_REGIONS;
+    m_Frame++;
+
+    if (m_Fences[m_Region]) {
+        // Only blocks when the GPU is more than two frames behind
+        while (glClientWaitSync(m_Fences[m_Region], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED) {
+        }
+        glDeleteSync(m_Fences[m_Region]);
+        m_Fences[m_Region] = 0;
+    }
+
+    return m_pMapped + m_Region * m_MaxBones * m_TexelsPerBone;
+}
+
+
+void BonePaletteBuffer::EndFrame(uint NumBones)
+{
+    // Coherent mapping: the writes are already visible
+    if (m_Persistent || NumBones == 0) {
+        return;
+    }
+
+    glBindBuffer(GL_TEXTURE_BUFFER, m_Buffer);
+    glBufferData(GL_TEXTURE_BUFFER, sizeof(glm::vec4) * m_TexelsPerBone * m_MaxBones, NULL, GL_STREAM_DRAW);
+    glBufferSubData(GL_TEXTURE_BUFFER, 0, sizeof(glm::vec4) * m_TexelsPerBone * NumBones, &m_Staging[0]);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+
+void BonePaletteBuffer::Bind(GLuint TextureUnit, GLint OffsetLocation) const
+{
+    glActiveTexture(GL_TEXTURE0 + TextureUnit);
+    glBindTexture(GL_TEXTURE_BUFFER, m_Texture);
+
+    if (OffsetLocation >= 0) {
+        glUniform1i(OffsetLocation, m_Persistent ? m_Region * m_MaxBones * m_TexelsPerBone : 0);
+    }
+}
@@ -0,0 +1,73 @@
+#ifndef BONE_PALETTE_H
+#define	BONE_PALETTE_H
+
+#include <assert.h>
+#include <vector>
+#include <GL/glew.h>
+
+#include "pose_math.h"
+
+using namespace std;
+
+// Bone palettes for the GPU, stored as a texture buffer of RGBA32F texels
+// (three per AffineMatrix, two per DualQuaternion) and read with texelFetch
+// in the vertex shader.
+//
+// With ARB_buffer_storage the buffer is mapped once, persistently, and split
+// into three regions used round robin, each guarded by a fence so the CPU
+// never writes a region the GPU may still be reading. Without it palettes
+// are written to system memory and uploaded into an orphaned buffer.
+class BonePaletteBuffer
+{
+public:
+    BonePaletteBuffer();
+
+    ~BonePaletteBuffer();
+
+    // MaxBones is the number of bones that can be written per frame, e.g.
+    // the bones of every instance of a crowd, and BoneSize the size of one
+    // bone, sizeof(AffineMatrix) or sizeof(DualQuaternion). Fails if the
+    // buffer would exceed GL_MAX_TEXTURE_BUFFER_SIZE.
+    bool Init(uint MaxBones, uint BoneSize = sizeof(AffineMatrix));
+
+    void Clear();
+
+    uint MaxBones() const
+    {
+        return m_MaxBones;
+    }
+
+    // Returns room for MaxBones() bones of type T, the type the palette was
+    // created for, for the frame about to be drawn
+    template <class T> T* BeginFrame()
+    {
+        assert(sizeof(T) == m_TexelsPerBone * sizeof(glm::vec4));
+        return (T*)MapFrame();
+    }
+
+    // Makes the first NumBones bones written since BeginFrame visible to
+    // the GPU
+    void EndFrame(uint NumBones);
+
+    // Binds the palette texture to TextureUnit and sets OffsetLocation to
+    // the first texel of this frame's region
+    void Bind(GLuint TextureUnit, GLint OffsetLocation) const;
+
+private:
+    #define NUM_PALETTE_REGIONS 3
+
+    glm::vec4* MapFrame();
+
+    GLuint m_Buffer;
+    GLuint m_Texture;
+    uint m_MaxBones;
+    uint m_TexelsPerBone;
+    bool m_Persistent;
+    uint m_Frame;
+    uint m_Region;
+    glm::vec4* m_pMapped;
+    GLsync m_Fences[NUM_PALETTE_REGIONS];
+    vector<glm::vec4> m_Staging;
+};
+
+#endif	/* BONE_PALETTE_H */
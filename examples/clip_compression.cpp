@@ -0,0 +1,343 @@
+#include <math.h>
+#include <algorithm>
+
+#include "clip_compression.h"
+
+// Most keys one pair of kept keys may replace, which bounds the quadratic
+// cost of reducing long tracks
+#define MAX_SEGMENT_KEYS 1024
+
+#define VECTOR_STEPS 65535.0f
+
+// Keys kept from one track of the source clip
+struct ReducedTrack
+{
+    const vector<float>* pTimes;
+    vector<uint> Keys;      // a single key for constant tracks
+    aiVector3D Min;         // vector tracks only
+    aiVector3D Scale;
+};
+
+
+static inline float Distance(const aiVector3D& a, const aiVector3D& b)
+{
+    return (a - b).Length();
+}
+
+
+// Angle between two rotations. In double as acos is too coarse near 1 in
+// float for tolerances around a milliradian.
+static inline float Distance(const aiQuaternion& a, const aiQuaternion& b)
+{
+    double Dot = fabs((double)a.x * b.x + (double)a.y * b.y + (double)a.z * b.z + (double)a.w * b.w);
+
+    return (float)(2.0 * acos(Dot < 1.0 ? Dot : 1.0));
+}
+
+
+static inline aiVector3D Interpolate(const aiVector3D& Start, const aiVector3D& End, float Factor)
+{
+    return Start + Factor * (End - Start);
+}
+
+
+// The same interpolation as SampleChannel
+static inline aiQuaternion Interpolate(const aiQuaternion& Start, const aiQuaternion& End, float Factor)
+{
+    aiQuaternion Out;
+    aiQuaternion::Interpolate(Out, Start, End, Factor);
+    Out.Normalize();
+
+    return Out;
+}
+
+
+static inline uint16_t QuantizeComponent(float Value, float Min, float Scale)
+{
+    if (Scale <= 0.0f) {
+        return 0;
+    }
+
+    float q = (Value - Min) / Scale + 0.5f;
+
+    return (uint16_t)(q < 0.0f ? 0.0f : (q > VECTOR_STEPS ? VECTOR_STEPS : q));
+}
+
+
+static void QuantizeVector(const aiVector3D& v, const ReducedTrack& Track, uint16_t* pKey)
+{
+    pKey[0] = QuantizeComponent(v.x, Track.Min.x, Track.Scale.x);
+    pKey[1] = QuantizeComponent(v.y, Track.Min.y, Track.Scale.y);
+    pKey[2] = QuantizeComponent(v.z, Track.Min.z, Track.Scale.z);
+}
+
+
+template <class T>
+static bool IsConstant(const vector<T>& Values, float Tolerance)
+{
+    for (uint i = 1 ; i < Values.size() ; i++) {
+        if (Distance(Values[i], Values[0]) > Tolerance) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+// Whether interpolating the decoded keys Start and End reproduces every
+// source key between them
+template <class T>
+static bool SegmentFits(const vector<float>& Times, const vector<T>& Values, const vector<T>& Decoded,
+                        uint Start, uint End, float Tolerance)
+{
+    const float DeltaTime = Times[End] - Times[Start];
+
+    for (uint i = Start + 1 ; i < End ; i++) {
+        float Factor = DeltaTime > 0.0f ? (Times[i] - Times[Start]) / DeltaTime : 0.0f;
+
+        if (Distance(Interpolate(Decoded[Start], Decoded[End], Factor), Values[i]) > Tolerance) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+// Greedily stretches every segment as far as it fits, the first and last
+// keys are always kept
+template <class T>
+static void ReduceKeys(const vector<float>& Times, const vector<T>& Values, const vector<T>& Decoded,
+                       float Tolerance, vector<uint>& Keys)
+{
+    const uint NumKeys = Times.size();
+    Keys.assign(1, 0);
+
+    for (uint Start = 0 ; Start + 1 < NumKeys ; Start = Keys.back()) {
+        uint End = Start + 1;
+
+        while (End + 1 < NumKeys && End + 1 - Start <= MAX_SEGMENT_KEYS &&
+               SegmentFits(Times, Values, Decoded, Start, End + 1, Tolerance)) {
+            End++;
+        }
+
+        Keys.push_back(End);
+    }
+}
+
+
+static void ReduceVectorTrack(const vector<float>& Times, const vector<aiVector3D>& Values, float Tolerance,
+                              ReducedTrack& Track)
+{
+    Track.pTimes = &Times;
+    Track.Min    = Values[0];
+    Track.Scale  = aiVector3D(0.0f, 0.0f, 0.0f);
+
+    if (IsConstant(Values, Tolerance)) {
+        Track.Keys.assign(1, 0);
+        return;
+    }
+
+    aiVector3D Max = Values[0];
+
+    for (uint i = 1 ; i < Values.size() ; i++) {
+        Track.Min.x = min(Track.Min.x, Values[i].x);
+        Track.Min.y = min(Track.Min.y, Values[i].y);
+        Track.Min.z = min(Track.Min.z, Values[i].z);
+        Max.x = max(Max.x, Values[i].x);
+        Max.y = max(Max.y, Values[i].y);
+        Max.z = max(Max.z, Values[i].z);
+    }
+
+    Track.Scale = (Max - Track.Min) / VECTOR_STEPS;
+
+    // Reduce against what the sampler will actually decode
+    vector<aiVector3D> Decoded(Values.size());
+
+    for (uint i = 0 ; i < Values.size() ; i++) {
+        uint16_t Key[3];
+        QuantizeVector(Values[i], Track, Key);
+        Decoded[i] = aiVector3D(Track.Min.x + Track.Scale.x * Key[0],
+                                Track.Min.y + Track.Scale.y * Key[1],
+                                Track.Min.z + Track.Scale.z * Key[2]);
+    }
+
+    ReduceKeys(Times, Values, Decoded, Tolerance, Track.Keys);
+}
+
+
+static void ReduceRotationTrack(const vector<float>& Times, const vector<aiQuaternion>& Values, float Tolerance,
+                                ReducedTrack& Track)
+{
+    Track.pTimes = &Times;
+
+    if (IsConstant(Values, Tolerance)) {
+        Track.Keys.assign(1, 0);
+        return;
+    }
+
+    vector<aiQuaternion> Decoded(Values.size());
+
+    for (uint i = 0 ; i < Values.size() ; i++) {
+        uint16_t Key[3];
+        EncodeRotation(Values[i], Key);
+        Decoded[i] = DecodeRotation(Key);
+    }
+
+    ReduceKeys(Times, Values, Decoded, Tolerance, Track.Keys);
+}
+
+
+static void AddTimes(const ReducedTrack& Track, vector<float>& Times)
+{
+    if (Track.Keys.size() > 1) {
+        for (uint i = 0 ; i < Track.Keys.size() ; i++) {
+            Times.push_back((*Track.pTimes)[Track.Keys[i]]);
+        }
+    }
+}
+
+
+static void WriteFrames(const ReducedTrack& Track, CompressedClip& Clip, CompressedTrack& Out)
+{
+    Out.FirstFrame = Clip.Frames.size();
+    Out.NumKeys    = Track.Keys.size();
+    Out.Min        = Track.Min;
+    Out.Scale      = Track.Scale;
+
+    if (Track.Keys.size() > 1) {
+        for (uint i = 0 ; i < Track.Keys.size() ; i++) {
+            const float Time = (*Track.pTimes)[Track.Keys[i]];
+            Clip.Frames.push_back(lower_bound(Clip.Times.begin(), Clip.Times.end(), Time) - Clip.Times.begin());
+        }
+    }
+}
+
+
+static void WriteVectorTrack(const ReducedTrack& Track, const vector<aiVector3D>& Values, CompressedClip& Clip,
+                             CompressedTrack& Out)
+{
+    WriteFrames(Track, Clip, Out);
+    Out.FirstValue = Clip.VectorKeys.size() / 3;
+
+    // Constant tracks decode to Min and need no keys
+    if (Track.Keys.size() > 1) {
+        for (uint i = 0 ; i < Track.Keys.size() ; i++) {
+            uint16_t Key[3];
+            QuantizeVector(Values[Track.Keys[i]], Track, Key);
+            Clip.VectorKeys.insert(Clip.VectorKeys.end(), Key, Key + 3);
+        }
+    }
+}
+
+
+static void WriteRotationTrack(const ReducedTrack& Track, const vector<aiQuaternion>& Values, CompressedClip& Clip,
+                               CompressedTrack& Out)
+{
+    WriteFrames(Track, Clip, Out);
+    Out.FirstValue = Clip.RotationKeys.size() / 3;
+
+    for (uint i = 0 ; i < Track.Keys.size() ; i++) {
+        uint16_t Key[3];
+        EncodeRotation(Values[Track.Keys[i]], Key);
+        Clip.RotationKeys.insert(Clip.RotationKeys.end(), Key, Key + 3);
+    }
+}
+
+
+bool CompressAnimationClip(AnimationClip& Clip, const ClipCompressionSettings& Settings)
+{
+    const uint NumChannels = Clip.Channels.size();
+
+    if (NumChannels == 0) {
+        return true;
+    }
+
+    // Three tracks per channel: position, rotation and scaling
+    vector<ReducedTrack> Tracks(NumChannels * 3);
+    vector<float> Times;
+
+    for (uint i = 0 ; i < NumChannels ; i++) {
+        const AnimationChannel& Channel = Clip.Channels[i];
+
+        ReduceVectorTrack(Channel.PositionTimes, Channel.Positions, Settings.PositionTolerance, Tracks[3 * i]);
+        ReduceRotationTrack(Channel.RotationTimes, Channel.Rotations, Settings.RotationTolerance, Tracks[3 * i + 1]);
+        ReduceVectorTrack(Channel.ScalingTimes, Channel.Scalings, Settings.ScalingTolerance, Tracks[3 * i + 2]);
+
+        for (uint j = 0 ; j < 3 ; j++) {
+            AddTimes(Tracks[3 * i + j], Times);
+        }
+    }
+
+    sort(Times.begin(), Times.end());
+    Times.erase(unique(Times.begin(), Times.end()), Times.end());
+
+    if (Times.size() > 65536) {
+        return false;
+    }
+
+    CompressedClip Compressed;
+    Compressed.Times.swap(Times);
+    Compressed.Channels.resize(NumChannels);
+
+    for (uint i = 0 ; i < NumChannels ; i++) {
+        const AnimationChannel& Channel = Clip.Channels[i];
+        CompressedChannel& Out = Compressed.Channels[i];
+
+        WriteVectorTrack(Tracks[3 * i], Channel.Positions, Compressed, Out.Position);
+        WriteRotationTrack(Tracks[3 * i + 1], Channel.Rotations, Compressed, Out.Rotation);
+        WriteVectorTrack(Tracks[3 * i + 2], Channel.Scalings, Compressed, Out.Scaling);
+    }
+
+    Clip.Compressed = Compressed;
+    vector<AnimationChannel>().swap(Clip.Channels);
+
+    return true;
+}
+
+
+static void SampleClip(const AnimationClip& Clip, uint Channel, float AnimationTime, KeyframeCursor& Cursor,
+                       aiVector3D& Position, aiQuaternion& Rotation, aiVector3D& Scaling)
+{
+    if (Clip.IsCompressed()) {
+        SampleCompressedChannel(Clip.Compressed, Channel, FindCompressedFrame(Clip.Compressed, AnimationTime),
+                                AnimationTime, Cursor, Position, Rotation, Scaling);
+    }
+    else {
+        SampleChannel(Clip.Channels[Channel], AnimationTime, Cursor, Position, Rotation, Scaling);
+    }
+}
+
+
+ClipCompressionError MeasureCompressionError(const AnimationClip& Raw, const AnimationClip& Compressed)
+{
+    ClipCompressionError Error = { 0.0f, 0.0f, 0.0f };
+
+    for (uint i = 0 ; i < Raw.Channels.size() && i < Compressed.NumChannels() ; i++) {
+        const AnimationChannel& Channel = Raw.Channels[i];
+
+        vector<float> Times(Channel.PositionTimes);
+        Times.insert(Times.end(), Channel.RotationTimes.begin(), Channel.RotationTimes.end());
+        Times.insert(Times.end(), Channel.ScalingTimes.begin(), Channel.ScalingTimes.end());
+        sort(Times.begin(), Times.end());
+        Times.erase(unique(Times.begin(), Times.end()), Times.end());
+
+        KeyframeCursor RawCursor, CompressedCursor;
+
+        for (uint j = 0 ; j < Times.size() * 2 - 1 ; j++) {
+            const float Time = j % 2 ? (Times[j / 2] + Times[j / 2 + 1]) * 0.5f : Times[j / 2];
+
+            aiVector3D Position, CompressedPosition, Scaling, CompressedScaling;
+            aiQuaternion Rotation, CompressedRotation;
+            SampleChannel(Channel, Time, RawCursor, Position, Rotation, Scaling);
+            SampleClip(Compressed, i, Time, CompressedCursor, CompressedPosition, CompressedRotation, CompressedScaling);
+
+            Error.Position = max(Error.Position, Distance(Position, CompressedPosition));
+            Error.Rotation = max(Error.Rotation, Distance(Rotation, CompressedRotation));
+            Error.Scaling  = max(Error.Scaling, Distance(Scaling, CompressedScaling));
+        }
+    }
+
+    return Error;
+}
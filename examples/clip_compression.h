@@ -0,0 +1,40 @@
+#ifndef CLIP_COMPRESSION_H
+#define	CLIP_COMPRESSION_H
+
+#include "animation.h"
+
+// Largest error CompressAnimationClip may add to the keys of a track
+struct ClipCompressionSettings
+{
+    float PositionTolerance;    // in the units of the model
+    float RotationTolerance;    // in radians
+    float ScalingTolerance;
+
+    ClipCompressionSettings()
+    {
+        PositionTolerance = 0.01f;
+        RotationTolerance = 0.001f;
+        ScalingTolerance  = 0.001f;
+    }
+};
+
+// Largest local space differences between two versions of a clip
+struct ClipCompressionError
+{
+    float Position;
+    float Rotation;     // in radians
+    float Scaling;
+};
+
+// Replaces the channels of Clip with Clip.Compressed. Tracks whose keys all
+// stay within the tolerance of the first key become constant; of the
+// others only the keys that interpolation between the kept (quantized) keys
+// can't reproduce within the tolerance are kept. Returns false, leaving the
+// clip as it is, when the kept key times don't fit 16-bit frame numbers.
+bool CompressAnimationClip(AnimationClip& Clip, const ClipCompressionSettings& Settings);
+
+// Samples both clips at and halfway between every key of Raw, an
+// uncompressed clip, and returns the largest differences to Compressed
+ClipCompressionError MeasureCompressionError(const AnimationClip& Raw, const AnimationClip& Compressed);
+
+#endif	/* CLIP_COMPRESSION_H */
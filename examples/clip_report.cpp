@@ -0,0 +1,166 @@
+// Reports what CompressAnimationClip does to the animations of models:
+// keys and bytes before and after, and the error it adds.
+//
+// usage: clip_report [--position T] [--rotation T] [--scaling T] model files...
+//
+//   --position T  position tolerance in model units (default 0.01)
+//   --rotation T  rotation tolerance in radians (default 0.001)
+//   --scaling T   scaling tolerance (default 0.001)
+//
+// Local errors are the largest differences of any channel at and between
+// its keys. The model error is the largest distance between a node's
+// origin in model space with and without compression, sampled at 120 Hz,
+// which includes the error accumulated down the hierarchy.
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include <assimp/Importer.hpp>
+#include <assimp/postprocess.h>
+#include <assimp/scene.h>
+
+#include "clip_compression.h"
+#include "scene.h"
+
+#define SAMPLES_PER_SECOND 120.0f
+
+static uint CountKeys(const AnimationClip& Clip)
+{
+    uint Keys = 0;
+
+    for (uint i = 0 ; i < Clip.Channels.size() ; i++) {
+        Keys += Clip.Channels[i].PositionTimes.size() + Clip.Channels[i].RotationTimes.size() +
+                Clip.Channels[i].ScalingTimes.size();
+    }
+
+    for (uint i = 0 ; i < Clip.Compressed.Channels.size() ; i++) {
+        const CompressedChannel& Channel = Clip.Compressed.Channels[i];
+        Keys += Channel.Position.NumKeys + Channel.Rotation.NumKeys + Channel.Scaling.NumKeys;
+    }
+
+    return Keys;
+}
+
+
+static float ModelError(const Scene& Raw, const Scene& Compressed, uint AnimationIndex)
+{
+    const AnimationClip& Clip = Raw.Animation(AnimationIndex);
+    const float Seconds = Clip.Duration / Clip.TicksPerSecond;
+    const uint NumSamples = max((uint)(Seconds * SAMPLES_PER_SECOND), 1u);
+
+    AnimationInstance RawInstance, CompressedInstance;
+    Raw.InitInstance(RawInstance, AnimationIndex);
+    Compressed.InitInstance(CompressedInstance, AnimationIndex);
+
+    vector<AffineMatrix> Palette;
+    float Error = 0.0f;
+
+    for (uint i = 0 ; i < NumSamples ; i++) {
+        const float Time = Seconds * i / NumSamples;
+
+        Raw.BoneTransform(RawInstance, Time, Palette);
+        Compressed.BoneTransform(CompressedInstance, Time, Palette);
+
+        for (uint j = 0 ; j < RawInstance.GlobalTransforms.size() ; j++) {
+            const AffineMatrix& a = RawInstance.GlobalTransforms[j];
+            const AffineMatrix& b = CompressedInstance.GlobalTransforms[j];
+            const aiVector3D Delta(a.Row(0).w - b.Row(0).w, a.Row(1).w - b.Row(1).w, a.Row(2).w - b.Row(2).w);
+
+            Error = max(Error, Delta.Length());
+        }
+    }
+
+    return Error;
+}
+
+
+static bool Report(const string& Filename, const ClipCompressionSettings& Settings)
+{
+    Assimp::Importer Importer;
+    const aiScene* pScene = Importer.ReadFile(Filename.c_str(), aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs);
+
+    if (!pScene) {
+        printf("Error parsing '%s': '%s'\n", Filename.c_str(), Importer.GetErrorString());
+        return false;
+    }
+
+    Scene Raw, Compressed;
+    Raw.LoadSkeleton(pScene);
+    Compressed.LoadSkeleton(pScene);
+
+    if (!Compressed.CompressAnimations(Settings)) {
+        printf("%s: some animations are too long to compress\n", Filename.c_str());
+    }
+
+    printf("%s: %u animations, %u bones\n", Filename.c_str(), Raw.NumAnimations(), Raw.NumBones());
+    printf("%-4s %-24s %10s %10s %10s %10s %7s %10s %10s %10s %10s\n", "clip", "name", "keys", "kept", "bytes",
+           "compressed", "ratio", "position", "rotation", "scaling", "model");
+
+    size_t TotalRaw = 0, TotalCompressed = 0;
+
+    for (uint i = 0 ; i < Raw.NumAnimations() ; i++) {
+        const AnimationClip& RawClip = Raw.Animation(i);
+        const AnimationClip& Clip = Compressed.Animation(i);
+        const ClipCompressionError Error = MeasureCompressionError(RawClip, Clip);
+
+        const size_t RawSize = RawClip.RawSize();
+        const size_t CompressedSize = Clip.IsCompressed() ? Clip.Compressed.Size() : Clip.RawSize();
+        TotalRaw += RawSize;
+        TotalCompressed += CompressedSize;
+
+        printf("%-4u %-24.24s %10u %10u %10u %10u %6.1fx %10.6f %9.4fd %10.6f %10.6f\n", i,
+               pScene->mAnimations[i]->mName.data, CountKeys(RawClip), CountKeys(Clip), (uint)RawSize,
+               (uint)CompressedSize, CompressedSize ? double(RawSize) / CompressedSize : 0.0,
+               Error.Position, Error.Rotation * 180.0f / (float)M_PI, Error.Scaling, ModelError(Raw, Compressed, i));
+    }
+
+    printf("total %u bytes, %u compressed\n\n", (uint)TotalRaw, (uint)TotalCompressed);
+
+    return true;
+}
+
+
+int main(int argc, char* argv[])
+{
+    ClipCompressionSettings Settings;
+    vector<string> Files;
+
+    for (int i = 1 ; i < argc ; i++) {
+        const bool HasValue = i + 1 < argc;
+
+        if (strcmp(argv[i], "--position") == 0 && HasValue) {
+            Settings.PositionTolerance = (float)atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--rotation") == 0 && HasValue) {
+            Settings.RotationTolerance = (float)atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--scaling") == 0 && HasValue) {
+            Settings.ScalingTolerance = (float)atof(argv[++i]);
+        }
+        else if (strncmp(argv[i], "--", 2) != 0) {
+            Files.push_back(argv[i]);
+        }
+        else {
+            Files.clear();
+            break;
+        }
+    }
+
+    if (Files.empty()) {
+        printf("usage: %s [--position T] [--rotation T] [--scaling T] model files...\n", argv[0]);
+        return 1;
+    }
+
+    int Ret = 0;
+
+    for (uint i = 0 ; i < Files.size() ; i++) {
+        if (!Report(Files[i], Settings)) {
+            Ret = 1;
+        }
+    }
+
+    return Ret;
+}
@@ -0,0 +1,203 @@
+#include "cpu_skinning.h"
+
+#ifdef POSE_MATH_SIMD
+#include <xmmintrin.h>
+#endif
+
+// Vertices per thread pool chunk
+#define SKINNING_GRAIN 1024
+
+CpuSkinning::CpuSkinning()
+{
+    m_NumVertices = 0;
+#ifdef POSE_MATH_SIMD
+    m_Simd = true;
+#else
+    m_Simd = false;
+#endif
+}
+
+
+void CpuSkinning::Init(const SkinnedVertex* pVertices, uint NumVertices)
+{
+    m_NumVertices = NumVertices;
+
+    // Padding vertices have no weights, they skin to the origin and are
+    // never written out
+    const uint PaddedVertices = (NumVertices + 3) & ~3u;
+
+    for (uint i = 0 ; i < NUM_STREAMS ; i++) {
+        m_Streams[i].assign(PaddedVertices, 0.0f);
+    }
+
+    for (uint i = 0 ; i < NUM_BONES_PER_VEREX ; i++) {
+        m_BoneIDs[i].assign(PaddedVertices, 0);
+    }
+
+    for (uint i = 0 ; i < NumVertices ; i++) {
+        const SkinnedVertex& v = pVertices[i];
+
+        m_Streams[POSITION_X][i] = v.Position.x;
+        m_Streams[POSITION_Y][i] = v.Position.y;
+        m_Streams[POSITION_Z][i] = v.Position.z;
+        m_Streams[NORMAL_X][i]   = v.Normal.x;
+        m_Streams[NORMAL_Y][i]   = v.Normal.y;
+        m_Streams[NORMAL_Z][i]   = v.Normal.z;
+
+        for (uint j = 0 ; j < NUM_BONES_PER_VEREX ; j++) {
+            m_Streams[WEIGHT_0 + j][i] = v.Bones.Weights[j];
+            m_BoneIDs[j][i] = v.Bones.IDs[j];
+        }
+    }
+}
+
+
+void CpuSkinning::SetSimd(bool Simd)
+{
+#ifdef POSE_MATH_SIMD
+    m_Simd = Simd;
+#endif
+}
+
+
+void CpuSkinning::Skin(const AffineMatrix* pPalette, CpuSkinnedVertex* pOut, ThreadPool& Pool) const
+{
+    // Chunks are made of whole groups of four vertices
+    const uint NumGroups = (m_NumVertices + 3) / 4;
+
+    Pool.ParallelFor(NumGroups, SKINNING_GRAIN / 4, [&](uint Begin, uint End) {
+        const uint EndVertex = min(End * 4, m_NumVertices);
+
+        if (m_Simd) {
+            SkinSimd(pPalette, pOut, Begin * 4, EndVertex);
+        }
+        else {
+            SkinScalar(pPalette, pOut, Begin * 4, EndVertex);
+        }
+    });
+}
+
+
+bool CpuSkinning::SkinToBuffer(const AffineMatrix* pPalette, GLuint Buffer, ThreadPool& Pool) const
+{
+    if (m_NumVertices == 0) {
+        return true;
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, Buffer);
+
+    // The workers write straight into the mapping; no GL call is made
+    // until they are all done
+    void* pMapped = glMapBufferRange(GL_ARRAY_BUFFER, 0, sizeof(CpuSkinnedVertex) * m_NumVertices,
+                                     GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+
+    if (!pMapped) {
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        return false;
+    }
+
+    Skin(pPalette, (CpuSkinnedVertex*)pMapped, Pool);
+
+    const bool Ret = glUnmapBuffer(GL_ARRAY_BUFFER) == GL_TRUE;
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    return Ret;
+}
+
+
+void CpuSkinning::SkinScalar(const AffineMatrix* pPalette, CpuSkinnedVertex* pOut, uint Begin, uint End) const
+{
+    for (uint i = Begin ; i < End ; i++) {
+        glm::vec4 Rows[3] = { glm::vec4(0.0f), glm::vec4(0.0f), glm::vec4(0.0f) };
+
+        for (uint k = 0 ; k < NUM_BONES_PER_VEREX ; k++) {
+            const AffineMatrix& Bone = pPalette[m_BoneIDs[k][i]];
+            const float Weight = m_Streams[WEIGHT_0 + k][i];
+
+            for (uint r = 0 ; r < 3 ; r++) {
+                Rows[r] += Bone.Row(r) * Weight;
+            }
+        }
+
+        const glm::vec4 Position(m_Streams[POSITION_X][i], m_Streams[POSITION_Y][i], m_Streams[POSITION_Z][i], 1.0f);
+        const glm::vec4 Normal(m_Streams[NORMAL_X][i], m_Streams[NORMAL_Y][i], m_Streams[NORMAL_Z][i], 0.0f);
+
+        pOut[i].Position = aiVector3D(glm::dot(Rows[0], Position), glm::dot(Rows[1], Position), glm::dot(Rows[2], Position));
+        pOut[i].Normal   = aiVector3D(glm::dot(Rows[0], Normal), glm::dot(Rows[1], Normal), glm::dot(Rows[2], Normal));
+    }
+}
+
+
+void CpuSkinning::SkinSimd(const AffineMatrix* pPalette, CpuSkinnedVertex* pOut, uint Begin, uint End) const
+{
+#ifdef POSE_MATH_SIMD
+    // Every bone is 12 consecutive floats, three rows of four
+    const float* pBones = (const float*)pPalette;
+    const __m128 Zero = _mm_setzero_ps();
+
+    for (uint i = Begin ; i < End ; i += 4) {
+        // Blended matrices of the four vertices, one register per element
+        __m128 m[12];
+
+        for (uint e = 0 ; e < 12 ; e++) {
+            m[e] = Zero;
+        }
+
+        for (uint k = 0 ; k < NUM_BONES_PER_VEREX ; k++) {
+            const __m128 Weight = _mm_loadu_ps(&m_Streams[WEIGHT_0 + k][i]);
+            const uint* pIDs = &m_BoneIDs[k][i];
+            const float* pBone0 = pBones + 12 * pIDs[0];
+            const float* pBone1 = pBones + 12 * pIDs[1];
+            const float* pBone2 = pBones + 12 * pIDs[2];
+            const float* pBone3 = pBones + 12 * pIDs[3];
+
+            for (uint r = 0 ; r < 3 ; r++) {
+                // Row r of each vertex's bone, transposed so that register
+                // c holds element (r, c) of all four
+                __m128 c0 = _mm_loadu_ps(pBone0 + 4 * r);
+                __m128 c1 = _mm_loadu_ps(pBone1 + 4 * r);
+                __m128 c2 = _mm_loadu_ps(pBone2 + 4 * r);
+                __m128 c3 = _mm_loadu_ps(pBone3 + 4 * r);
+                _MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+
+                m[4 * r + 0] = _mm_add_ps(m[4 * r + 0], _mm_mul_ps(c0, Weight));
+                m[4 * r + 1] = _mm_add_ps(m[4 * r + 1], _mm_mul_ps(c1, Weight));
+                m[4 * r + 2] = _mm_add_ps(m[4 * r + 2], _mm_mul_ps(c2, Weight));
+                m[4 * r + 3] = _mm_add_ps(m[4 * r + 3], _mm_mul_ps(c3, Weight));
+            }
+        }
+
+        const __m128 px = _mm_loadu_ps(&m_Streams[POSITION_X][i]);
+        const __m128 py = _mm_loadu_ps(&m_Streams[POSITION_Y][i]);
+        const __m128 pz = _mm_loadu_ps(&m_Streams[POSITION_Z][i]);
+        const __m128 nx = _mm_loadu_ps(&m_Streams[NORMAL_X][i]);
+        const __m128 ny = _mm_loadu_ps(&m_Streams[NORMAL_Y][i]);
+        const __m128 nz = _mm_loadu_ps(&m_Streams[NORMAL_Z][i]);
+
+        __m128 Out[8];
+
+        for (uint r = 0 ; r < 3 ; r++) {
+            const __m128* pRow = &m[4 * r];
+            Out[r] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(pRow[0], px), _mm_mul_ps(pRow[1], py)),
+                                _mm_add_ps(_mm_mul_ps(pRow[2], pz), pRow[3]));
+            Out[3 + r] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(pRow[0], nx), _mm_mul_ps(pRow[1], ny)), _mm_mul_ps(pRow[2], nz));
+        }
+        Out[6] = Zero;
+        Out[7] = Zero;
+
+        // Back to one vertex per register: (x, y, z, nx) and (ny, nz, 0, 0)
+        _MM_TRANSPOSE4_PS(Out[0], Out[1], Out[2], Out[3]);
+        _MM_TRANSPOSE4_PS(Out[4], Out[5], Out[6], Out[7]);
+
+        float* pDst = (float*)(pOut + i);
+        const uint Count = min(End - i, 4u);
+
+        for (uint j = 0 ; j < Count ; j++) {
+            _mm_storeu_ps(pDst + 6 * j, Out[j]);
+            _mm_storel_pi((__m64*)(pDst + 6 * j + 4), Out[4 + j]);
+        }
+    }
+#else
+    SkinScalar(pPalette, pOut, Begin, End);
+#endif
+}
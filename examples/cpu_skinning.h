@@ -0,0 +1,77 @@
+#ifndef CPU_SKINNING_H
+#define	CPU_SKINNING_H
+
+#include <vector>
+#include <GL/glew.h>
+
+#include "pose_math.h"
+#include "scene.h"
+#include "thread_pool.h"
+
+using namespace std;
+
+// Output of CpuSkinning, 24 bytes. Normals are blended but not
+// renormalized, the same as in the vertex shader.
+struct CpuSkinnedVertex
+{
+    aiVector3D Position;
+    aiVector3D Normal;
+};
+
+// Linear blend skinning on the CPU, for work that needs the skinned mesh
+// (collision, picking, bounds, baking) or for GPUs that can't skin.
+//
+// The bind pose is kept as structure-of-arrays so that, with SIMD, four
+// vertices are skinned at once: their bone rows are transposed into SSE
+// registers and blended per matrix element. Chunks of vertices are spread
+// across a thread pool.
+class CpuSkinning
+{
+public:
+    CpuSkinning();
+
+    // Takes a copy of the bind pose vertices
+    void Init(const SkinnedVertex* pVertices, uint NumVertices);
+
+    uint NumVertices() const
+    {
+        return m_NumVertices;
+    }
+
+    // Selects the SSE kernel, only available with POSE_MATH_SIMD. The
+    // scalar kernel produces the same results and exists for comparison.
+    void SetSimd(bool Simd);
+
+    bool Simd() const
+    {
+        return m_Simd;
+    }
+
+    // Writes NumVertices() skinned vertices to pOut using the palette of a
+    // Scene::BoneTransform call. pOut may be mapped GPU memory, it is only
+    // written sequentially.
+    void Skin(const AffineMatrix* pPalette, CpuSkinnedVertex* pOut, ThreadPool& Pool) const;
+
+    // Skins into Buffer, which has to hold NumVertices() vertices, through
+    // a write-only mapping that invalidates its previous contents
+    bool SkinToBuffer(const AffineMatrix* pPalette, GLuint Buffer, ThreadPool& Pool) const;
+
+private:
+    void SkinScalar(const AffineMatrix* pPalette, CpuSkinnedVertex* pOut, uint Begin, uint End) const;
+    void SkinSimd(const AffineMatrix* pPalette, CpuSkinnedVertex* pOut, uint Begin, uint End) const;
+
+    // The streams are padded to a multiple of 4 vertices
+    enum STREAMS {
+        POSITION_X, POSITION_Y, POSITION_Z,
+        NORMAL_X, NORMAL_Y, NORMAL_Z,
+        WEIGHT_0, WEIGHT_1, WEIGHT_2, WEIGHT_3,
+        NUM_STREAMS
+    };
+
+    uint m_NumVertices;
+    bool m_Simd;
+    vector<float> m_Streams[NUM_STREAMS];
+    vector<uint> m_BoneIDs[NUM_BONES_PER_VEREX];
+};
+
+#endif	/* CPU_SKINNING_H */
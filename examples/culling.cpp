@@ -0,0 +1,163 @@
+#include <math.h>
+
+#include "culling.h"
+
+#ifdef POSE_MATH_SIMD
+#include <xmmintrin.h>
+#endif
+
+BoundingBox TransformBounds(const AffineMatrix& m, const BoundingBox& Box)
+{
+    if (Box.Empty()) {
+        return Box;
+    }
+
+    // The centre moves with the matrix, the half extents grow by the
+    // absolute values of its terms
+    const aiVector3D Center = 0.5f * (Box.Min + Box.Max);
+    const aiVector3D Extent = 0.5f * (Box.Max - Box.Min);
+    aiVector3D NewCenter, NewExtent;
+
+    for (uint i = 0 ; i < 3 ; i++) {
+        const glm::vec4 Row = m.Row(i);
+
+        NewCenter[i] = Row.x * Center.x + Row.y * Center.y + Row.z * Center.z + Row.w;
+        NewExtent[i] = fabsf(Row.x) * Extent.x + fabsf(Row.y) * Extent.y + fabsf(Row.z) * Extent.z;
+    }
+
+    BoundingBox Result;
+    Result.Min = NewCenter - NewExtent;
+    Result.Max = NewCenter + NewExtent;
+
+    return Result;
+}
+
+
+Frustum::Frustum()
+{
+    // Nothing is outside
+    for (uint i = 0 ; i < 6 ; i++) {
+        Planes[i] = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+    }
+}
+
+
+Frustum::Frustum(const glm::mat4& Clip)
+{
+    // -w <= x, y, z <= w in clip space (Gribb and Hartmann). glm matrices
+    // are column-major, so the rows are gathered first.
+    glm::vec4 Rows[4];
+
+    for (uint i = 0 ; i < 4 ; i++) {
+        Rows[i] = glm::vec4(Clip[0][i], Clip[1][i], Clip[2][i], Clip[3][i]);
+    }
+
+    for (uint i = 0 ; i < 3 ; i++) {
+        Planes[2 * i]     = Rows[3] + Rows[i];
+        Planes[2 * i + 1] = Rows[3] - Rows[i];
+    }
+}
+
+
+// A box is outside when even its corner furthest along a plane's normal
+// is behind the plane
+static bool BoxVisible(const Frustum& View, const BoundingBox& Box)
+{
+    if (Box.Empty()) {
+        return false;
+    }
+
+    const aiVector3D Center = 0.5f * (Box.Min + Box.Max);
+    const aiVector3D Extent = 0.5f * (Box.Max - Box.Min);
+
+    for (uint i = 0 ; i < 6 ; i++) {
+        const glm::vec4& Plane = View.Planes[i];
+        const float Distance = Plane.x * Center.x + Plane.y * Center.y + Plane.z * Center.z + Plane.w;
+        const float Radius = fabsf(Plane.x) * Extent.x + fabsf(Plane.y) * Extent.y + fabsf(Plane.z) * Extent.z;
+
+        if (Distance + Radius < 0.0f) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+#ifdef POSE_MATH_SIMD
+// Four boxes at once: their centres and extents are transposed into one
+// register per component and every plane is tested on all four
+static uint CullBoxesSimd(const Frustum& View, const BoundingBox* pBoxes, uint NumBoxes, unsigned char* pVisible)
+{
+    const __m128 Half = _mm_set1_ps(0.5f);
+    const __m128 Zero = _mm_setzero_ps();
+    const __m128 SignMask = _mm_set1_ps(-0.0f);
+    uint NumVisible = 0;
+    uint i = 0;
+
+    for ( ; i + 4 <= NumBoxes ; i += 4) {
+        const BoundingBox* b = &pBoxes[i];
+        const __m128 MinX = _mm_setr_ps(b[0].Min.x, b[1].Min.x, b[2].Min.x, b[3].Min.x);
+        const __m128 MinY = _mm_setr_ps(b[0].Min.y, b[1].Min.y, b[2].Min.y, b[3].Min.y);
+        const __m128 MinZ = _mm_setr_ps(b[0].Min.z, b[1].Min.z, b[2].Min.z, b[3].Min.z);
+        const __m128 MaxX = _mm_setr_ps(b[0].Max.x, b[1].Max.x, b[2].Max.x, b[3].Max.x);
+        const __m128 MaxY = _mm_setr_ps(b[0].Max.y, b[1].Max.y, b[2].Max.y, b[3].Max.y);
+        const __m128 MaxZ = _mm_setr_ps(b[0].Max.z, b[1].Max.z, b[2].Max.z, b[3].Max.z);
+
+        const __m128 cx = _mm_mul_ps(_mm_add_ps(MinX, MaxX), Half);
+        const __m128 cy = _mm_mul_ps(_mm_add_ps(MinY, MaxY), Half);
+        const __m128 cz = _mm_mul_ps(_mm_add_ps(MinZ, MaxZ), Half);
+        const __m128 ex = _mm_mul_ps(_mm_sub_ps(MaxX, MinX), Half);
+        const __m128 ey = _mm_mul_ps(_mm_sub_ps(MaxY, MinY), Half);
+        const __m128 ez = _mm_mul_ps(_mm_sub_ps(MaxZ, MinZ), Half);
+
+        // Empty boxes have Min.x above Max.x
+        __m128 Visible = _mm_cmple_ps(MinX, MaxX);
+
+        for (uint p = 0 ; p < 6 ; p++) {
+            const glm::vec4& Plane = View.Planes[p];
+            const __m128 px = _mm_set1_ps(Plane.x), py = _mm_set1_ps(Plane.y), pz = _mm_set1_ps(Plane.z);
+            const __m128 Distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(px, cx), _mm_mul_ps(py, cy)),
+                                               _mm_add_ps(_mm_mul_ps(pz, cz), _mm_set1_ps(Plane.w)));
+            const __m128 Radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_andnot_ps(SignMask, px), ex),
+                                                        _mm_mul_ps(_mm_andnot_ps(SignMask, py), ey)),
+                                             _mm_mul_ps(_mm_andnot_ps(SignMask, pz), ez));
+
+            Visible = _mm_and_ps(Visible, _mm_cmpge_ps(_mm_add_ps(Distance, Radius), Zero));
+        }
+
+        const int Mask = _mm_movemask_ps(Visible);
+
+        for (uint k = 0 ; k < 4 ; k++) {
+            pVisible[i + k] = (Mask >> k) & 1;
+            NumVisible += pVisible[i + k];
+        }
+    }
+
+    for ( ; i < NumBoxes ; i++) {
+        pVisible[i] = BoxVisible(View, pBoxes[i]);
+        NumVisible += pVisible[i];
+    }
+
+    return NumVisible;
+}
+#endif
+
+
+uint CullBoxes(const Frustum& View, const BoundingBox* pBoxes, uint NumBoxes, unsigned char* pVisible, bool Simd)
+{
+#ifdef POSE_MATH_SIMD
+    if (Simd) {
+        return CullBoxesSimd(View, pBoxes, NumBoxes, pVisible);
+    }
+#endif
+
+    uint NumVisible = 0;
+
+    for (uint i = 0 ; i < NumBoxes ; i++) {
+        pVisible[i] = BoxVisible(View, pBoxes[i]);
+        NumVisible += pVisible[i];
+    }
+
+    return NumVisible;
+}
@@ -0,0 +1,62 @@
+#ifndef CULLING_H
+#define	CULLING_H
+
+#include <algorithm>
+#include <glm/glm.hpp>
+
+#include "pose_math.h"
+
+// Axis aligned box, empty (Min above Max) when default constructed
+struct BoundingBox
+{
+    aiVector3D Min;
+    aiVector3D Max;
+
+    BoundingBox() : Min(1e30f, 1e30f, 1e30f), Max(-1e30f, -1e30f, -1e30f)
+    {
+    }
+
+    bool Empty() const
+    {
+        return Min.x > Max.x;
+    }
+
+    void Add(const aiVector3D& p)
+    {
+        Min = aiVector3D(std::min(Min.x, p.x), std::min(Min.y, p.y), std::min(Min.z, p.z));
+        Max = aiVector3D(std::max(Max.x, p.x), std::max(Max.y, p.y), std::max(Max.z, p.z));
+    }
+
+    void Add(const BoundingBox& Box)
+    {
+        if (!Box.Empty()) {
+            Add(Box.Min);
+            Add(Box.Max);
+        }
+    }
+};
+
+// Box around Box transformed by m
+BoundingBox TransformBounds(const AffineMatrix& m, const BoundingBox& Box);
+
+// The six planes of a view frustum as (a, b, c, d), a point p being on
+// the inside of a plane when a p.x + b p.y + c p.z + d >= 0
+struct Frustum
+{
+    glm::vec4 Planes[6];
+
+    Frustum();
+
+    // The frustum of a projection * view (* model) matrix, in the space
+    // the matrix transforms from
+    explicit Frustum(const glm::mat4& Clip);
+};
+
+// Tests NumBoxes boxes against the frustum, setting pVisible[i] to 1 when
+// box i may be visible and to 0 when it is outside one of the planes or
+// empty. Returns the number of visible boxes. The SSE kernel, only
+// available with POSE_MATH_SIMD, tests four boxes at once and gives the
+// same results as the scalar one.
+uint CullBoxes(const Frustum& View, const BoundingBox* pBoxes, uint NumBoxes, unsigned char* pVisible, bool Simd = true);
+
+#endif	/* CULLING_H */
@@ -0,0 +1,112 @@
+#include <algorithm>
+#include <math.h>
+
+#include "frame_timer.h"
+
+FrameTimer::FrameTimer()
+{
+    m_Frame     = 0;
+    m_Collected = 0;
+
+    for (uint i = 0 ; i < NUM_TIMER_QUERIES ; i++) {
+        m_Queries[i] = 0;
+    }
+}
+
+
+FrameTimer::~FrameTimer()
+{
+    if (m_Queries[0] != 0) {
+        glDeleteQueries(NUM_TIMER_QUERIES, m_Queries);
+    }
+}
+
+
+bool FrameTimer::Init()
+{
+    glGenQueries(NUM_TIMER_QUERIES, m_Queries);
+    m_Frame     = 0;
+    m_Collected = 0;
+    m_CpuTimes.clear();
+    m_GpuTimes.clear();
+
+    return glGetError() == GL_NO_ERROR;
+}
+
+
+void FrameTimer::BeginFrame()
+{
+    // The query about to be reused belongs to the frame NUM_TIMER_QUERIES
+    // back, which has almost certainly finished by now
+    if (m_Frame >= NUM_TIMER_QUERIES) {
+        CollectQuery(m_Frame - NUM_TIMER_QUERIES);
+    }
+
+    glBeginQuery(GL_TIME_ELAPSED, m_Queries[m_Frame % NUM_TIMER_QUERIES]);
+    m_Start = chrono::steady_clock::now();
+}
+
+
+void FrameTimer::EndFrame()
+{
+    glEndQuery(GL_TIME_ELAPSED);
+
+    const chrono::duration<double, milli> Elapsed = chrono::steady_clock::now() - m_Start;
+    m_CpuTimes.push_back(Elapsed.count());
+    m_Frame++;
+}
+
+
+void FrameTimer::CollectQuery(uint Frame)
+{
+    GLuint64 Nanoseconds = 0;
+    glGetQueryObjectui64v(m_Queries[Frame % NUM_TIMER_QUERIES], GL_QUERY_RESULT, &Nanoseconds);
+    m_GpuTimes.push_back(Nanoseconds * 1e-6);
+    m_Collected++;
+}
+
+
+void FrameTimer::Finish()
+{
+    while (m_Collected < m_Frame) {
+        CollectQuery(m_Collected);
+    }
+}
+
+
+double FrameTimer::Percentile(vector<double> Samples, double P)
+{
+    if (Samples.empty()) {
+        return 0.0;
+    }
+
+    const size_t Rank = (size_t)ceil(P / 100.0 * Samples.size());
+    const size_t Index = Rank > 0 ? min(Rank - 1, Samples.size() - 1) : 0;
+
+    nth_element(Samples.begin(), Samples.begin() + Index, Samples.end());
+    return Samples[Index];
+}
+
+
+static void ReportTimes(FILE* f, const char* pName, const vector<double>& Times)
+{
+    double Sum = 0.0;
+
+    for (uint i = 0 ; i < Times.size() ; i++) {
+        Sum += Times[i];
+    }
+
+    fprintf(f, "%s ms: mean %.3f  p50 %.3f  p90 %.3f  p95 %.3f  p99 %.3f  max %.3f\n", pName,
+            Times.empty() ? 0.0 : Sum / Times.size(),
+            FrameTimer::Percentile(Times, 50.0), FrameTimer::Percentile(Times, 90.0),
+            FrameTimer::Percentile(Times, 95.0), FrameTimer::Percentile(Times, 99.0),
+            FrameTimer::Percentile(Times, 100.0));
+}
+
+
+void FrameTimer::Report(FILE* f) const
+{
+    fprintf(f, "%u frames\n", (uint)m_CpuTimes.size());
+    ReportTimes(f, "CPU", m_CpuTimes);
+    ReportTimes(f, "GPU", m_GpuTimes);
+}
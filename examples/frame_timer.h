@@ -0,0 +1,59 @@
+#ifndef FRAME_TIMER_H
+#define	FRAME_TIMER_H
+
+#include <stdio.h>
+#include <chrono>
+#include <vector>
+#include <GL/glew.h>
+
+using namespace std;
+
+// CPU and GPU time of every frame between BeginFrame and EndFrame. The GPU
+// time comes from GL_TIME_ELAPSED queries that are read back a few frames
+// later, so measuring does not stall the pipeline.
+class FrameTimer
+{
+public:
+    FrameTimer();
+
+    ~FrameTimer();
+
+    bool Init();
+
+    void BeginFrame();
+
+    void EndFrame();
+
+    // Waits for the outstanding queries; call before Report
+    void Finish();
+
+    // Prints mean and percentiles of both timings, in milliseconds
+    void Report(FILE* f) const;
+
+    const vector<double>& CpuTimes() const
+    {
+        return m_CpuTimes;
+    }
+
+    const vector<double>& GpuTimes() const
+    {
+        return m_GpuTimes;
+    }
+
+    // P in [0, 100], nearest rank
+    static double Percentile(vector<double> Samples, double P);
+
+private:
+    #define NUM_TIMER_QUERIES 4
+
+    void CollectQuery(uint Frame);
+
+    GLuint m_Queries[NUM_TIMER_QUERIES];
+    uint m_Frame;
+    uint m_Collected;
+    chrono::steady_clock::time_point m_Start;
+    vector<double> m_CpuTimes;
+    vector<double> m_GpuTimes;
+};
+
+#endif	/* FRAME_TIMER_H */
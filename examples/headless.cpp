@@ -0,0 +1,181 @@
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include "headless.h"
+
+#ifndef EGL_PLATFORM_SURFACELESS_MESA
+#define EGL_PLATFORM_SURFACELESS_MESA 0x31DD
+#endif
+
+HeadlessContext::HeadlessContext()
+{
+    m_Display     = NULL;
+    m_Context     = NULL;
+    m_Framebuffer = 0;
+    m_ColorBuffer = 0;
+    m_DepthBuffer = 0;
+    m_Width       = 0;
+    m_Height      = 0;
+}
+
+
+HeadlessContext::~HeadlessContext()
+{
+    Destroy();
+}
+
+
+static EGLDisplay GetDisplay()
+{
+    // Prefer a display that needs neither X nor a GPU device
+    const char* pExtensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+
+    if (pExtensions && strstr(pExtensions, "EGL_MESA_platform_surfaceless")) {
+        PFNEGLGETPLATFORMDISPLAYEXTPROC GetPlatformDisplay =
+            (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+
+        if (GetPlatformDisplay) {
+            EGLDisplay Display = GetPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+
+            if (Display != EGL_NO_DISPLAY) {
+                return Display;
+            }
+        }
+    }
+
+    return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+}
+
+
+bool HeadlessContext::Init(int Width, int Height)
+{
+    Destroy();
+
+    EGLDisplay Display = GetDisplay();
+    EGLint Major, Minor;
+
+    if (Display == EGL_NO_DISPLAY || !eglInitialize(Display, &Major, &Minor)) {
+        printf("Unable to initialize EGL\n");
+        return false;
+    }
+
+    m_Display = Display;
+
+    const EGLint ConfigAttribs[] = {
+        EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_NONE
+    };
+
+    EGLConfig Config;
+    EGLint NumConfigs = 0;
+
+    if (!eglChooseConfig(Display, ConfigAttribs, &Config, 1, &NumConfigs) || NumConfigs == 0 || !eglBindAPI(EGL_OPENGL_API)) {
+        printf("No EGL config for desktop OpenGL\n");
+        Destroy();
+        return false;
+    }
+
+    const EGLint ContextAttribs[] = {
+        EGL_CONTEXT_MAJOR_VERSION, 3,
+        EGL_CONTEXT_MINOR_VERSION, 3,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        EGL_NONE
+    };
+
+    EGLContext Context = eglCreateContext(Display, Config, EGL_NO_CONTEXT, ContextAttribs);
+
+    // Surfaceless: all drawing goes to the framebuffer object below
+    if (Context == EGL_NO_CONTEXT || !eglMakeCurrent(Display, EGL_NO_SURFACE, EGL_NO_SURFACE, Context)) {
+        printf("Unable to create an OpenGL 3.3 core context\n");
+        m_Context = Context != EGL_NO_CONTEXT ? Context : NULL;
+        Destroy();
+        return false;
+    }
+
+    m_Context = Context;
+
+    glewExperimental = GL_TRUE;
+    glewInit();
+    // glewInit queries the extensions the pre-3.0 way and leaves an error
+    glGetError();
+
+    m_Width  = Width;
+    m_Height = Height;
+
+    glGenRenderbuffers(1, &m_ColorBuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, m_ColorBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, Width, Height);
+
+    glGenRenderbuffers(1, &m_DepthBuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, m_DepthBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, Width, Height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glGenFramebuffers(1, &m_Framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, m_Framebuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, m_ColorBuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, m_DepthBuffer);
+
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        printf("Offscreen framebuffer is incomplete\n");
+        Destroy();
+        return false;
+    }
+
+    glViewport(0, 0, Width, Height);
+
+    return true;
+}
+
+
+void HeadlessContext::Destroy()
+{
+    if (m_Context) {
+        if (m_Framebuffer != 0) {
+            glDeleteFramebuffers(1, &m_Framebuffer);
+            glDeleteRenderbuffers(1, &m_ColorBuffer);
+            glDeleteRenderbuffers(1, &m_DepthBuffer);
+            m_Framebuffer = 0;
+            m_ColorBuffer = 0;
+            m_DepthBuffer = 0;
+        }
+
+        eglMakeCurrent((EGLDisplay)m_Display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        eglDestroyContext((EGLDisplay)m_Display, (EGLContext)m_Context);
+        m_Context = NULL;
+    }
+
+    if (m_Display) {
+        eglTerminate((EGLDisplay)m_Display);
+        m_Display = NULL;
+    }
+}
+
+
+bool HeadlessContext::WritePPM(const string& Filename) const
+{
+    vector<unsigned char> Pixels(m_Width * m_Height * 3);
+
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, m_Width, m_Height, GL_RGB, GL_UNSIGNED_BYTE, &Pixels[0]);
+
+    FILE* f = fopen(Filename.c_str(), "wb");
+
+    if (!f) {
+        return false;
+    }
+
+    fprintf(f, "P6\n%d %d\n255\n", m_Width, m_Height);
+
+    // GL's first row is the bottom one
+    for (int y = m_Height - 1 ; y >= 0 ; y--) {
+        fwrite(&Pixels[y * m_Width * 3], 1, m_Width * 3, f);
+    }
+
+    return fclose(f) == 0;
+}
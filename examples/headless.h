@@ -0,0 +1,42 @@
+#ifndef HEADLESS_H
+#define	HEADLESS_H
+
+#include <string>
+#include <GL/glew.h>
+
+using namespace std;
+
+// Offscreen OpenGL 3.3 core context for running without a window, e.g. on
+// CI machines with Mesa's llvmpipe. The context is created through EGL
+// without any surface and everything is drawn into a framebuffer object
+// of the requested size, which stays bound.
+class HeadlessContext
+{
+public:
+    HeadlessContext();
+
+    ~HeadlessContext();
+
+    // Creates the context, makes it current and initializes GLEW
+    bool Init(int Width, int Height);
+
+    void Destroy();
+
+    // Reads back the color buffer and writes it as a binary PPM, top row
+    // first
+    bool WritePPM(const string& Filename) const;
+
+private:
+    HeadlessContext(const HeadlessContext&);
+    HeadlessContext& operator=(const HeadlessContext&);
+
+    void* m_Display;   // EGLDisplay
+    void* m_Context;   // EGLContext
+    GLuint m_Framebuffer;
+    GLuint m_ColorBuffer;
+    GLuint m_DepthBuffer;
+    int m_Width;
+    int m_Height;
+};
+
+#endif	/* HEADLESS_H */
@@ -0,0 +1,486 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <fstream>
+
+#include "mesh_cache.h"
+
+struct MeshCacheHeader
+{
+    char Magic[8];
+    uint32_t Version;
+    uint32_t VertexSize;      // guards against layout changes of the raw streams
+    uint32_t MatrixSize;
+    uint32_t NumVertices;
+    uint32_t NumIndices;
+    uint32_t Padding;
+    uint64_t SourceHash;
+    uint64_t StreamOffset;    // vertices, immediately followed by the indices
+    uint64_t TablesOffset;    // entries, bone offsets, skeleton, animations
+    uint64_t FileSize;
+};
+
+static const char MESH_CACHE_MAGIC[8] = { 'M', 'E', 'S', 'H', 'C', 'A', 'C', 'H' };
+
+#define STREAM_ALIGNMENT 64
+
+
+MappedFile::MappedFile()
+{
+    m_pData = NULL;
+    m_Size  = 0;
+}
+
+
+MappedFile::~MappedFile()
+{
+    Close();
+}
+
+
+bool MappedFile::Open(const string& Filename)
+{
+    Close();
+
+    int fd = open(Filename.c_str(), O_RDONLY);
+
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat Info;
+
+    if (fstat(fd, &Info) != 0 || Info.st_size == 0) {
+        close(fd);
+        return false;
+    }
+
+    void* p = mmap(NULL, Info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (p == MAP_FAILED) {
+        return false;
+    }
+
+    m_pData = (const char*)p;
+    m_Size  = Info.st_size;
+    return true;
+}
+
+
+void MappedFile::Close()
+{
+    if (m_pData) {
+        munmap((void*)m_pData, m_Size);
+        m_pData = NULL;
+        m_Size  = 0;
+    }
+}
+
+
+uint64_t HashBytes(const void* pData, size_t Size, uint64_t Hash)
+{
+    const unsigned char* p = (const unsigned char*)pData;
+
+    for (size_t i = 0 ; i < Size ; i++) {
+        Hash ^= p[i];
+        Hash *= 1099511628211ULL;
+    }
+
+    return Hash;
+}
+
+
+uint64_t HashFile(const string& Filename, uint64_t Seed)
+{
+    MappedFile File;
+
+    if (!File.Open(Filename)) {
+        return 0;
+    }
+
+    return HashBytes(File.Data(), File.Size(), HashBytes(&Seed, sizeof(Seed)));
+}
+
+
+// Appends plain data to a byte buffer
+class CacheWriter
+{
+public:
+    vector<char> Data;
+
+    template <typename T>
+    void Write(const T& Value)
+    {
+        WriteBytes(&Value, sizeof(T));
+    }
+
+    template <typename T>
+    void WriteArray(const vector<T>& Values)
+    {
+        Write((uint32_t)Values.size());
+        Align(16);
+        if (!Values.empty()) {
+            WriteBytes(&Values[0], sizeof(T) * Values.size());
+        }
+    }
+
+    void WriteBytes(const void* p, size_t Size)
+    {
+        Data.insert(Data.end(), (const char*)p, (const char*)p + Size);
+    }
+
+    void Align(size_t Alignment)
+    {
+        Data.resize((Data.size() + Alignment - 1) / Alignment * Alignment, 0);
+    }
+};
+
+
+// Reads what CacheWriter wrote, failing (instead of overrunning) on
+// truncated or corrupt files
+class CacheReader
+{
+public:
+    CacheReader(const char* pData, size_t Size, size_t Offset)
+    {
+        m_pBegin = pData;
+        m_Pos    = Offset;
+        m_Size   = Size;
+        m_Ok     = Offset <= Size;
+    }
+
+    bool Ok() const
+    {
+        return m_Ok;
+    }
+
+    template <typename T>
+    void Read(T& Value)
+    {
+        ReadBytes(&Value, sizeof(T));
+    }
+
+    template <typename T>
+    void ReadArray(vector<T>& Values)
+    {
+        uint32_t Count = 0;
+        Read(Count);
+        Align(16);
+
+        if (!m_Ok || Count > (m_Size - m_Pos) / sizeof(T)) {
+            m_Ok = false;
+            Values.clear();
+            return;
+        }
+
+        Values.resize(Count);
+        if (Count > 0) {
+            ReadBytes(&Values[0], sizeof(T) * Count);
+        }
+    }
+
+    void ReadBytes(void* p, size_t Size)
+    {
+        if (!m_Ok || Size > m_Size - m_Pos) {
+            m_Ok = false;
+            return;
+        }
+
+        memcpy(p, m_pBegin + m_Pos, Size);
+        m_Pos += Size;
+    }
+
+    void Align(size_t Alignment)
+    {
+        m_Pos = (m_Pos + Alignment - 1) / Alignment * Alignment;
+        m_Ok = m_Ok && m_Pos <= m_Size;
+    }
+
+private:
+    const char* m_pBegin;
+    size_t m_Pos;
+    size_t m_Size;
+    bool m_Ok;
+};
+
+
+static void WriteTables(CacheWriter& Writer, const MeshData& Data)
+{
+    Writer.WriteArray(Data.Entries);
+    Writer.WriteArray(Data.BoneOffsets);
+
+    Writer.WriteArray(Data.Skel.Parents);
+    Writer.WriteArray(Data.Skel.BoneIndices);
+    Writer.WriteArray(Data.Skel.BindPositions);
+    Writer.WriteArray(Data.Skel.BindRotations);
+    Writer.WriteArray(Data.Skel.BindScalings);
+
+    // Node names, each followed by a terminating zero
+    vector<char> Names;
+
+    for (uint i = 0 ; i < Data.Skel.Names.size() ; i++) {
+        Names.insert(Names.end(), Data.Skel.Names[i].begin(), Data.Skel.Names[i].end());
+        Names.push_back('\0');
+    }
+    Writer.WriteArray(Names);
+
+    Writer.Write((uint32_t)Data.Animations.size());
+
+    for (uint i = 0 ; i < Data.Animations.size() ; i++) {
+        const AnimationClip& Clip = Data.Animations[i];
+
+        Writer.Write(Clip.Duration);
+        Writer.Write(Clip.TicksPerSecond);
+        Writer.WriteArray(Clip.NodeChannels);
+        Writer.Write((uint32_t)Clip.Channels.size());
+
+        for (uint j = 0 ; j < Clip.Channels.size() ; j++) {
+            const AnimationChannel& Channel = Clip.Channels[j];
+
+            Writer.WriteArray(Channel.PositionTimes);
+            Writer.WriteArray(Channel.Positions);
+            Writer.WriteArray(Channel.RotationTimes);
+            Writer.WriteArray(Channel.Rotations);
+            Writer.WriteArray(Channel.ScalingTimes);
+            Writer.WriteArray(Channel.Scalings);
+        }
+    }
+}
+
+
+static bool ReadTables(CacheReader& Reader, MeshData& Data)
+{
+    Reader.ReadArray(Data.Entries);
+    Reader.ReadArray(Data.BoneOffsets);
+
+    Reader.ReadArray(Data.Skel.Parents);
+    Reader.ReadArray(Data.Skel.BoneIndices);
+    Reader.ReadArray(Data.Skel.BindPositions);
+    Reader.ReadArray(Data.Skel.BindRotations);
+    Reader.ReadArray(Data.Skel.BindScalings);
+
+    vector<char> Names;
+    Reader.ReadArray(Names);
+    Data.Skel.Names.clear();
+
+    for (uint i = 0 ; i < Names.size() ; ) {
+        const uint End = find(Names.begin() + i, Names.end(), '\0') - Names.begin();
+        Data.Skel.Names.push_back(string(&Names[i], End - i));
+        i = End + 1;
+    }
+
+    uint32_t NumAnimations = 0;
+    Reader.Read(NumAnimations);
+
+    // Every clip takes at least a few bytes, which bounds the counts read
+    // from a corrupt file before anything is allocated for them
+    const uint32_t MaxCount = 1u << 20;
+
+    if (!Reader.Ok() || NumAnimations > MaxCount) {
+        return false;
+    }
+
+    Data.Animations.resize(NumAnimations);
+
+    for (uint i = 0 ; i < NumAnimations && Reader.Ok() ; i++) {
+        AnimationClip& Clip = Data.Animations[i];
+
+        Reader.Read(Clip.Duration);
+        Reader.Read(Clip.TicksPerSecond);
+        Reader.ReadArray(Clip.NodeChannels);
+
+        uint32_t NumChannels = 0;
+        Reader.Read(NumChannels);
+
+        if (!Reader.Ok() || NumChannels > MaxCount) {
+            return false;
+        }
+
+        Clip.Channels.resize(NumChannels);
+
+        for (uint j = 0 ; j < NumChannels && Reader.Ok() ; j++) {
+            AnimationChannel& Channel = Clip.Channels[j];
+
+            Reader.ReadArray(Channel.PositionTimes);
+            Reader.ReadArray(Channel.Positions);
+            Reader.ReadArray(Channel.RotationTimes);
+            Reader.ReadArray(Channel.Rotations);
+            Reader.ReadArray(Channel.ScalingTimes);
+            Reader.ReadArray(Channel.Scalings);
+        }
+    }
+
+    if (!Reader.Ok()) {
+        return false;
+    }
+
+    // Indices into the tables must stay in range, the sampler and the
+    // hierarchy pass don't check them
+    const uint NumNodes = Data.Skel.NumNodes();
+
+    if (Data.Skel.BoneIndices.size() != NumNodes || Data.Skel.BindPositions.size() != NumNodes ||
+        Data.Skel.BindRotations.size() != NumNodes || Data.Skel.BindScalings.size() != NumNodes ||
+        Data.Skel.Names.size() != NumNodes) {
+        return false;
+    }
+
+    for (uint i = 0 ; i < NumNodes ; i++) {
+        if (Data.Skel.Parents[i] < -1 || Data.Skel.Parents[i] >= (int)i ||
+            Data.Skel.BoneIndices[i] < -1 || Data.Skel.BoneIndices[i] >= (int)Data.BoneOffsets.size()) {
+            return false;
+        }
+    }
+
+    for (uint i = 0 ; i < Data.Animations.size() ; i++) {
+        const AnimationClip& Clip = Data.Animations[i];
+
+        if (Clip.NodeChannels.size() != NumNodes) {
+            return false;
+        }
+
+        for (uint j = 0 ; j < NumNodes ; j++) {
+            if (Clip.NodeChannels[j] < -1 || Clip.NodeChannels[j] >= (int)Clip.Channels.size()) {
+                return false;
+            }
+        }
+
+        for (uint j = 0 ; j < Clip.Channels.size() ; j++) {
+            const AnimationChannel& Channel = Clip.Channels[j];
+
+            if (Channel.Positions.empty() || Channel.Positions.size() != Channel.PositionTimes.size() ||
+                Channel.Rotations.empty() || Channel.Rotations.size() != Channel.RotationTimes.size() ||
+                Channel.Scalings.empty() || Channel.Scalings.size() != Channel.ScalingTimes.size()) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+
+bool WriteMeshCache(const string& Filename, uint64_t SourceHash, const MeshData& Data)
+{
+    CacheWriter Writer;
+
+    MeshCacheHeader Header;
+    memset(&Header, 0, sizeof(Header));
+    Writer.Write(Header);
+    Writer.Align(STREAM_ALIGNMENT);
+
+    Header.StreamOffset = Writer.Data.size();
+    if (!Data.Vertices.empty()) {
+        Writer.WriteBytes(&Data.Vertices[0], sizeof(SkinnedVertex) * Data.Vertices.size());
+    }
+    if (!Data.Indices.empty()) {
+        Writer.WriteBytes(&Data.Indices[0], sizeof(uint) * Data.Indices.size());
+    }
+    Writer.Align(STREAM_ALIGNMENT);
+
+    Header.TablesOffset = Writer.Data.size();
+    WriteTables(Writer, Data);
+
+    memcpy(Header.Magic, MESH_CACHE_MAGIC, sizeof(Header.Magic));
+    Header.Version     = MESH_CACHE_VERSION;
+    Header.VertexSize  = sizeof(SkinnedVertex);
+    Header.MatrixSize  = sizeof(AffineMatrix);
+    Header.NumVertices = Data.Vertices.size();
+    Header.NumIndices  = Data.Indices.size();
+    Header.SourceHash  = SourceHash;
+    Header.FileSize    = Writer.Data.size();
+    memcpy(&Writer.Data[0], &Header, sizeof(Header));
+
+    const string TempFilename = Filename + ".tmp";
+
+    {
+        std::ofstream Out(TempFilename.c_str(), std::ios::binary | std::ios::trunc);
+        Out.write(&Writer.Data[0], Writer.Data.size());
+
+        if (!Out) {
+            remove(TempFilename.c_str());
+            return false;
+        }
+    }
+
+    return rename(TempFilename.c_str(), Filename.c_str()) == 0;
+}
+
+
+MeshCacheFile::MeshCacheFile()
+{
+    m_pVertices   = NULL;
+    m_NumVertices = 0;
+    m_pIndices    = NULL;
+    m_NumIndices  = 0;
+}
+
+
+bool MeshCacheFile::Open(const string& Filename, uint64_t SourceHash, MeshData& Data)
+{
+    if (!m_File.Open(Filename) || m_File.Size() < sizeof(MeshCacheHeader)) {
+        return false;
+    }
+
+    MeshCacheHeader Header;
+    memcpy(&Header, m_File.Data(), sizeof(Header));
+
+    const uint64_t StreamSize = (uint64_t)sizeof(SkinnedVertex) * Header.NumVertices + (uint64_t)sizeof(uint) * Header.NumIndices;
+
+    if (memcmp(Header.Magic, MESH_CACHE_MAGIC, sizeof(Header.Magic)) != 0 ||
+        Header.Version != MESH_CACHE_VERSION ||
+        Header.VertexSize != sizeof(SkinnedVertex) ||
+        Header.MatrixSize != sizeof(AffineMatrix) ||
+        Header.SourceHash != SourceHash ||
+        Header.FileSize != m_File.Size() ||
+        Header.StreamOffset % STREAM_ALIGNMENT != 0 ||
+        Header.StreamOffset + StreamSize > Header.TablesOffset ||
+        Header.TablesOffset > Header.FileSize) {
+        m_File.Close();
+        return false;
+    }
+
+    CacheReader Reader(m_File.Data(), m_File.Size(), Header.TablesOffset);
+
+    if (!ReadTables(Reader, Data)) {
+        m_File.Close();
+        return false;
+    }
+
+    const SkinnedVertex* pVertices = (const SkinnedVertex*)(m_File.Data() + Header.StreamOffset);
+    const uint* pIndices = (const uint*)(pVertices + Header.NumVertices);
+
+    for (uint i = 0 ; i < Data.Entries.size() ; i++) {
+        const MeshEntry& Entry = Data.Entries[i];
+
+        bool Valid = Entry.BaseVertex <= Header.NumVertices && Entry.NumLods >= 1 && Entry.NumLods <= MAX_MESH_LODS;
+
+        // Every level has to stay within the ranges of the file, and the
+        // indices, relative to the entry's first vertex, within the vertices
+        for (uint l = 0 ; Valid && l < Entry.NumLods ; l++) {
+            const MeshLod& Lod = Entry.Lods[l];
+            Valid = (uint64_t)Lod.BaseIndex + Lod.NumIndices <= Header.NumIndices;
+
+            for (uint j = 0 ; Valid && j < Lod.NumIndices ; j++) {
+                Valid = (uint64_t)Entry.BaseVertex + pIndices[Lod.BaseIndex + j] < Header.NumVertices;
+            }
+        }
+
+        if ((uint64_t)Entry.BaseIndex + Entry.NumIndices > Header.NumIndices || !Valid) {
+            m_File.Close();
+            return false;
+        }
+    }
+
+    m_pVertices   = pVertices;
+    m_NumVertices = Header.NumVertices;
+    m_pIndices    = pIndices;
+    m_NumIndices  = Header.NumIndices;
+
+    return true;
+}
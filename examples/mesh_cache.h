@@ -0,0 +1,93 @@
+#ifndef MESH_CACHE_H
+#define	MESH_CACHE_H
+
+#include <stdint.h>
+#include <string>
+
+#include "scene.h"
+
+using namespace std;
+
+// Bump whenever the layout of anything written below changes
+#define MESH_CACHE_VERSION 4
+
+// Read-only memory mapping of a whole file
+class MappedFile
+{
+public:
+    MappedFile();
+
+    ~MappedFile();
+
+    bool Open(const string& Filename);
+
+    void Close();
+
+    const char* Data() const
+    {
+        return m_pData;
+    }
+
+    size_t Size() const
+    {
+        return m_Size;
+    }
+
+private:
+    MappedFile(const MappedFile&);
+    MappedFile& operator=(const MappedFile&);
+
+    const char* m_pData;
+    size_t m_Size;
+};
+
+// 64-bit FNV-1a
+uint64_t HashBytes(const void* pData, size_t Size, uint64_t Hash = 14695981039346656037ULL);
+
+// Hash of the source file's contents, 0 if it can't be read
+uint64_t HashFile(const string& Filename, uint64_t Seed);
+
+// Writes Data to Filename (through a temporary file, so readers never see a
+// partial cache). The vertex and index streams are stored back to back so
+// they can be uploaded into one buffer with a single call.
+bool WriteMeshCache(const string& Filename, uint64_t SourceHash, const MeshData& Data);
+
+// A mapped cache file. Open validates the header against SourceHash and
+// copies the small tables into Data. The vertex and index streams are not
+// copied; Vertices()/Indices() point into the mapping while it stays open.
+class MeshCacheFile
+{
+public:
+    MeshCacheFile();
+
+    bool Open(const string& Filename, uint64_t SourceHash, MeshData& Data);
+
+    const SkinnedVertex* Vertices() const
+    {
+        return m_pVertices;
+    }
+
+    uint NumVertices() const
+    {
+        return m_NumVertices;
+    }
+
+    const uint* Indices() const
+    {
+        return m_pIndices;
+    }
+
+    uint NumIndices() const
+    {
+        return m_NumIndices;
+    }
+
+private:
+    MappedFile m_File;
+    const SkinnedVertex* m_pVertices;
+    uint m_NumVertices;
+    const uint* m_pIndices;
+    uint m_NumIndices;
+};
+
+#endif	/* MESH_CACHE_H */
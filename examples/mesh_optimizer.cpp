@@ -0,0 +1,268 @@
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+
+#include "mesh_cache.h"
+#include "mesh_optimizer.h"
+
+// Size of the LRU cache OptimizeVertexCache models, and the scoring
+// constants of Forsyth's "Linear-Speed Vertex Cache Optimisation"
+#define FORSYTH_CACHE_SIZE    32
+#define FORSYTH_MAX_VALENCE   32
+#define CACHE_DECAY_POWER     1.5f
+#define LAST_TRIANGLE_SCORE   0.75f
+#define VALENCE_BOOST_SCALE   2.0f
+#define VALENCE_BOOST_POWER   0.5f
+
+#define NO_VERTEX 0xFFFFFFFF
+
+VertexCacheStats AnalyzeVertexCache(const uint* pIndices, uint NumIndices, uint NumVertices, uint CacheSize)
+{
+    // A vertex is still cached while fewer than CacheSize vertices have
+    // been pushed after it
+    vector<uint> Pushed(NumVertices, 0);
+    vector<bool> Referenced(NumVertices, false);
+    uint Time = CacheSize + 1;
+    uint Invocations = 0, NumReferenced = 0;
+
+    for (uint i = 0 ; i < NumIndices ; i++) {
+        const uint v = pIndices[i];
+
+        if (Time - Pushed[v] > CacheSize) {
+            Pushed[v] = Time++;
+            Invocations++;
+        }
+
+        if (!Referenced[v]) {
+            Referenced[v] = true;
+            NumReferenced++;
+        }
+    }
+
+    VertexCacheStats Stats;
+    Stats.ACMR = NumIndices ? Invocations / (NumIndices / 3.0f) : 0.0f;
+    Stats.ATVR = NumReferenced ? Invocations / (float)NumReferenced : 0.0f;
+
+    return Stats;
+}
+
+
+uint WeldVertices(SkinnedVertex* pVertices, uint NumVertices, uint* pIndices, uint NumIndices)
+{
+    // Open addressing, at most half full. The table holds the compacted
+    // index of each unique vertex, which stays in place as the compaction
+    // only writes behind the vertex being looked up.
+    uint TableSize = 16;
+
+    while (TableSize < NumVertices * 2) {
+        TableSize *= 2;
+    }
+
+    vector<uint> Table(TableSize, NO_VERTEX);
+    vector<uint> Remap(NumVertices);
+    uint NumUnique = 0;
+
+    for (uint v = 0 ; v < NumVertices ; v++) {
+        uint Slot = (uint)HashBytes(&pVertices[v], sizeof(SkinnedVertex)) & (TableSize - 1);
+
+        while (Table[Slot] != NO_VERTEX && memcmp(&pVertices[Table[Slot]], &pVertices[v], sizeof(SkinnedVertex)) != 0) {
+            Slot = (Slot + 1) & (TableSize - 1);
+        }
+
+        if (Table[Slot] == NO_VERTEX) {
+            pVertices[NumUnique] = pVertices[v];
+            Table[Slot] = NumUnique++;
+        }
+
+        Remap[v] = Table[Slot];
+    }
+
+    for (uint i = 0 ; i < NumIndices ; i++) {
+        pIndices[i] = Remap[pIndices[i]];
+    }
+
+    return NumUnique;
+}
+
+
+void OptimizeVertexCache(uint* pIndices, uint NumIndices, uint NumVertices)
+{
+    const uint NumTriangles = NumIndices / 3;
+
+    if (NumTriangles < 2) {
+        return;
+    }
+
+    float CacheScores[FORSYTH_CACHE_SIZE];
+    float ValenceScores[FORSYTH_MAX_VALENCE + 1];
+
+    for (uint i = 0 ; i < FORSYTH_CACHE_SIZE ; i++) {
+        // The last triangle's vertices score the same whatever their order,
+        // so that it isn't simply walked back along
+        CacheScores[i] = i < 3 ? LAST_TRIANGLE_SCORE :
+                         powf(1.0f - (i - 3) / (float)(FORSYTH_CACHE_SIZE - 3), CACHE_DECAY_POWER);
+    }
+
+    // Vertices with few triangles left are finished first, so they don't
+    // end up needing another transform later on their own
+    ValenceScores[0] = 0.0f;
+
+    for (uint i = 1 ; i <= FORSYTH_MAX_VALENCE ; i++) {
+        ValenceScores[i] = VALENCE_BOOST_SCALE * powf((float)i, -VALENCE_BOOST_POWER);
+    }
+
+    // Triangles around every vertex, of which the first Valence[v] are
+    // not emitted yet
+    vector<uint> Valence(NumVertices, 0);
+    vector<uint> FirstTriangle(NumVertices + 1, 0);
+
+    for (uint i = 0 ; i < NumTriangles * 3 ; i++) {
+        Valence[pIndices[i]]++;
+    }
+
+    for (uint v = 0 ; v < NumVertices ; v++) {
+        FirstTriangle[v + 1] = FirstTriangle[v] + Valence[v];
+        Valence[v] = 0;
+    }
+
+    vector<uint> Triangles(NumTriangles * 3);
+
+    for (uint t = 0 ; t < NumTriangles ; t++) {
+        for (uint k = 0 ; k < 3 ; k++) {
+            const uint v = pIndices[3 * t + k];
+            Triangles[FirstTriangle[v] + Valence[v]++] = t;
+        }
+    }
+
+    vector<int> CachePosition(NumVertices, -1);
+    vector<float> VertexScores(NumVertices);
+    vector<bool> Emitted(NumTriangles, false);
+
+    auto VertexScore = [&](uint v) {
+        if (Valence[v] == 0) {
+            return -1.0f;
+        }
+
+        const float CacheScore = CachePosition[v] < 0 ? 0.0f : CacheScores[CachePosition[v]];
+        return CacheScore + ValenceScores[min(Valence[v], (uint)FORSYTH_MAX_VALENCE)];
+    };
+
+    for (uint v = 0 ; v < NumVertices ; v++) {
+        VertexScores[v] = VertexScore(v);
+    }
+
+    vector<uint> Output(NumTriangles * 3);
+    uint Cache[FORSYTH_CACHE_SIZE + 3];
+    uint CacheSize = 0;
+    uint NextUnemitted = 0;
+    int Best = -1;
+
+    for (uint i = 0 ; i < NumTriangles ; i++) {
+        if (Best < 0) {
+            // Nothing around the cache is left, start over where the input
+            // order has unemitted triangles
+            while (Emitted[NextUnemitted]) {
+                NextUnemitted++;
+            }
+
+            Best = NextUnemitted;
+        }
+
+        const uint* pTriangle = &pIndices[3 * Best];
+        memcpy(&Output[3 * i], pTriangle, sizeof(uint) * 3);
+        Emitted[Best] = true;
+
+        for (uint k = 0 ; k < 3 ; k++) {
+            const uint v = pTriangle[k];
+            uint* pLive = &Triangles[FirstTriangle[v]];
+            const uint Last = --Valence[v];
+            *find(pLive, pLive + Last, (uint)Best) = pLive[Last];
+        }
+
+        // The triangle's vertices move to the front of the cache, the rest
+        // moves back, and what ends up past its end falls out
+        uint NewCache[FORSYTH_CACHE_SIZE + 3];
+        uint NewSize = 0;
+
+        for (uint k = 0 ; k < 3 ; k++) {
+            if (find(NewCache, NewCache + NewSize, pTriangle[k]) == NewCache + NewSize) {
+                NewCache[NewSize++] = pTriangle[k];
+            }
+        }
+
+        for (uint j = 0 ; j < CacheSize ; j++) {
+            if (find(pTriangle, pTriangle + 3, Cache[j]) == pTriangle + 3) {
+                NewCache[NewSize++] = Cache[j];
+            }
+        }
+
+        for (uint j = 0 ; j < NewSize ; j++) {
+            const uint v = NewCache[j];
+            CachePosition[v] = j < FORSYTH_CACHE_SIZE ? (int)j : -1;
+            VertexScores[v] = VertexScore(v);
+        }
+
+        CacheSize = min(NewSize, (uint)FORSYTH_CACHE_SIZE);
+        memcpy(Cache, NewCache, sizeof(uint) * CacheSize);
+
+        // The next triangle is the best one around the cache
+        Best = -1;
+        float BestScore = -1.0f;
+
+        for (uint j = 0 ; j < CacheSize ; j++) {
+            const uint v = Cache[j];
+
+            for (uint n = 0 ; n < Valence[v] ; n++) {
+                const uint t = Triangles[FirstTriangle[v] + n];
+                const float Score = VertexScores[pIndices[3 * t]] + VertexScores[pIndices[3 * t + 1]] + VertexScores[pIndices[3 * t + 2]];
+
+                if (Score > BestScore) {
+                    Best = t;
+                    BestScore = Score;
+                }
+            }
+        }
+    }
+
+    memcpy(pIndices, &Output[0], sizeof(uint) * NumTriangles * 3);
+}
+
+
+uint OptimizeVertexFetch(SkinnedVertex* pVertices, uint NumVertices, uint* pIndices, uint NumIndices)
+{
+    vector<uint> Remap(NumVertices, NO_VERTEX);
+    uint NumUsed = 0;
+
+    for (uint i = 0 ; i < NumIndices ; i++) {
+        uint& Index = pIndices[i];
+
+        if (Remap[Index] == NO_VERTEX) {
+            Remap[Index] = NumUsed++;
+        }
+
+        Index = Remap[Index];
+    }
+
+    vector<SkinnedVertex> Reordered(NumUsed);
+
+    for (uint v = 0 ; v < NumVertices ; v++) {
+        if (Remap[v] != NO_VERTEX) {
+            Reordered[Remap[v]] = pVertices[v];
+        }
+    }
+
+    if (NumUsed > 0) {
+        memcpy(pVertices, &Reordered[0], sizeof(SkinnedVertex) * NumUsed);
+    }
+
+    return NumUsed;
+}
+
+
+uint OptimizeMesh(SkinnedVertex* pVertices, uint NumVertices, uint* pIndices, uint NumIndices)
+{
+    NumVertices = WeldVertices(pVertices, NumVertices, pIndices, NumIndices);
+    OptimizeVertexCache(pIndices, NumIndices, NumVertices);
+
+    return OptimizeVertexFetch(pVertices, NumVertices, pIndices, NumIndices);
+}
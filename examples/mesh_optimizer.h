@@ -0,0 +1,40 @@
+#ifndef MESH_OPTIMIZER_H
+#define	MESH_OPTIMIZER_H
+
+#include "scene.h"
+
+// Entries of the post-transform cache AnalyzeVertexCache simulates
+#define ANALYZE_CACHE_SIZE 16
+
+// Vertex shader invocations of an indexed triangle list
+struct VertexCacheStats
+{
+    float ACMR;     // average cache miss ratio: invocations per triangle
+    float ATVR;     // average transform to vertex ratio: invocations per
+                    // referenced vertex, 1 at best
+};
+
+// Runs the indices of a triangle list through a FIFO cache of CacheSize
+// vertices
+VertexCacheStats AnalyzeVertexCache(const uint* pIndices, uint NumIndices, uint NumVertices,
+                                    uint CacheSize = ANALYZE_CACHE_SIZE);
+
+// Merges vertices that are identical in every attribute, bone data
+// included, keeping the first of each. Compacts pVertices, rewrites the
+// indices and returns the number of vertices left.
+uint WeldVertices(SkinnedVertex* pVertices, uint NumVertices, uint* pIndices, uint NumIndices);
+
+// Reorders the triangles so that consecutive triangles share vertices,
+// with Forsyth's linear-speed vertex cache optimization
+void OptimizeVertexCache(uint* pIndices, uint NumIndices, uint NumVertices);
+
+// Reorders the vertices into the order the indices first use them, which
+// keeps vertex fetches sequential, and drops unreferenced vertices.
+// Returns the number of vertices left.
+uint OptimizeVertexFetch(SkinnedVertex* pVertices, uint NumVertices, uint* pIndices, uint NumIndices);
+
+// The three passes above in order, what Scene::SetOptimizeMeshes runs on
+// every mesh entry. Returns the number of vertices left.
+uint OptimizeMesh(SkinnedVertex* pVertices, uint NumVertices, uint* pIndices, uint NumIndices);
+
+#endif	/* MESH_OPTIMIZER_H */
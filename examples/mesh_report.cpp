@@ -0,0 +1,122 @@
+// Reports what Scene::SetOptimizeMeshes does to the meshes of models:
+// vertices and post-transform cache efficiency of every mesh entry before
+// and after.
+//
+// usage: mesh_report [--cache N] model files...
+//
+//   --cache N  entries of the simulated FIFO cache (default 16)
+//
+// ACMR is vertex shader invocations per triangle (0.5 is the limit for
+// large regular meshes, 3 the worst), ATVR invocations per vertex (1 at
+// best).
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "mesh_optimizer.h"
+#include "scene.h"
+
+// Vertex ranges of the entries and the index stream of an unpacked import
+struct EntryStreams
+{
+    const ImportedMesh* pMesh;
+
+    uint NumVertices(uint Entry) const
+    {
+        const vector<MeshEntry>& Entries = pMesh->Data.Entries;
+        const uint End = Entry + 1 < Entries.size() ? Entries[Entry + 1].BaseVertex :
+                         pMesh->VertexSize / sizeof(SkinnedVertex);
+
+        return End - Entries[Entry].BaseVertex;
+    }
+
+    const uint* Indices(uint Entry) const
+    {
+        return (const uint*)&pMesh->Buffer[pMesh->VertexSize] + pMesh->Data.Entries[Entry].BaseIndex;
+    }
+};
+
+
+static bool Report(const string& Filename, uint CacheSize)
+{
+    ThreadPool Pool;
+    Scene Source, Optimized;
+    Source.SetImportPool(&Pool);
+    Optimized.SetImportPool(&Pool);
+    Optimized.SetOptimizeMeshes(true);
+
+    ImportedMesh SourceMesh, OptimizedMesh;
+
+    if (!Source.ImportMesh(Filename, "", SourceMesh) || !Optimized.ImportMesh(Filename, "", OptimizedMesh)) {
+        return false;
+    }
+
+    const EntryStreams Before = { &SourceMesh }, After = { &OptimizedMesh };
+    const vector<MeshEntry>& Entries = SourceMesh.Data.Entries;
+
+    printf("%s: %u mesh entries\n", Filename.c_str(), (uint)Entries.size());
+    printf("%-5s %10s %10s %10s %8s %8s %8s %8s\n", "entry", "triangles", "vertices", "kept", "ACMR", "after", "ATVR",
+           "after");
+
+    uint TotalTriangles = 0, TotalVertices = 0, TotalKept = 0;
+    double TotalBefore = 0.0, TotalAfter = 0.0;
+
+    for (uint i = 0 ; i < Entries.size() ; i++) {
+        const uint NumIndices = Entries[i].NumIndices;
+        const VertexCacheStats StatsBefore = AnalyzeVertexCache(Before.Indices(i), NumIndices, Before.NumVertices(i), CacheSize);
+        const VertexCacheStats StatsAfter = AnalyzeVertexCache(After.Indices(i), NumIndices, After.NumVertices(i), CacheSize);
+
+        printf("%-5u %10u %10u %10u %8.3f %8.3f %8.3f %8.3f\n", i, NumIndices / 3, Before.NumVertices(i), After.NumVertices(i),
+               StatsBefore.ACMR, StatsAfter.ACMR, StatsBefore.ATVR, StatsAfter.ATVR);
+
+        TotalTriangles += NumIndices / 3;
+        TotalVertices += Before.NumVertices(i);
+        TotalKept += After.NumVertices(i);
+        TotalBefore += StatsBefore.ACMR * (NumIndices / 3);
+        TotalAfter += StatsAfter.ACMR * (NumIndices / 3);
+    }
+
+    if (TotalTriangles > 0) {
+        printf("total %u triangles, %u vertices, %u kept, ACMR %.3f -> %.3f\n\n", TotalTriangles, TotalVertices, TotalKept,
+               TotalBefore / TotalTriangles, TotalAfter / TotalTriangles);
+    }
+
+    return true;
+}
+
+
+int main(int argc, char* argv[])
+{
+    uint CacheSize = ANALYZE_CACHE_SIZE;
+    vector<string> Files;
+
+    for (int i = 1 ; i < argc ; i++) {
+        if (strcmp(argv[i], "--cache") == 0 && i + 1 < argc) {
+            CacheSize = max(atoi(argv[++i]), 1);
+        }
+        else if (strncmp(argv[i], "--", 2) != 0) {
+            Files.push_back(argv[i]);
+        }
+        else {
+            Files.clear();
+            break;
+        }
+    }
+
+    if (Files.empty()) {
+        printf("usage: %s [--cache N] model files...\n", argv[0]);
+        return 1;
+    }
+
+    int Ret = 0;
+
+    for (uint i = 0 ; i < Files.size() ; i++) {
+        if (!Report(Files[i], CacheSize)) {
+            Ret = 1;
+        }
+    }
+
+    return Ret;
+}
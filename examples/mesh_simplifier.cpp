@@ -0,0 +1,421 @@
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+
+#include "mesh_cache.h"
+#include "mesh_simplifier.h"
+
+// A collapse is rejected when it turns a triangle around the removed
+// vertex by more than about 75 degrees
+#define MIN_NORMAL_COSINE 0.25f
+
+#define NO_VERTEX 0xFFFFFFFF
+
+// Sum of squared distances to the planes of a vertex's triangles, each
+// weighted by its triangle's area: the symmetric A, b and c of
+// p'Ap + 2b'p + c plus the total weight
+struct Quadric
+{
+    float a00, a01, a02, a11, a12, a22;
+    float b0, b1, b2;
+    float c;
+    float Weight;
+
+    Quadric()
+    {
+        memset(this, 0, sizeof(*this));
+    }
+
+    void AddPlane(const aiVector3D& n, float d, float w)
+    {
+        a00 += w * n.x * n.x; a01 += w * n.x * n.y; a02 += w * n.x * n.z;
+        a11 += w * n.y * n.y; a12 += w * n.y * n.z; a22 += w * n.z * n.z;
+        b0 += w * n.x * d; b1 += w * n.y * d; b2 += w * n.z * d;
+        c += w * d * d;
+        Weight += w;
+    }
+
+    Quadric& operator+=(const Quadric& q)
+    {
+        a00 += q.a00; a01 += q.a01; a02 += q.a02;
+        a11 += q.a11; a12 += q.a12; a22 += q.a22;
+        b0 += q.b0; b1 += q.b1; b2 += q.b2;
+        c += q.c;
+        Weight += q.Weight;
+        return *this;
+    }
+
+    // Area weighted mean of the squared distances of p to the planes
+    float Error(const aiVector3D& p) const
+    {
+        const float Sum = p.x * (a00 * p.x + 2.0f * (a01 * p.y + a02 * p.z + b0))
+                        + p.y * (a11 * p.y + 2.0f * (a12 * p.z + b1))
+                        + p.z * (a22 * p.z + 2.0f * b2) + c;
+
+        return Weight > 0.0f ? max(Sum / Weight, 0.0f) : 0.0f;
+    }
+};
+
+struct Collapse
+{
+    uint From;
+    uint To;
+    float Error;        // squared
+
+    bool operator<(const Collapse& c) const
+    {
+        return Error < c.Error;
+    }
+};
+
+
+// Half the L1 distance between the weights per bone: 0 for the same
+// influences, 1 for disjoint ones
+static float WeightDistance(const VertexBoneData& a, const VertexBoneData& b)
+{
+    float Distance = 0.0f;
+
+    for (uint i = 0 ; i < NUM_BONES_PER_VEREX ; i++) {
+        if (a.Weights[i] != 0.0f) {
+            float Other = 0.0f;
+
+            for (uint j = 0 ; j < NUM_BONES_PER_VEREX ; j++) {
+                if (b.Weights[j] != 0.0f && b.IDs[j] == a.IDs[i]) {
+                    Other = b.Weights[j];
+                }
+            }
+
+            Distance += fabsf(a.Weights[i] - Other);
+        }
+
+        if (b.Weights[i] != 0.0f) {
+            bool Shared = false;
+
+            for (uint j = 0 ; j < NUM_BONES_PER_VEREX ; j++) {
+                Shared = Shared || (a.Weights[j] != 0.0f && a.IDs[j] == b.IDs[i]);
+            }
+
+            if (!Shared) {
+                Distance += b.Weights[i];
+            }
+        }
+    }
+
+    return 0.5f * Distance;
+}
+
+
+// Points every index at the first vertex identical to its own in every
+// attribute. Importers that don't join identical vertices give every
+// triangle corner its own copy, which would otherwise look like seams all
+// over the mesh.
+static void WeldIndices(const SkinnedVertex* pVertices, uint NumVertices, uint* pIndices, uint NumIndices)
+{
+    uint TableSize = 16;
+
+    while (TableSize < NumVertices * 2) {
+        TableSize *= 2;
+    }
+
+    vector<uint> Table(TableSize, NO_VERTEX);
+    vector<uint> Remap(NumVertices);
+
+    for (uint v = 0 ; v < NumVertices ; v++) {
+        uint Slot = (uint)HashBytes(&pVertices[v], sizeof(SkinnedVertex)) & (TableSize - 1);
+
+        while (Table[Slot] != NO_VERTEX && memcmp(&pVertices[Table[Slot]], &pVertices[v], sizeof(SkinnedVertex)) != 0) {
+            Slot = (Slot + 1) & (TableSize - 1);
+        }
+
+        if (Table[Slot] == NO_VERTEX) {
+            Table[Slot] = v;
+        }
+
+        Remap[v] = Table[Slot];
+    }
+
+    for (uint i = 0 ; i < NumIndices ; i++) {
+        pIndices[i] = Remap[pIndices[i]];
+    }
+}
+
+
+// Vertices that have to stay: those sharing their position with other
+// vertices of the triangles (attribute seams) and those on an edge with
+// only one triangle
+static void FindLockedVertices(const SkinnedVertex* pVertices, uint NumVertices, const uint* pIndices, uint NumIndices,
+                               vector<bool>& Locked)
+{
+    // First vertex at every position, found by open addressing
+    uint TableSize = 16;
+
+    while (TableSize < NumVertices * 2) {
+        TableSize *= 2;
+    }
+
+    vector<uint> Table(TableSize, NO_VERTEX);
+    vector<uint> Wedge(NumVertices);
+
+    vector<bool> Used(NumVertices, false);
+
+    for (uint i = 0 ; i < NumIndices ; i++) {
+        Used[pIndices[i]] = true;
+    }
+
+    Locked.assign(NumVertices, false);
+
+    for (uint v = 0 ; v < NumVertices ; v++) {
+        if (!Used[v]) {
+            continue;
+        }
+
+        const aiVector3D& p = pVertices[v].Position;
+        uint Slot = (uint)HashBytes(&p, sizeof(p)) & (TableSize - 1);
+
+        while (Table[Slot] != NO_VERTEX && !(pVertices[Table[Slot]].Position == p)) {
+            Slot = (Slot + 1) & (TableSize - 1);
+        }
+
+        if (Table[Slot] == NO_VERTEX) {
+            Table[Slot] = v;
+        }
+        else {
+            Locked[v] = true;
+            Locked[Table[Slot]] = true;
+        }
+
+        Wedge[v] = Table[Slot];
+    }
+
+    // Directed edges between positions. An edge whose reverse is missing
+    // is on a border.
+    vector<uint64_t> Edges(NumIndices);
+
+    for (uint i = 0 ; i < NumIndices ; i++) {
+        const uint a = Wedge[pIndices[i]], b = Wedge[pIndices[i - i % 3 + (i + 1) % 3]];
+        Edges[i] = ((uint64_t)a << 32) | b;
+    }
+
+    vector<uint64_t> Sorted(Edges);
+    sort(Sorted.begin(), Sorted.end());
+
+    for (uint i = 0 ; i < NumIndices ; i++) {
+        const uint64_t Reverse = (Edges[i] << 32) | (Edges[i] >> 32);
+
+        if (!binary_search(Sorted.begin(), Sorted.end(), Reverse)) {
+            Locked[pIndices[i]] = true;
+            Locked[pIndices[i - i % 3 + (i + 1) % 3]] = true;
+        }
+    }
+}
+
+
+uint SimplifyMesh(const SkinnedVertex* pVertices, uint NumVertices, const uint* pIndices, uint NumIndices,
+                  uint TargetIndices, float MaxError, uint* pDestination, float* pError)
+{
+    uint* pResult = pDestination;
+    uint Count = NumIndices - NumIndices % 3;
+    float MaxCollapseError = 0.0f;
+
+    memcpy(pResult, pIndices, sizeof(uint) * Count);
+    WeldIndices(pVertices, NumVertices, pResult, Count);
+
+    vector<bool> Locked;
+    FindLockedVertices(pVertices, NumVertices, pResult, Count, Locked);
+
+    // The weight term is scaled by the size of the mesh to compare it with
+    // the geometric error
+    aiVector3D Min(1e30f), Max(-1e30f);
+
+    for (uint i = 0 ; i < Count ; i++) {
+        const aiVector3D& p = pVertices[pResult[i]].Position;
+
+        for (uint k = 0 ; k < 3 ; k++) {
+            Min[k] = min(Min[k], p[k]);
+            Max[k] = max(Max[k], p[k]);
+        }
+    }
+
+    const float Radius = Count ? 0.5f * (Max - Min).Length() : 0.0f;
+    const float WeightScale = SKIN_WEIGHT_ERROR * Radius * SKIN_WEIGHT_ERROR * Radius;
+
+    vector<Quadric> Quadrics(NumVertices);
+
+    for (uint i = 0 ; i < Count ; i += 3) {
+        const aiVector3D& p0 = pVertices[pResult[i]].Position;
+        aiVector3D Normal = (pVertices[pResult[i + 1]].Position - p0) ^ (pVertices[pResult[i + 2]].Position - p0);
+        const float Area = 0.5f * Normal.Length();
+
+        if (Area > 0.0f) {
+            Normal.Normalize();
+
+            for (uint k = 0 ; k < 3 ; k++) {
+                Quadrics[pResult[i + k]].AddPlane(Normal, -(Normal * p0), Area);
+            }
+        }
+    }
+
+    auto CollapseError = [&](uint From, uint To) {
+        Quadric q = Quadrics[From];
+        q += Quadrics[To];
+
+        const float Weights = WeightDistance(pVertices[From].Bones, pVertices[To].Bones);
+        return q.Error(pVertices[To].Position) + WeightScale * Weights * Weights;
+    };
+
+    vector<uint> Remap(NumVertices);
+    vector<uint> FirstTriangle(NumVertices + 1);
+    vector<uint> Triangles;
+    vector<bool> Touched(NumVertices);
+    vector<Collapse> Collapses;
+
+    for (uint v = 0 ; v < NumVertices ; v++) {
+        Remap[v] = v;
+    }
+
+    // Every pass collapses the cheapest edges whose neighbourhoods don't
+    // overlap, then rebuilds the triangles
+    while (Count > TargetIndices) {
+        fill(FirstTriangle.begin(), FirstTriangle.end(), 0);
+
+        for (uint i = 0 ; i < Count ; i++) {
+            FirstTriangle[pResult[i] + 1]++;
+        }
+
+        for (uint v = 0 ; v < NumVertices ; v++) {
+            FirstTriangle[v + 1] += FirstTriangle[v];
+        }
+
+        Triangles.resize(Count);
+
+        for (uint i = 0 ; i < Count ; i++) {
+            Triangles[FirstTriangle[pResult[i]]++] = i / 3;
+        }
+
+        for (uint v = NumVertices ; v > 0 ; v--) {
+            FirstTriangle[v] = FirstTriangle[v - 1];
+        }
+        FirstTriangle[0] = 0;
+
+        // Interior edges are seen from both of their triangles, so only the
+        // one going up is taken, in its cheaper direction
+        Collapses.clear();
+
+        for (uint i = 0 ; i < Count ; i++) {
+            const uint a = pResult[i], b = pResult[i - i % 3 + (i + 1) % 3];
+
+            if (a >= b || (Locked[a] && Locked[b])) {
+                continue;
+            }
+
+            Collapse c;
+            c.Error = 1e30f;
+
+            if (!Locked[a]) {
+                c.From = a;
+                c.To = b;
+                c.Error = CollapseError(a, b);
+            }
+
+            if (!Locked[b]) {
+                const float Error = CollapseError(b, a);
+
+                if (Error < c.Error) {
+                    c.From = b;
+                    c.To = a;
+                    c.Error = Error;
+                }
+            }
+
+            Collapses.push_back(c);
+        }
+
+        sort(Collapses.begin(), Collapses.end());
+
+        // Each collapse removes the two triangles of its edge
+        const uint TrianglesToRemove = (Count - TargetIndices + 2) / 3;
+        uint Removed = 0;
+
+        fill(Touched.begin(), Touched.end(), false);
+
+        for (uint i = 0 ; i < Collapses.size() && Removed < TrianglesToRemove ; i++) {
+            const Collapse& c = Collapses[i];
+
+            if (c.Error > MaxError * MaxError) {
+                break;
+            }
+
+            if (Touched[c.From] || Touched[c.To]) {
+                continue;
+            }
+
+            // None of the triangles kept may flip or collapse
+            bool Flips = false;
+
+            for (uint n = FirstTriangle[c.From] ; n < FirstTriangle[c.From + 1] && !Flips ; n++) {
+                const uint* pTriangle = &pResult[3 * Triangles[n]];
+
+                if (pTriangle[0] == c.To || pTriangle[1] == c.To || pTriangle[2] == c.To) {
+                    continue;
+                }
+
+                aiVector3D p[3], q[3];
+                aiVector3D Normals(0.0f, 0.0f, 0.0f);
+
+                for (uint k = 0 ; k < 3 ; k++) {
+                    const uint v = pTriangle[k] == c.From ? c.To : pTriangle[k];
+                    p[k] = pVertices[pTriangle[k]].Position;
+                    q[k] = pVertices[v].Position;
+                    Normals += pVertices[v].Normal;
+                }
+
+                // Small turns can add up over many collapses, so the result
+                // also has to face the way of its vertex normals
+                const aiVector3D Before = (p[1] - p[0]) ^ (p[2] - p[0]);
+                const aiVector3D After = (q[1] - q[0]) ^ (q[2] - q[0]);
+
+                Flips = Before * After <= MIN_NORMAL_COSINE * Before.Length() * After.Length() || After * Normals < 0.0f;
+            }
+
+            if (Flips) {
+                continue;
+            }
+
+            for (uint n = FirstTriangle[c.From] ; n < FirstTriangle[c.From + 1] ; n++) {
+                const uint* pTriangle = &pResult[3 * Triangles[n]];
+                Touched[pTriangle[0]] = Touched[pTriangle[1]] = Touched[pTriangle[2]] = true;
+            }
+
+            Remap[c.From] = c.To;
+            Quadrics[c.To] += Quadrics[c.From];
+            MaxCollapseError = max(MaxCollapseError, c.Error);
+            Removed += 2;
+        }
+
+        if (Removed == 0) {
+            break;
+        }
+
+        // A collapsed vertex is never a target in the same pass, so one
+        // lookup is enough
+        uint NewCount = 0;
+
+        for (uint i = 0 ; i < Count ; i += 3) {
+            const uint a = Remap[pResult[i]], b = Remap[pResult[i + 1]], c = Remap[pResult[i + 2]];
+
+            if (a != b && b != c && c != a) {
+                pResult[NewCount++] = a;
+                pResult[NewCount++] = b;
+                pResult[NewCount++] = c;
+            }
+        }
+
+        Count = NewCount;
+    }
+
+    if (pError) {
+        *pError = sqrtf(MaxCollapseError);
+    }
+
+    return Count;
+}
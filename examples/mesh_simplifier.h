@@ -0,0 +1,26 @@
+#ifndef MESH_SIMPLIFIER_H
+#define	MESH_SIMPLIFIER_H
+
+#include "scene.h"
+
+// Collapsing an edge between vertices with entirely different bone weights
+// costs as much as moving a vertex by this fraction of the mesh radius, so
+// that simplification keeps the areas where the skin bends
+#define SKIN_WEIGHT_ERROR 0.1f
+
+// Simplifies a triangle list by quadric edge collapse until it has at most
+// TargetIndices indices or the next collapse would cost more than MaxError
+// (a distance in the units of the positions). Vertices are only ever
+// collapsed onto other vertices, so the result indexes the same vertices.
+// Duplicates identical in every attribute are treated as one vertex, so the
+// input needs no welding. Border and seam vertices (sharing their position
+// with other vertices that differ otherwise) stay in place.
+//
+// Writes the simplified indices to pDestination, which must hold
+// NumIndices, and returns their number. pError receives the largest error
+// of the collapses done, including the cost of blending different bone
+// weights.
+uint SimplifyMesh(const SkinnedVertex* pVertices, uint NumVertices, const uint* pIndices, uint NumIndices,
+                  uint TargetIndices, float MaxError, uint* pDestination, float* pError);
+
+#endif	/* MESH_SIMPLIFIER_H */
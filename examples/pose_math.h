@@ -0,0 +1,133 @@
+#ifndef POSE_MATH_H
+#define	POSE_MATH_H
+
+// Affine transforms for pose evaluation. With USE_SIMD (and an SSE2 target)
+// every row is an SSE register via glm's simdVec4, otherwise plain glm::vec4
+// is used with the same code shape.
+
+#include "TutorialConfig.h"
+
+#include <assimp/scene.h>
+
+// No angles go through glm here; this only keeps the quaternion headers
+// from warning about their degree-based overloads
+#ifndef GLM_FORCE_RADIANS
+#define GLM_FORCE_RADIANS
+#endif
+#include <glm/glm.hpp>
+#include <glm/gtx/dual_quaternion.hpp>
+
+#if defined(USE_SIMD) && (GLM_ARCH & GLM_ARCH_SSE2)
+#define POSE_MATH_SIMD
+#include <glm/gtx/simd_vec4.hpp>
+typedef glm::simdVec4 AffineRow;
+#else
+typedef glm::vec4 AffineRow;
+#endif
+
+// 3x4 row-major matrix, the implicit last row being (0, 0, 0, 1). Rows are
+// 16 byte aligned with SIMD so palettes can be copied straight to the GPU.
+struct AffineMatrix
+{
+    AffineRow Rows[3];
+
+    AffineMatrix()
+    {
+        Rows[0] = AffineRow(1.0f, 0.0f, 0.0f, 0.0f);
+        Rows[1] = AffineRow(0.0f, 1.0f, 0.0f, 0.0f);
+        Rows[2] = AffineRow(0.0f, 0.0f, 1.0f, 0.0f);
+    }
+
+    // The last row of m is dropped, it has to be (0, 0, 0, 1)
+    explicit AffineMatrix(const aiMatrix4x4& m)
+    {
+        Rows[0] = AffineRow(m.a1, m.a2, m.a3, m.a4);
+        Rows[1] = AffineRow(m.b1, m.b2, m.b3, m.b4);
+        Rows[2] = AffineRow(m.c1, m.c2, m.c3, m.c4);
+    }
+
+    glm::vec4 Row(uint i) const
+    {
+#ifdef POSE_MATH_SIMD
+        return glm::vec4_cast(Rows[i]);
+#else
+        return Rows[i];
+#endif
+    }
+
+    aiMatrix4x4 ToMatrix4x4() const
+    {
+        const glm::vec4 a = Row(0), b = Row(1), c = Row(2);
+
+        return aiMatrix4x4(a.x,  a.y,  a.z,  a.w,
+                           b.x,  b.y,  b.z,  b.w,
+                           c.x,  c.y,  c.z,  c.w,
+                           0.0f, 0.0f, 0.0f, 1.0f);
+    }
+};
+
+// Rigid transform as a unit dual quaternion, 32 bytes against the 48 of an
+// AffineMatrix. Real is the rotation and Dual encodes the translation, both
+// stored (x, y, z, w). Scale and shear can't be represented.
+struct DualQuaternion
+{
+    glm::vec4 Real;
+    glm::vec4 Dual;
+
+    DualQuaternion() : Real(0.0f, 0.0f, 0.0f, 1.0f), Dual(0.0f)
+    {
+    }
+
+    // m has to be a rotation plus a translation
+    explicit DualQuaternion(const AffineMatrix& m)
+    {
+        // glm's 3x4 matrices are row-major like AffineMatrix
+        const glm::dualquat q = glm::dualquat_cast(glm::mat3x4(m.Row(0), m.Row(1), m.Row(2)));
+
+        Real = glm::vec4(q.real.x, q.real.y, q.real.z, q.real.w);
+        Dual = glm::vec4(q.dual.x, q.dual.y, q.dual.z, q.dual.w);
+    }
+};
+
+// Out = T * R * S, built directly from the rotation's matrix terms scaled
+// per column instead of multiplying three 4x4 matrices
+inline void ComposeTRS(AffineMatrix& Out, const aiVector3D& T, const aiQuaternion& R, const aiVector3D& S)
+{
+    const float x2 = R.x + R.x, y2 = R.y + R.y, z2 = R.z + R.z;
+    const float xx = R.x * x2, xy = R.x * y2, xz = R.x * z2;
+    const float yy = R.y * y2, yz = R.y * z2, zz = R.z * z2;
+    const float wx = R.w * x2, wy = R.w * y2, wz = R.w * z2;
+
+    const AffineRow Scale(S.x, S.y, S.z, 1.0f);
+
+    Out.Rows[0] = AffineRow(1.0f - (yy + zz), xy - wz,          xz + wy,          T.x) * Scale;
+    Out.Rows[1] = AffineRow(xy + wz,          1.0f - (xx + zz), yz - wx,          T.y) * Scale;
+    Out.Rows[2] = AffineRow(xz - wy,          yz + wx,          1.0f - (xx + yy), T.z) * Scale;
+}
+
+// Out = A * B. Out may alias A but not B.
+inline void MultiplyAffine(AffineMatrix& Out, const AffineMatrix& A, const AffineMatrix& B)
+{
+    // Each row of the result is a combination of the rows of B weighted by
+    // the row of A; B's implicit last row only contributes A's translation
+#ifdef POSE_MATH_SIMD
+    const AffineRow TranslationMask(0.0f, 0.0f, 0.0f, 1.0f);
+
+    for (uint i = 0 ; i < 3 ; i++) {
+        const AffineRow a = A.Rows[i];
+
+        Out.Rows[i] = a.swizzle<glm::X, glm::X, glm::X, glm::X>() * B.Rows[0]
+                    + a.swizzle<glm::Y, glm::Y, glm::Y, glm::Y>() * B.Rows[1]
+                    + a.swizzle<glm::Z, glm::Z, glm::Z, glm::Z>() * B.Rows[2]
+                    + a * TranslationMask;
+    }
+#else
+    for (uint i = 0 ; i < 3 ; i++) {
+        const AffineRow a = A.Rows[i];
+
+        Out.Rows[i] = a.x * B.Rows[0] + a.y * B.Rows[1] + a.z * B.Rows[2] + AffineRow(0.0f, 0.0f, 0.0f, a.w);
+    }
+#endif
+}
+
+#endif	/* POSE_MATH_H */
@@ -0,0 +1,421 @@
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <map>
+
+#include "profiler.h"
+
+// Hands the ring of an exiting thread back to the profiler
+struct ThreadRingOwner
+{
+    ProfileRing* pRing;
+
+    ~ThreadRingOwner()
+    {
+        if (pRing) {
+            Profiler::Get().ReleaseRing(pRing);
+        }
+    }
+};
+
+static thread_local ThreadRingOwner t_Ring = { NULL };
+
+
+Profiler& Profiler::Get()
+{
+    static Profiler* s_pProfiler = new Profiler;
+    return *s_pProfiler;
+}
+
+
+Profiler::Profiler()
+{
+    m_Enabled.store(false);
+    m_Origin         = Now();
+    m_Frame          = 0;
+    m_MaxTraceEvents = 0;
+    m_Gpu            = false;
+    m_GpuOffset      = 0;
+    m_GpuFrame       = 0;
+    memset(m_GpuFrames, 0, sizeof(m_GpuFrames));
+}
+
+
+uint64_t Profiler::Now()
+{
+    return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+bool Profiler::InitGpu()
+{
+    for (uint i = 0 ; i < NUM_GPU_PROFILE_FRAMES ; i++) {
+        glGenQueries(2 * MAX_GPU_SCOPES, m_GpuFrames[i].Queries);
+        m_GpuFrames[i].NumScopes = 0;
+    }
+
+    // Maps GPU timestamps onto the CPU timeline of the trace
+    GLint64 GpuTime = 0;
+    glGetInteger64v(GL_TIMESTAMP, &GpuTime);
+    m_GpuOffset = (int64_t)Now() - GpuTime;
+    m_GpuFrame = m_Frame;
+
+    m_Gpu = glGetError() == GL_NO_ERROR;
+    return m_Gpu;
+}
+
+
+ProfileRing* Profiler::ThreadRing()
+{
+    if (!t_Ring.pRing) {
+        lock_guard<mutex> Lock(m_RingsMutex);
+        ProfileRing* pRing;
+
+        if (!m_FreeRings.empty()) {
+            pRing = m_FreeRings.back();
+            m_FreeRings.pop_back();
+        }
+        else {
+            pRing = new ProfileRing;
+            pRing->Written.store(0);
+            pRing->Read.store(0);
+            pRing->Dropped.store(0);
+            m_Rings.push_back(unique_ptr<ProfileRing>(pRing));
+        }
+
+        pRing->ThreadIndex = m_ThreadNames.size();
+        pRing->Released = false;
+        m_ThreadNames.push_back("thread " + to_string(pRing->ThreadIndex));
+        t_Ring.pRing = pRing;
+    }
+
+    return t_Ring.pRing;
+}
+
+
+// The events still in the ring are drained by the next EndFrame, which
+// then frees it
+void Profiler::ReleaseRing(ProfileRing* pRing)
+{
+    lock_guard<mutex> Lock(m_RingsMutex);
+
+    if (pRing->Read.load(memory_order_relaxed) == pRing->Written.load(memory_order_relaxed)) {
+        m_FreeRings.push_back(pRing);
+    }
+    else {
+        pRing->Released = true;
+    }
+}
+
+
+uint Profiler::NumThreadRings() const
+{
+    lock_guard<mutex> Lock(m_RingsMutex);
+    return m_Rings.size();
+}
+
+
+void Profiler::SetThreadName(const string& Name)
+{
+    ProfileRing* pRing = ThreadRing();
+    lock_guard<mutex> Lock(m_RingsMutex);
+    m_ThreadNames[pRing->ThreadIndex] = Name;
+}
+
+
+void Profiler::Record(const char* pName, uint64_t Begin, uint64_t End)
+{
+    ProfileRing* pRing = ThreadRing();
+    const uint Written = pRing->Written.load(memory_order_relaxed);
+
+    if (Written - pRing->Read.load(memory_order_acquire) >= PROFILE_RING_SIZE) {
+        pRing->Dropped.fetch_add(1, memory_order_relaxed);
+        return;
+    }
+
+    ProfileEvent& Event = pRing->Events[Written % PROFILE_RING_SIZE];
+    Event.pName = pName;
+    Event.Begin = Begin;
+    Event.End   = End;
+    pRing->Written.store(Written + 1, memory_order_release);
+}
+
+
+void Profiler::BeginGpuScope(const char* pName)
+{
+    GpuFrame& Frame = m_GpuFrames[m_Frame % NUM_GPU_PROFILE_FRAMES];
+
+    if (!m_Gpu || !Enabled() || Frame.NumScopes == MAX_GPU_SCOPES) {
+        m_GpuStack.push_back(~0u);
+        return;
+    }
+
+    const uint Scope = Frame.NumScopes++;
+    Frame.Names[Scope] = pName;
+    glQueryCounter(Frame.Queries[2 * Scope], GL_TIMESTAMP);
+    m_GpuStack.push_back(Scope);
+}
+
+
+void Profiler::EndGpuScope()
+{
+    if (m_GpuStack.empty()) {
+        return;
+    }
+
+    const uint Scope = m_GpuStack.back();
+    m_GpuStack.pop_back();
+
+    if (Scope != ~0u) {
+        glQueryCounter(m_GpuFrames[m_Frame % NUM_GPU_PROFILE_FRAMES].Queries[2 * Scope + 1], GL_TIMESTAMP);
+    }
+}
+
+
+void Profiler::AddEvent(unordered_map<const char*, ScopeStats>& Stats, const ProfileEvent& Event, int Thread)
+{
+    const uint Slot = (Thread < 0 ? m_GpuFrame : m_Frame) % PROFILE_WINDOW;
+    unordered_map<const char*, ScopeStats>::iterator it = Stats.find(Event.pName);
+
+    if (it == Stats.end()) {
+        it = Stats.insert(make_pair(Event.pName, ScopeStats())).first;
+        memset(&it->second, 0, sizeof(ScopeStats));
+    }
+
+    it->second.Ms[Slot] += (Event.End - Event.Begin) * 1e-6;
+    it->second.Calls[Slot]++;
+
+    if (m_Trace.size() < m_MaxTraceEvents) {
+        TraceEvent Trace;
+        Trace.Event  = Event;
+        Trace.Thread = Thread;
+        m_Trace.push_back(Trace);
+    }
+}
+
+
+// The results of the frame m_GpuFrame, which replace those of the frame
+// PROFILE_WINDOW before it
+void Profiler::CollectGpuFrame(GpuFrame& Frame)
+{
+    const uint Slot = m_GpuFrame % PROFILE_WINDOW;
+
+    for (unordered_map<const char*, ScopeStats>::iterator it = m_GpuStats.begin() ; it != m_GpuStats.end() ; it++) {
+        it->second.Ms[Slot]    = 0.0;
+        it->second.Calls[Slot] = 0;
+    }
+
+    for (uint i = 0 ; i < Frame.NumScopes ; i++) {
+        GLuint64 Begin = 0, End = 0;
+        glGetQueryObjectui64v(Frame.Queries[2 * i], GL_QUERY_RESULT, &Begin);
+        glGetQueryObjectui64v(Frame.Queries[2 * i + 1], GL_QUERY_RESULT, &End);
+
+        ProfileEvent Event;
+        Event.pName = Frame.Names[i];
+        Event.Begin = Begin + m_GpuOffset;
+        Event.End   = max(End, Begin) + m_GpuOffset;
+        AddEvent(m_GpuStats, Event, -1);
+    }
+
+    Frame.NumScopes = 0;
+    m_GpuFrame++;
+}
+
+
+void Profiler::BeginFrame()
+{
+    const uint Slot = m_Frame % PROFILE_WINDOW;
+
+    for (unordered_map<const char*, ScopeStats>::iterator it = m_CpuStats.begin() ; it != m_CpuStats.end() ; it++) {
+        it->second.Ms[Slot]    = 0.0;
+        it->second.Calls[Slot] = 0;
+    }
+
+    // The queries of the frame NUM_GPU_PROFILE_FRAMES back are almost
+    // certainly done, and are about to be reused
+    if (m_Gpu && m_GpuFrame + NUM_GPU_PROFILE_FRAMES <= m_Frame) {
+        CollectGpuFrame(m_GpuFrames[m_GpuFrame % NUM_GPU_PROFILE_FRAMES]);
+    }
+
+    m_GpuStack.clear();
+}
+
+
+void Profiler::EndFrame()
+{
+    lock_guard<mutex> Lock(m_RingsMutex);
+
+    for (uint r = 0 ; r < m_Rings.size() ; r++) {
+        ProfileRing& Ring = *m_Rings[r];
+        const uint Read = Ring.Read.load(memory_order_relaxed);
+        const uint Written = Ring.Written.load(memory_order_acquire);
+
+        for (uint i = Read ; i != Written ; i++) {
+            AddEvent(m_CpuStats, Ring.Events[i % PROFILE_RING_SIZE], Ring.ThreadIndex);
+        }
+
+        Ring.Read.store(Written, memory_order_release);
+
+        if (Ring.Released) {
+            Ring.Released = false;
+            m_FreeRings.push_back(&Ring);
+        }
+    }
+
+    m_Frame++;
+}
+
+
+void Profiler::Finish()
+{
+    if (!m_Gpu) {
+        return;
+    }
+
+    while (m_GpuFrame < m_Frame) {
+        CollectGpuFrame(m_GpuFrames[m_GpuFrame % NUM_GPU_PROFILE_FRAMES]);
+    }
+}
+
+
+void Profiler::StartTrace(size_t MaxEvents)
+{
+    m_Trace.clear();
+    m_Trace.reserve(MaxEvents);
+    m_MaxTraceEvents = MaxEvents;
+}
+
+
+// Names are literals from the code, only quotes and backslashes need care
+static void WriteJsonString(FILE* f, const char* pString)
+{
+    fputc('"', f);
+
+    for (const char* p = pString ; *p ; p++) {
+        if (*p == '"' || *p == '\\') {
+            fputc('\\', f);
+        }
+        fputc(*p, f);
+    }
+
+    fputc('"', f);
+}
+
+
+bool Profiler::WriteTrace(const string& Filename) const
+{
+    FILE* f = fopen(Filename.c_str(), "w");
+
+    if (!f) {
+        return false;
+    }
+
+    // Complete ("X") events in microseconds, one track per thread and one
+    // for the GPU
+    fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    fprintf(f, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"GPU\"}}");
+
+    {
+        lock_guard<mutex> Lock(m_RingsMutex);
+
+        for (uint t = 0 ; t < m_ThreadNames.size() ; t++) {
+            fprintf(f, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":", t + 1);
+            WriteJsonString(f, m_ThreadNames[t].c_str());
+            fprintf(f, "}}");
+        }
+    }
+
+    for (size_t i = 0 ; i < m_Trace.size() ; i++) {
+        const ProfileEvent& Event = m_Trace[i].Event;
+        const double Begin = ((int64_t)(Event.Begin - m_Origin)) * 1e-3;
+
+        fprintf(f, ",\n{\"name\":");
+        WriteJsonString(f, Event.pName);
+        fprintf(f, ",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%d}",
+                m_Trace[i].Thread < 0 ? "gpu" : "cpu", Begin, (Event.End - Event.Begin) * 1e-3, m_Trace[i].Thread + 1);
+    }
+
+    fprintf(f, "\n]}\n");
+
+    return fclose(f) == 0;
+}
+
+
+void Profiler::ReportStats(FILE* f, const char* pKind, const unordered_map<const char*, ScopeStats>& Stats, uint NumFrames)
+{
+    // Equal names from different literals are one scope
+    map<string, ScopeStats> Merged;
+
+    for (unordered_map<const char*, ScopeStats>::const_iterator it = Stats.begin() ; it != Stats.end() ; it++) {
+        map<string, ScopeStats>::iterator m = Merged.find(it->first);
+
+        if (m == Merged.end()) {
+            Merged.insert(make_pair(string(it->first), it->second));
+            continue;
+        }
+
+        for (uint i = 0 ; i < PROFILE_WINDOW ; i++) {
+            m->second.Ms[i]    += it->second.Ms[i];
+            m->second.Calls[i] += it->second.Calls[i];
+        }
+    }
+
+    vector<pair<double, string> > Order;
+
+    for (map<string, ScopeStats>::const_iterator it = Merged.begin() ; it != Merged.end() ; it++) {
+        double Sum = 0.0;
+
+        for (uint i = 0 ; i < PROFILE_WINDOW ; i++) {
+            Sum += it->second.Ms[i];
+        }
+
+        Order.push_back(make_pair(-Sum, it->first));
+    }
+
+    sort(Order.begin(), Order.end());
+
+    for (uint i = 0 ; i < Order.size() ; i++) {
+        const ScopeStats& s = Merged[Order[i].second];
+        double Max = 0.0;
+        uint Calls = 0;
+
+        for (uint j = 0 ; j < PROFILE_WINDOW ; j++) {
+            Max = max(Max, s.Ms[j]);
+            Calls += s.Calls[j];
+        }
+
+        fprintf(f, "  %s %-28s mean %8.3f  max %8.3f  calls %6.1f\n", pKind, Order[i].second.c_str(),
+                -Order[i].first / NumFrames, Max, double(Calls) / NumFrames);
+    }
+}
+
+
+void Profiler::Report(FILE* f) const
+{
+    const uint NumFrames = min(m_Frame, (uint)PROFILE_WINDOW);
+    const uint NumGpuFrames = min(m_GpuFrame, (uint)PROFILE_WINDOW);
+
+    if (NumFrames == 0) {
+        return;
+    }
+
+    uint Dropped = 0;
+
+    {
+        lock_guard<mutex> Lock(m_RingsMutex);
+
+        for (uint r = 0 ; r < m_Rings.size() ; r++) {
+            Dropped += m_Rings[r]->Dropped.load(memory_order_relaxed);
+        }
+    }
+
+    fprintf(f, "Profile of the last %u frames, ms per frame:\n", NumFrames);
+    ReportStats(f, "CPU", m_CpuStats, NumFrames);
+    if (NumGpuFrames > 0) {
+        ReportStats(f, "GPU", m_GpuStats, NumGpuFrames);
+    }
+
+    if (Dropped > 0) {
+        fprintf(f, "  %u events dropped, raise PROFILE_RING_SIZE\n", Dropped);
+    }
+}
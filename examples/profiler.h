@@ -0,0 +1,199 @@
+#ifndef PROFILER_H
+#define	PROFILER_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <GL/glew.h>
+
+using namespace std;
+
+#define PROFILE_RING_SIZE 4096        // CPU events a thread can record between two EndFrame calls
+#define PROFILE_WINDOW 60             // frames of the rolling summary
+#define MAX_GPU_SCOPES 32             // GPU scopes per frame
+#define NUM_GPU_PROFILE_FRAMES 4      // frames before GPU results are read back
+
+// One timed scope, in nanoseconds of the steady clock. Names are string
+// literals and are told apart by address.
+struct ProfileEvent
+{
+    const char* pName;
+    uint64_t Begin;
+    uint64_t End;
+};
+
+// Events of one thread, written by that thread only and drained by
+// Profiler::EndFrame. A full ring drops new events rather than blocking.
+// Once its thread has exited and its events are drained, a ring is reused
+// by the next thread, which still gets a track of its own in the trace.
+struct ProfileRing
+{
+    ProfileEvent Events[PROFILE_RING_SIZE];
+    atomic<uint> Written;
+    atomic<uint> Read;
+    atomic<uint> Dropped;
+    uint ThreadIndex;       // track of the thread writing it
+    bool Released;          // its thread has exited
+};
+
+// Scope timings of every thread plus GPU timings of the main thread,
+// summed up per frame over a rolling window and optionally kept for a
+// Chrome trace (chrome://tracing or Perfetto). Recording costs a clock read
+// and a ring write per scope, and a flag check while disabled.
+//
+// BeginFrame, EndFrame, the GPU scopes and everything reading the results
+// belong to the thread owning the GL context. CPU scopes can be recorded
+// on any thread.
+class Profiler
+{
+public:
+    static Profiler& Get();
+
+    // Nothing is recorded until enabled
+    void Enable(bool Enabled)
+    {
+        m_Enabled.store(Enabled, memory_order_relaxed);
+    }
+
+    bool Enabled() const
+    {
+        return m_Enabled.load(memory_order_relaxed);
+    }
+
+    // Creates the timestamp queries of the GPU scopes, which are ignored
+    // until then. Needs a current GL context with timer queries.
+    bool InitGpu();
+
+    void BeginFrame();
+
+    // Collects the CPU events recorded since the last EndFrame
+    void EndFrame();
+
+    // Waits for the outstanding GPU results, ends the profile
+    void Finish();
+
+    // Keeps up to MaxEvents CPU and GPU events for WriteTrace
+    void StartTrace(size_t MaxEvents);
+
+    bool WriteTrace(const string& Filename) const;
+
+    // Mean and largest time per frame and calls per frame of every scope
+    // over the last PROFILE_WINDOW frames, slowest first. The GPU lags
+    // NUM_GPU_PROFILE_FRAMES frames behind until Finish.
+    void Report(FILE* f) const;
+
+    // Name of the calling thread in the trace, "thread N" by default
+    void SetThreadName(const string& Name);
+
+    // Rings allocated so far, at most one per thread alive at a time plus
+    // those of exited threads not drained yet
+    uint NumThreadRings() const;
+
+    void Record(const char* pName, uint64_t Begin, uint64_t End);
+
+    void BeginGpuScope(const char* pName);
+
+    void EndGpuScope();
+
+    static uint64_t Now();
+
+private:
+    // Per frame sums of one scope, indexed by frame % PROFILE_WINDOW
+    struct ScopeStats
+    {
+        double Ms[PROFILE_WINDOW];
+        uint Calls[PROFILE_WINDOW];
+    };
+
+    struct TraceEvent
+    {
+        ProfileEvent Event;
+        int Thread;             // -1 for the GPU
+    };
+
+    struct GpuFrame
+    {
+        GLuint Queries[2 * MAX_GPU_SCOPES];   // begin and end timestamp of every scope
+        const char* Names[MAX_GPU_SCOPES];
+        uint NumScopes;
+    };
+
+    friend struct ThreadRingOwner;
+
+    // Never destroyed, so that threads outliving the other statics can
+    // still hand back their rings
+    Profiler();
+
+    ProfileRing* ThreadRing();
+    void ReleaseRing(ProfileRing* pRing);
+    void AddEvent(unordered_map<const char*, ScopeStats>& Stats, const ProfileEvent& Event, int Thread);
+    void CollectGpuFrame(GpuFrame& Frame);
+    static void ReportStats(FILE* f, const char* pKind, const unordered_map<const char*, ScopeStats>& Stats, uint NumFrames);
+
+    atomic<bool> m_Enabled;
+    mutable mutex m_RingsMutex;
+    vector<unique_ptr<ProfileRing> > m_Rings;
+    vector<ProfileRing*> m_FreeRings;
+    vector<string> m_ThreadNames;   // of every thread that recorded, by ThreadIndex
+    uint64_t m_Origin;              // start of the trace timeline
+    uint m_Frame;
+    unordered_map<const char*, ScopeStats> m_CpuStats;
+    unordered_map<const char*, ScopeStats> m_GpuStats;
+    vector<TraceEvent> m_Trace;
+    size_t m_MaxTraceEvents;
+    bool m_Gpu;
+    int64_t m_GpuOffset;            // steady clock minus GPU timestamp, in nanoseconds
+    uint m_GpuFrame;                // next frame whose GPU results are collected
+    GpuFrame m_GpuFrames[NUM_GPU_PROFILE_FRAMES];
+    vector<uint> m_GpuStack;        // open GPU scopes, ~0 for the ones not measured
+};
+
+// Times the enclosing block on the calling thread
+class ProfileScope
+{
+public:
+    explicit ProfileScope(const char* pName)
+    {
+        m_pName = Profiler::Get().Enabled() ? pName : NULL;
+        m_Begin = m_pName ? Profiler::Now() : 0;
+    }
+
+    ~ProfileScope()
+    {
+        if (m_pName) {
+            Profiler::Get().Record(m_pName, m_Begin, Profiler::Now());
+        }
+    }
+
+private:
+    const char* m_pName;
+    uint64_t m_Begin;
+};
+
+// Times the GL commands of the enclosing block on the GPU
+class GpuProfileScope
+{
+public:
+    explicit GpuProfileScope(const char* pName)
+    {
+        Profiler::Get().BeginGpuScope(pName);
+    }
+
+    ~GpuProfileScope()
+    {
+        Profiler::Get().EndGpuScope();
+    }
+};
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+
+#define PROFILE_SCOPE(Name) ProfileScope PROFILE_CONCAT(ProfileScope, __LINE__)(Name)
+#define GPU_PROFILE_SCOPE(Name) GpuProfileScope PROFILE_CONCAT(GpuProfileScope, __LINE__)(Name)
+
+#endif	/* PROFILER_H */
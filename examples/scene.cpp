@@ -17,20 +17,38 @@
 */
 
 #include <assert.h>
+#include <stddef.h>
 
 #include "scene.h"
+#include "mesh_cache.h"
+#include "mesh_optimizer.h"
+#include "mesh_simplifier.h"
+#include "profiler.h"
+
+#include <glm/gtc/packing.hpp>
 
 #define POSITION_LOCATION    0
 //#define TEX_COORD_LOCATION   1
 #define NORMAL_LOCATION      1
 #define BONE_ID_LOCATION     2
 #define BONE_WEIGHT_LOCATION 3
+#define INSTANCE_WORLD_LOCATION   4    // three rows, locations 4 to 6
+#define INSTANCE_PALETTE_LOCATION 7
 
 #define ARRAY_SIZE_IN_ELEMENTS(a) (sizeof(a)/sizeof(a[0]))
 #define SNPRINTF snprintf
 #define GLCheckError() (glGetError() == GL_NO_ERROR)
 
-void Scene::VertexBoneData::AddBoneData(uint BoneID, float Weight)
+// Below this many vertices InitFromScene flattens the meshes on the
+// calling thread even with an import pool
+#define PARALLEL_IMPORT_VERTICES 32768
+
+// Levels of detail stop when simplifying can't get below this fraction of
+// the previous level's triangles within LOD_MAX_ERROR of the entry's radius
+#define LOD_MIN_REDUCTION 0.8f
+#define LOD_MAX_ERROR     0.05f
+
+void VertexBoneData::AddBoneData(uint BoneID, float Weight)
 {
     for (uint i = 0 ; i < ARRAY_SIZE_IN_ELEMENTS(IDs) ; i++) {
         if (Weights[i] == 0.0) {
@@ -44,461 +62,1857 @@ void Scene::VertexBoneData::AddBoneData(uint BoneID, float Weight)
     //assert(0);
 }
 
-Scene::Scene()
+uint SkinningVariantInfluences(SkinningVariant Variant)
 {
-    m_VAO = 0;
-    ZERO_MEM(m_Buffers);
-    m_NumBones = 0;
-    m_pScene = NULL;
+    static const uint Influences[NUM_SKINNING_VARIANTS] = { 0, 1, 2, 4 };
+    return Influences[Variant];
 }
 
 
-Scene::~Scene()
+// The cheapest variant that blends the first NumInfluences bones
+static SkinningVariant VariantForInfluences(uint NumInfluences)
 {
-    Clear();
+    uint Variant = SKINNING_RIGID;
+
+    while (SkinningVariantInfluences((SkinningVariant)Variant) < NumInfluences) {
+        Variant++;
+    }
+
+    return (SkinningVariant)Variant;
 }
 
 
-void Scene::Clear()
+static void PackVertices(const SkinnedVertex* pVertices, uint NumVertices, vector<PackedSkinnedVertex>& Packed)
 {
+    Packed.resize(NumVertices);
+
+    for (uint i = 0 ; i < NumVertices ; i++) {
+        const SkinnedVertex& v = pVertices[i];
+        PackedSkinnedVertex& p = Packed[i];
+
+        p.Position    = v.Position;
+        p.Normal      = glm::packSnorm3x10_1x2(glm::vec4(v.Normal.x, v.Normal.y, v.Normal.z, 0.0f));
+        p.TexCoord[0] = glm::packHalf1x16(v.TexCoord.x);
+        p.TexCoord[1] = glm::packHalf1x16(v.TexCoord.y);
+
+        // Round each weight, then give the rounding error to the largest one
+        // so the quantized weights keep the original sum
+        float Sum = 0.0f;
+        int QuantizedSum = 0;
+        uint Largest = 0;
+
+        for (uint j = 0 ; j < NUM_BONES_PER_VEREX ; j++) {
+            p.BoneIDs[j] = v.Bones.IDs[j];
+            p.Weights[j] = glm::packUnorm1x16(v.Bones.Weights[j]);
+            Sum += v.Bones.Weights[j];
+            QuantizedSum += p.Weights[j];
+
+            if (p.Weights[j] > p.Weights[Largest]) {
+                Largest = j;
+            }
+        }
 
-    if (m_Buffers[0] != 0) {
-        glDeleteBuffers(ARRAY_SIZE_IN_ELEMENTS(m_Buffers), m_Buffers);
-    }
-       
-    if (m_VAO != 0) {
-        glDeleteVertexArrays(1, &m_VAO);
-        m_VAO = 0;
+        const int Target = (int)glm::round(glm::clamp(Sum, 0.0f, 1.0f) * 65535.0f);
+        p.Weights[Largest] = glm::clamp(p.Weights[Largest] + Target - QuantizedSum, 0, 65535);
     }
 }
 
 
-bool Scene::LoadMesh(const string& Filename)
+// Sphere around the box of the vertices
+static void InitBounds(const SkinnedVertex* pVertices, uint NumVertices, MeshEntry& Entry)
 {
-    // Release the previously loaded mesh (if it exists)
-    Clear();
- 
-    // Create the VAO
-    glGenVertexArrays(1, &m_VAO);   
-    glBindVertexArray(m_VAO);
-    
-    // Create the buffers for the vertices attributes
-    glGenBuffers(ARRAY_SIZE_IN_ELEMENTS(m_Buffers), m_Buffers);
+    aiVector3D Min(1e30f), Max(-1e30f);
 
-    bool Ret = false;    
-  
-    m_pScene = m_Importer.ReadFile(Filename.c_str(), aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs);
-    
-    if (m_pScene) {  
-        //m_GlobalInverseTransform = m_pScene->mRootNode->mTransformation;
-        //m_GlobalInverseTransform.Inverse();
-        Ret = InitFromScene(m_pScene, Filename);
-    }
-    else {
-        printf("Error parsing '%s': '%s'\n", Filename.c_str(), m_Importer.GetErrorString());
+    for (uint i = 0 ; i < NumVertices ; i++) {
+        for (uint k = 0 ; k < 3 ; k++) {
+            Min[k] = min(Min[k], pVertices[i].Position[k]);
+            Max[k] = max(Max[k], pVertices[i].Position[k]);
+        }
     }
 
-    // Make sure the VAO is not changed from the outside
-    glBindVertexArray(0);   
-    return Ret;
+    Entry.Center = NumVertices ? 0.5f * (Min + Max) : aiVector3D(0.0f, 0.0f, 0.0f);
+    Entry.Radius = 0.0f;
+
+    for (uint i = 0 ; i < NumVertices ; i++) {
+        Entry.Radius = max(Entry.Radius, (pVertices[i].Position - Entry.Center).Length());
+    }
 }
 
 
-bool Scene::InitFromScene(const aiScene* pScene, const string& Filename)
-{  
-    m_Entries.resize(pScene->mNumMeshes);
+// Simplifies the full mesh of Entry for every further level, halving the
+// triangles each time, and appends the indices of the levels to Lods
+static void InitMeshLods(const SkinnedVertex* pVertices, uint NumVertices, const uint* pIndices, uint NumLods, bool Optimize,
+                         MeshEntry& Entry, vector<uint>& Lods)
+{
+    vector<uint> Simplified(Entry.NumIndices);
 
-    vector<aiVector3D> Positions;
-    vector<aiVector3D> Normals;
-    vector<aiVector2D> TexCoords;
-    vector<VertexBoneData> Bones;
-    vector<uint> Indices;
-       
-    uint NumVertices = 0;
-    uint NumIndices = 0;
-    
-    // Count the number of vertices and indices
-    for (uint i = 0 ; i < m_Entries.size() ; i++) {
-        m_Entries[i].MaterialIndex = pScene->mMeshes[i]->mMaterialIndex;        
-        m_Entries[i].NumIndices    = pScene->mMeshes[i]->mNumFaces * 3;
-        m_Entries[i].BaseVertex    = NumVertices;
-        m_Entries[i].BaseIndex     = NumIndices;
-        
-        NumVertices += pScene->mMeshes[i]->mNumVertices;
-        NumIndices  += m_Entries[i].NumIndices;
+    for (uint l = 1 ; l < NumLods ; l++) {
+        const uint Previous = Entry.Lods[l - 1].NumIndices;
+        const uint Target = Entry.NumIndices >> l;
+        float Error = 0.0f;
+        const uint Count = SimplifyMesh(pVertices, NumVertices, pIndices, Entry.NumIndices, Target - Target % 3,
+                                        LOD_MAX_ERROR * Entry.Radius, &Simplified[0], &Error);
+
+        if (Count == 0 || Count > Previous * LOD_MIN_REDUCTION) {
+            break;
+        }
+
+        if (Optimize) {
+            OptimizeVertexCache(&Simplified[0], Count, NumVertices);
+        }
+
+        Entry.Lods[l].NumIndices = Count;
+        Entry.Lods[l].Error = Error;
+        Entry.NumLods = l + 1;
+        Lods.insert(Lods.end(), Simplified.begin(), Simplified.begin() + Count);
     }
-    
-    // Reserve space in the vectors for the vertex attributes and indices
-    Positions.reserve(NumVertices);
-    Normals.reserve(NumVertices);
-    TexCoords.reserve(NumVertices);
-    Bones.resize(NumVertices);
-    Indices.reserve(NumIndices);
-        
-    // Initialize the meshes in the scene one by one
-    for (uint i = 0 ; i < m_Entries.size() ; i++) {
-        const aiMesh* paiMesh = pScene->mMeshes[i];
-        InitMesh(i, paiMesh, Positions, Normals, TexCoords, Bones, Indices);
+}
+
+
+// Boxes of the vertices of every entry per bone in bone space and, for the
+// vertices not moved by any bone, in mesh space. A skinned vertex is a
+// blend of its bones' transforms of it, so with weights adding up to one
+// it stays within the skinned boxes of its bones.
+static void InitBoneBounds(const SkinnedVertex* pVertices, uint NumVertices, MeshData& Data)
+{
+    const uint NumBones = Data.BoneOffsets.size();
+    vector<int> BoneNodes(NumBones, -1);
+
+    for (uint n = 0 ; n < Data.Skel.NumNodes() ; n++) {
+        if (Data.Skel.BoneIndices[n] >= 0) {
+            BoneNodes[Data.Skel.BoneIndices[n]] = n;
+        }
     }
 
-    //if (!InitMaterials(pScene, Filename)) {
-    //    return false;
-    //}
+    // One box per bone, the last one for the unskinned vertices
+    vector<BoundingBox> Boxes(NumBones + 1);
 
-    // Generate and populate the buffers with vertex attributes and the indices
-    glBindBuffer(GL_ARRAY_BUFFER, m_Buffers[POS_VB]);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(Positions[0]) * Positions.size(), &Positions[0], GL_STATIC_DRAW);
-    glEnableVertexAttribArray(POSITION_LOCATION);
-    glVertexAttribPointer(POSITION_LOCATION, 3, GL_FLOAT, GL_FALSE, 0, 0);    
+    Data.EntryBounds.clear();
+    Data.EntryBoundsFirst.assign(1, 0);
 
- //    glBindBuffer(GL_ARRAY_BUFFER, m_Buffers[TEXCOORD_VB]);
-    // glBufferData(GL_ARRAY_BUFFER, sizeof(TexCoords[0]) * TexCoords.size(), &TexCoords[0], GL_STATIC_DRAW);
- //    glEnableVertexAttribArray(TEX_COORD_LOCATION);
- //    glVertexAttribPointer(TEX_COORD_LOCATION, 2, GL_FLOAT, GL_FALSE, 0, 0);
+    for (uint i = 0 ; i < Data.Entries.size() ; i++) {
+        const MeshEntry& Entry = Data.Entries[i];
+        const uint End = i + 1 < Data.Entries.size() ? Data.Entries[i + 1].BaseVertex : NumVertices;
 
-    glBindBuffer(GL_ARRAY_BUFFER, m_Buffers[NORMAL_VB]);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(Normals[0]) * Normals.size(), &Normals[0], GL_STATIC_DRAW);
-    glEnableVertexAttribArray(NORMAL_LOCATION);
-    glVertexAttribPointer(NORMAL_LOCATION, 3, GL_FLOAT, GL_FALSE, 0, 0);
+        fill(Boxes.begin(), Boxes.end(), BoundingBox());
 
-    glBindBuffer(GL_ARRAY_BUFFER, m_Buffers[BONE_VB]);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(Bones[0]) * Bones.size(), &Bones[0], GL_STATIC_DRAW);
-    glEnableVertexAttribArray(BONE_ID_LOCATION);
-    glVertexAttribIPointer(BONE_ID_LOCATION, 4, GL_INT, sizeof(VertexBoneData), (const GLvoid*)0);
-    glEnableVertexAttribArray(BONE_WEIGHT_LOCATION);    
-    glVertexAttribPointer(BONE_WEIGHT_LOCATION, 4, GL_FLOAT, GL_FALSE, sizeof(VertexBoneData), (const GLvoid*)16);
-    
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_Buffers[INDEX_BUFFER]);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(Indices[0]) * Indices.size(), &Indices[0], GL_STATIC_DRAW);
-     
+        for (uint v = Entry.BaseVertex ; v < End ; v++) {
+            const SkinnedVertex& Vertex = pVertices[v];
+            const glm::vec4 Position(Vertex.Position.x, Vertex.Position.y, Vertex.Position.z, 1.0f);
+            bool Skinned = false;
 
-    return GLCheckError();
-}
+            for (uint j = 0 ; j < NUM_BONES_PER_VEREX && Entry.Variant != SKINNING_RIGID ; j++) {
+                const uint Bone = Vertex.Bones.IDs[j];
 
+                if (Vertex.Bones.Weights[j] > 0.0f && Bone < NumBones) {
+                    const AffineMatrix& Offset = Data.BoneOffsets[Bone];
+                    Boxes[Bone].Add(aiVector3D(glm::dot(Offset.Row(0), Position), glm::dot(Offset.Row(1), Position),
+                                               glm::dot(Offset.Row(2), Position)));
+                    Skinned = true;
+                }
+            }
 
-void Scene::InitMesh(uint MeshIndex,
-                    const aiMesh* paiMesh,
-                    vector<aiVector3D>& Positions,
-                    vector<aiVector3D>& Normals,
-                    vector<aiVector2D>& TexCoords,
-                    vector<VertexBoneData>& Bones,
-                    vector<uint>& Indices)
-{    
-    const aiVector3D Zero3D(0.0f, 0.0f, 0.0f);
-    
-    // Populate the vertex attribute vectors
-    for (uint i = 0 ; i < paiMesh->mNumVertices ; i++) {
-        const aiVector3D* pPos      = &(paiMesh->mVertices[i]);
-        const aiVector3D* pNormal   = &(paiMesh->mNormals[i]);
-        const aiVector3D* pTexCoord = paiMesh->HasTextureCoords(0) ? &(paiMesh->mTextureCoords[0][i]) : &Zero3D;
+            // Skinning without weights leaves the vertex at the origin
+            if (!Skinned) {
+                Boxes[NumBones].Add(Entry.Variant == SKINNING_RIGID ? Vertex.Position : aiVector3D(0.0f, 0.0f, 0.0f));
+            }
+        }
 
-        Positions.push_back(aiVector3D(pPos->x, pPos->y, pPos->z));
-        Normals.push_back(aiVector3D(pNormal->x, pNormal->y, pNormal->z));
-        TexCoords.push_back(aiVector2D(pTexCoord->x, pTexCoord->y));        
-    }
-    
-    LoadBones(MeshIndex, paiMesh, Bones);
-    
-    // Populate the index buffer
-    for (uint i = 0 ; i < paiMesh->mNumFaces ; i++) {
-        const aiFace& Face = paiMesh->mFaces[i];
-        assert(Face.mNumIndices == 3);
-        Indices.push_back(Face.mIndices[0]);
-        Indices.push_back(Face.mIndices[1]);
-        Indices.push_back(Face.mIndices[2]);
+        for (uint b = 0 ; b <= NumBones ; b++) {
+            if (!Boxes[b].Empty() && (b == NumBones || BoneNodes[b] >= 0)) {
+                BoneBounds Bounds;
+                Bounds.Node   = b < NumBones ? BoneNodes[b] : -1;
+                Bounds.Bounds = Boxes[b];
+                Data.EntryBounds.push_back(Bounds);
+            }
+        }
+
+        Data.EntryBoundsFirst.push_back(Data.EntryBounds.size());
     }
 }
 
 
-void Scene::LoadBones(uint MeshIndex, const aiMesh* pMesh, vector<VertexBoneData>& Bones)
+Scene::Scene()
 {
-    for (uint i = 0 ; i < pMesh->mNumBones ; i++) {                
-        uint BoneIndex = 0;        
-        string BoneName(pMesh->mBones[i]->mName.data);
-        
-        if (m_BoneMapping.find(BoneName) == m_BoneMapping.end()) {
-            // Allocate an index for a new bone
-            BoneIndex = m_NumBones;
-            m_NumBones++;            
-	        BoneInfo bi;			
-			m_BoneInfo.push_back(bi);
-            m_BoneInfo[BoneIndex].BoneOffset = pMesh->mBones[i]->mOffsetMatrix;            
-            m_BoneMapping[BoneName] = BoneIndex;
-        }
-        else {
-            BoneIndex = m_BoneMapping[BoneName];
-        }                      
-        
-        for (uint j = 0 ; j < pMesh->mBones[i]->mNumWeights ; j++) {
-            uint VertexID = m_Entries[MeshIndex].BaseVertex + pMesh->mBones[i]->mWeights[j].mVertexId;
-            float Weight  = pMesh->mBones[i]->mWeights[j].mWeight;                   
-            Bones[VertexID].AddBoneData(BoneIndex, Weight);
-        }
-    }    
+    m_VAO = 0;
+    ZERO_MEM(m_Buffers);
+    m_IndexOffset = 0;
+    m_MaxInstances = 0;
+    m_UseMultiDrawIndirect = true;
+    m_MultiDrawIndirect = false;
+    m_PackVertices = false;
+    m_OptimizeMeshes = false;
+    m_MeshLods = 1;
+    m_pImportPool = NULL;
+    m_PackedVertices = false;
+    m_KeepVertices = false;
+    m_UploadOffset = 0;
+    m_NumBones = 0;
+    ZERO_MEM(m_VariantFirst);
+    ZERO_MEM(m_VariantPrograms);
+    m_NumLods = 1;
+    ZERO_MEM(m_LodErrors);
+    m_BoundRadius = 0.0f;
+    m_LodPixelsPerUnit = 0.0f;
+    m_LodMaxPixelError = 1.0f;
+    ZERO_MEM(m_LodInstances);
+    ZERO_MEM(m_IndirectLodInstances);
+    m_Cull = false;
+    m_VisibleInstanceCount = 0;
 }
 
 
-/*bool Scene::InitMaterials(const aiScene* pScene, const string& Filename)
+Scene::~Scene()
 {
-    // Extract the directory part from the file name
-    string::size_type SlashIndex = Filename.find_last_of("/");
-    string Dir;
+    Clear();
+}
 
-    if (SlashIndex == string::npos) {
-        Dir = ".";
-    }
-    else if (SlashIndex == 0) {
-        Dir = "/";
+
+void Scene::Clear()
+{
+
+    if (m_Buffers[0] != 0) {
+        glDeleteBuffers(ARRAY_SIZE_IN_ELEMENTS(m_Buffers), m_Buffers);
+        ZERO_MEM(m_Buffers);
     }
-    else {
-        Dir = Filename.substr(0, SlashIndex);
+
+    m_MaxInstances = 0;
+    m_MultiDrawIndirect = false;
+    m_IndirectCommands.clear();
+    m_DrawOrder.clear();
+    ZERO_MEM(m_VariantFirst);
+    m_NumLods = 1;
+    ZERO_MEM(m_LodInstances);
+    m_SortedInstances.clear();
+    m_EntryVisible.clear();
+    m_IndirectEntryVisible.clear();
+    m_VisibleInstanceCount = 0;
+    m_Vertices.clear();
+    m_UploadBuffer.clear();
+    m_UploadOffset = 0;
+       
+    if (m_VAO != 0) {
+        glDeleteVertexArrays(1, &m_VAO);
+        m_VAO = 0;
     }
+}
 
-    bool Ret = true;
 
-    // Initialize the materials
-    for (uint i = 0 ; i < pScene->mNumMaterials ; i++) {
-        const aiMaterial* pMaterial = pScene->mMaterials[i];
+// Anything that changes what the import produces must change the cache key
+#define ASSIMP_LOAD_FLAGS (aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs)
 
+uint64_t Scene::CacheSeed() const
+{
+    return ((uint64_t)MESH_CACHE_VERSION << 32) | ((uint64_t)m_OptimizeMeshes << 48) | ((uint64_t)m_MeshLods << 52) |
+           ASSIMP_LOAD_FLAGS;
+}
 
-        if (pMaterial->GetTextureCount(aiTextureType_DIFFUSE) > 0) {
-            aiString Path;
 
-            if (pMaterial->GetTexture(aiTextureType_DIFFUSE, 0, &Path, NULL, NULL, NULL, NULL, NULL) == AI_SUCCESS) {
-                string p(Path.data);
-                
-                if (p.substr(0, 2) == ".\\") {                    
-                    p = p.substr(2, p.size() - 2);
-                }
-                               
-                string FullPath = Dir + "/" + p;
-                    
-                m_Textures[i] = new Texture(GL_TEXTURE_2D, FullPath.c_str());
+bool Scene::LoadMesh(const string& Filename, const string& CacheFilename)
+{
+    // Release the previously loaded mesh (if it exists)
+    Clear();
 
-                if (!m_Textures[i]->Load()) {
-                    printf("Error loading texture '%s'\n", FullPath.c_str());
-                    delete m_Textures[i];
-                    m_Textures[i] = NULL;
-                    Ret = false;
-                }
-                else {
-                    printf("%d - loaded texture '%s'\n", i, FullPath.c_str());
-                }
-            }
+    MeshData Data;
+    uint64_t SourceHash = 0;
+
+    if (!CacheFilename.empty()) {
+        SourceHash = HashFile(Filename, CacheSeed());
+
+        MeshCacheFile Cache;
+
+        if (SourceHash != 0 && Cache.Open(CacheFilename, SourceHash, Data)) {
+            return InitFromData(Data, Cache.Vertices(), Cache.NumVertices(), Cache.Indices(), Cache.NumIndices());
         }
     }
 
-    return Ret;
-}*/
+    if (!ImportScene(Filename, CacheFilename, SourceHash, Data)) {
+        return false;
+    }
+
+    return InitFromData(Data, Data.Vertices.empty() ? NULL : &Data.Vertices[0], Data.Vertices.size(),
+                        Data.Indices.empty() ? NULL : &Data.Indices[0], Data.Indices.size());
+}
 
 
-void Scene::Render()
+// Imports with Assimp and writes the cache when SourceHash is set
+bool Scene::ImportScene(const string& Filename, const string& CacheFilename, uint64_t SourceHash, MeshData& Data) const
 {
-    glBindVertexArray(m_VAO);
-    
-    for (uint i = 0 ; i < m_Entries.size() ; i++) {
-        const uint MaterialIndex = m_Entries[i].MaterialIndex;
+    Assimp::Importer Importer;
+    const aiScene* pScene = Importer.ReadFile(Filename.c_str(), ASSIMP_LOAD_FLAGS);
 
-        //assert(MaterialIndex < m_Textures.size());
-        
-        //if (m_Textures[MaterialIndex]) {
-        //    m_Textures[MaterialIndex]->Bind(GL_TEXTURE0);
-        //}
+    if (!pScene) {
+        printf("Error parsing '%s': '%s'\n", Filename.c_str(), Importer.GetErrorString());
+        return false;
+    }
+
+    //m_GlobalInverseTransform = pScene->mRootNode->mTransformation;
+    //m_GlobalInverseTransform.Inverse();
+    InitFromScene(pScene, Data);
 
-		glDrawElementsBaseVertex(GL_TRIANGLES, 
-                                 m_Entries[i].NumIndices, 
-                                 GL_UNSIGNED_INT, 
-                                 (void*)(sizeof(uint) * m_Entries[i].BaseIndex), 
-                                 m_Entries[i].BaseVertex);
+    if (SourceHash != 0 && !WriteMeshCache(CacheFilename, SourceHash, Data)) {
+        printf("Warning: unable to write mesh cache '%s'\n", CacheFilename.c_str());
     }
 
-    // Make sure the VAO is not changed from the outside    
-    glBindVertexArray(0);
+    return true;
 }
 
 
-uint Scene::FindPosition(float AnimationTime, const aiNodeAnim* pNodeAnim)
-{    
-    for (uint i = 0 ; i < pNodeAnim->mNumPositionKeys - 1 ; i++) {
-        if (AnimationTime < (float)pNodeAnim->mPositionKeys[i + 1].mTime) {
-            return i;
+bool Scene::ImportMesh(const string& Filename, const string& CacheFilename, ImportedMesh& Mesh) const
+{
+    MeshData& Data = Mesh.Data;
+    Data = MeshData();
+
+    const SkinnedVertex* pVertices = NULL;
+    const uint* pIndices = NULL;
+    uint NumVertices = 0, NumIndices = 0;
+    uint64_t SourceHash = 0;
+    bool FromCache = false;
+    MeshCacheFile Cache;
+
+    if (!CacheFilename.empty()) {
+        SourceHash = HashFile(Filename, CacheSeed());
+    }
+
+    if (SourceHash != 0 && Cache.Open(CacheFilename, SourceHash, Data)) {
+        FromCache   = true;
+        pVertices   = Cache.Vertices();
+        NumVertices = Cache.NumVertices();
+        pIndices    = Cache.Indices();
+        NumIndices  = Cache.NumIndices();
+    }
+    else {
+        if (!ImportScene(Filename, CacheFilename, SourceHash, Data)) {
+            return false;
         }
+
+        pVertices   = Data.Vertices.empty() ? NULL : &Data.Vertices[0];
+        NumVertices = Data.Vertices.size();
+        pIndices    = Data.Indices.empty() ? NULL : &Data.Indices[0];
+        NumIndices  = Data.Indices.size();
     }
-    
-    assert(0);
 
-    return 0;
-}
+    // The same layout as InitFromData uploads
+    Mesh.Packed = m_PackVertices && Data.BoneOffsets.size() <= MAX_PACKED_BONES;
 
+    vector<PackedSkinnedVertex> PackedVertices;
 
-uint Scene::FindRotation(float AnimationTime, const aiNodeAnim* pNodeAnim)
-{
-    assert(pNodeAnim->mNumRotationKeys > 0);
+    if (Mesh.Packed) {
+        PackVertices(pVertices, NumVertices, PackedVertices);
+    }
 
-    for (uint i = 0 ; i < pNodeAnim->mNumRotationKeys - 1 ; i++) {
-        if (AnimationTime < (float)pNodeAnim->mRotationKeys[i + 1].mTime) {
-            return i;
-        }
+    Mesh.VertexSize = Mesh.Packed ? sizeof(PackedSkinnedVertex) * NumVertices : sizeof(SkinnedVertex) * NumVertices;
+    Mesh.Buffer.resize(Mesh.VertexSize + sizeof(uint) * NumIndices);
+
+    if (NumVertices > 0) {
+        memcpy(&Mesh.Buffer[0], Mesh.Packed ? (const void*)&PackedVertices[0] : (const void*)pVertices, Mesh.VertexSize);
     }
-    
-    assert(0);
 
-    return 0;
-}
+    if (NumIndices > 0) {
+        memcpy(&Mesh.Buffer[Mesh.VertexSize], pIndices, sizeof(uint) * NumIndices);
+    }
 
+    InitBoneBounds(pVertices, NumVertices, Data);
 
-uint Scene::FindScaling(float AnimationTime, const aiNodeAnim* pNodeAnim)
-{
-    assert(pNodeAnim->mNumScalingKeys > 0);
-    
-    for (uint i = 0 ; i < pNodeAnim->mNumScalingKeys - 1 ; i++) {
-        if (AnimationTime < (float)pNodeAnim->mScalingKeys[i + 1].mTime) {
-            return i;
-        }
+    // Imported vertices are in Data already, cached ones only in the mapping
+    if (!m_KeepVertices) {
+        vector<SkinnedVertex>().swap(Data.Vertices);
     }
-    
-    assert(0);
+    else if (FromCache) {
+        Data.Vertices.assign(pVertices, pVertices + NumVertices);
+    }
+    vector<uint>().swap(Data.Indices);
 
-    return 0;
+    return true;
 }
 
 
-void Scene::CalcInterpolatedPosition(aiVector3D& Out, float AnimationTime, const aiNodeAnim* pNodeAnim)
+bool Scene::BeginUpload(ImportedMesh& Mesh)
 {
-    if (pNodeAnim->mNumPositionKeys == 1) {
-        Out = pNodeAnim->mPositionKeys[0].mValue;
-        return;
+    Clear();
+
+    InitSkeleton(Mesh.Data);
+
+    if (m_KeepVertices) {
+        m_Vertices.swap(Mesh.Data.Vertices);
     }
-            
-    uint PositionIndex = FindPosition(AnimationTime, pNodeAnim);
-    uint NextPositionIndex = (PositionIndex + 1);
-    assert(NextPositionIndex < pNodeAnim->mNumPositionKeys);
-    float DeltaTime = (float)(pNodeAnim->mPositionKeys[NextPositionIndex].mTime - pNodeAnim->mPositionKeys[PositionIndex].mTime);
-    float Factor = (AnimationTime - (float)pNodeAnim->mPositionKeys[PositionIndex].mTime) / DeltaTime;
-    assert(Factor >= 0.0f && Factor <= 1.0f);
-    const aiVector3D& Start = pNodeAnim->mPositionKeys[PositionIndex].mValue;
-    const aiVector3D& End = pNodeAnim->mPositionKeys[NextPositionIndex].mValue;
-    aiVector3D Delta = End - Start;
-    Out = Start + Factor * Delta;
+
+    m_PackedVertices = Mesh.Packed;
+    m_UploadBuffer.swap(Mesh.Buffer);
+    m_UploadOffset = 0;
+    Mesh.Buffer.clear();
+
+    // Storage only, the contents follow in ContinueUpload
+    InitMeshBuffer(Mesh.VertexSize, m_UploadBuffer.size() - Mesh.VertexSize, NULL);
+
+    return GLCheckError();
 }
 
 
-void Scene::CalcInterpolatedRotation(aiQuaternion& Out, float AnimationTime, const aiNodeAnim* pNodeAnim)
+bool Scene::ContinueUpload(size_t& Budget)
 {
-	// we need at least two values to interpolate...
-    if (pNodeAnim->mNumRotationKeys == 1) {
-        Out = pNodeAnim->mRotationKeys[0].mValue;
-        return;
+    if (!Uploading()) {
+        return true;
     }
-    
-    uint RotationIndex = FindRotation(AnimationTime, pNodeAnim);
-    uint NextRotationIndex = (RotationIndex + 1);
-    assert(NextRotationIndex < pNodeAnim->mNumRotationKeys);
-    float DeltaTime = (float)(pNodeAnim->mRotationKeys[NextRotationIndex].mTime - pNodeAnim->mRotationKeys[RotationIndex].mTime);
-    float Factor = (AnimationTime - (float)pNodeAnim->mRotationKeys[RotationIndex].mTime) / DeltaTime;
-    assert(Factor >= 0.0f && Factor <= 1.0f);
-    const aiQuaternion& StartRotationQ = pNodeAnim->mRotationKeys[RotationIndex].mValue;
-    const aiQuaternion& EndRotationQ   = pNodeAnim->mRotationKeys[NextRotationIndex].mValue;    
-    aiQuaternion::Interpolate(Out, StartRotationQ, EndRotationQ, Factor);
-    Out = Out.Normalize();
-}
 
+    const size_t Size = min(Budget, m_UploadBuffer.size() - m_UploadOffset);
 
-void Scene::CalcInterpolatedScaling(aiVector3D& Out, float AnimationTime, const aiNodeAnim* pNodeAnim)
-{
-    if (pNodeAnim->mNumScalingKeys == 1) {
-        Out = pNodeAnim->mScalingKeys[0].mValue;
-        return;
+    if (Size > 0) {
+        glBindBuffer(GL_ARRAY_BUFFER, m_Buffers[MESH_BUFFER]);
+        glBufferSubData(GL_ARRAY_BUFFER, m_UploadOffset, Size, &m_UploadBuffer[m_UploadOffset]);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        m_UploadOffset += Size;
+        Budget -= Size;
     }
 
-    uint ScalingIndex = FindScaling(AnimationTime, pNodeAnim);
-    uint NextScalingIndex = (ScalingIndex + 1);
-    assert(NextScalingIndex < pNodeAnim->mNumScalingKeys);
-    float DeltaTime = (float)(pNodeAnim->mScalingKeys[NextScalingIndex].mTime - pNodeAnim->mScalingKeys[ScalingIndex].mTime);
-    float Factor = (AnimationTime - (float)pNodeAnim->mScalingKeys[ScalingIndex].mTime) / DeltaTime;
-    assert(Factor >= 0.0f && Factor <= 1.0f);
-    const aiVector3D& Start = pNodeAnim->mScalingKeys[ScalingIndex].mValue;
-    const aiVector3D& End   = pNodeAnim->mScalingKeys[NextScalingIndex].mValue;
-    aiVector3D Delta = End - Start;
-    Out = Start + Factor * Delta;
+    if (Uploading()) {
+        return false;
+    }
+
+    vector<char>().swap(m_UploadBuffer);
+    m_UploadOffset = 0;
+
+    return true;
 }
 
 
-void Scene::ReadNodeHeirarchy(float AnimationTime, const aiNode* pNode, const aiMatrix4x4& ParentTransform)
-{    
-    string NodeName(pNode->mName.data);
-    
-    const aiAnimation* pAnimation = m_pScene->mAnimations[0];
-        
-    aiMatrix4x4 NodeTransformation(pNode->mTransformation);
-     
-    const aiNodeAnim* pNodeAnim = FindNodeAnim(pAnimation, NodeName);
+void Scene::InitFromScene(const aiScene* pScene, MeshData& Data) const
+{  
+    Data.Entries.resize(pScene->mNumMeshes);
+
+    uint NumVertices = 0;
+    uint NumIndices = 0;
     
-    if (pNodeAnim) {
-        // Interpolate scaling and generate scaling transformation matrix
-        aiVector3D Scaling;
-        CalcInterpolatedScaling(Scaling, AnimationTime, pNodeAnim);
-        aiMatrix4x4 ScalingM;
-        //ScalingM.InitScaleTransform(Scaling.x, Scaling.y, Scaling.z);
-        ScalingM.Scaling(Scaling, ScalingM);//???
-
-        // Interpolate rotation and generate rotation transformation matrix
-        aiQuaternion RotationQ;
-        CalcInterpolatedRotation(RotationQ, AnimationTime, pNodeAnim); 
-        aiMatrix4x4 RotationM = aiMatrix4x4(RotationQ.GetMatrix());
-
-        // Interpolate translation and generate translation transformation matrix
-        aiVector3D Translation;
-        CalcInterpolatedPosition(Translation, AnimationTime, pNodeAnim);
-        aiMatrix4x4 TranslationM;
-        //TranslationM.InitTranslationTransform(Translation.x, Translation.y, Translation.z);
-        TranslationM.Translation(Translation,TranslationM);//???
+    // Count the number of vertices and indices
+    for (uint i = 0 ; i < Data.Entries.size() ; i++) {
+        Data.Entries[i].MaterialIndex = pScene->mMeshes[i]->mMaterialIndex;        
+        Data.Entries[i].NumIndices    = pScene->mMeshes[i]->mNumFaces * 3;
+        Data.Entries[i].BaseVertex    = NumVertices;
+        Data.Entries[i].BaseIndex     = NumIndices;
+        Data.Entries[i].Lods[0].NumIndices = Data.Entries[i].NumIndices;
+        Data.Entries[i].Lods[0].BaseIndex  = NumIndices;
         
-        // Combine the above transformations
-        NodeTransformation = TranslationM * RotationM * ScalingM;
-    }
-       
-    aiMatrix4x4 GlobalTransformation = ParentTransform * NodeTransformation;
-    
-    if (m_BoneMapping.find(NodeName) != m_BoneMapping.end()) {
-        uint BoneIndex = m_BoneMapping[NodeName];
-        //m_BoneInfo[BoneIndex].FinalTransformation = m_GlobalInverseTransform * GlobalTransformation * m_BoneInfo[BoneIndex].BoneOffset;
-        m_BoneInfo[BoneIndex].FinalTransformation = GlobalTransformation * m_BoneInfo[BoneIndex].BoneOffset;
+        NumVertices += pScene->mMeshes[i]->mNumVertices;
+        NumIndices  += Data.Entries[i].NumIndices;
     }
     
-    for (uint i = 0 ; i < pNode->mNumChildren ; i++) {
-        ReadNodeHeirarchy(AnimationTime, pNode->mChildren[i], GlobalTransformation);
-    }
-}
+    // Every mesh writes its own range of the vectors, so size them up front
+    Data.Vertices.resize(NumVertices);
+    Data.Indices.resize(NumIndices);
 
+    // Bone indices are allocated in the order the bones are first seen,
+    // which has to stay serial. The lookups are done once per mesh bone
+    // here; the weights are scattered below.
+    Data.BoneMapping.clear();
 
-void Scene::BoneTransform(float TimeInSeconds, vector<aiMatrix4x4>& Transforms)
-{
-    aiMatrix4x4 Identity;
-    
-    float TicksPerSecond = (float)(m_pScene->mAnimations[0]->mTicksPerSecond != 0 ? m_pScene->mAnimations[0]->mTicksPerSecond : 25.0f);
-    float TimeInTicks = TimeInSeconds * TicksPerSecond;
-    float AnimationTime = fmod(TimeInTicks, (float)m_pScene->mAnimations[0]->mDuration);
+    vector<uint> BoneIndices;
+    vector<uint> FirstBoneIndex(Data.Entries.size());
 
-    ReadNodeHeirarchy(AnimationTime, m_pScene->mRootNode, Identity);
+    for (uint i = 0 ; i < Data.Entries.size() ; i++) {
+        const aiMesh* paiMesh = pScene->mMeshes[i];
+        FirstBoneIndex[i] = BoneIndices.size();
 
-    Transforms.resize(m_NumBones);
+        for (uint j = 0 ; j < paiMesh->mNumBones ; j++) {
+            const aiBone* pBone = paiMesh->mBones[j];
+            pair<unordered_map<string,uint>::iterator, bool> it =
+                Data.BoneMapping.insert(make_pair(string(pBone->mName.data), (uint)Data.BoneOffsets.size()));
 
-    for (uint i = 0 ; i < m_NumBones ; i++) {
-        Transforms[i] = m_BoneInfo[i].FinalTransformation;
+            if (it.second) {
+                Data.BoneOffsets.push_back(AffineMatrix(pBone->mOffsetMatrix));
+            }
+
+            BoneIndices.push_back(it.first->second);
+        }
     }
-}
 
+    // Initialize the meshes, in parallel when there are enough vertices to
+    // pay for waking the threads up
+    const bool Parallel = m_pImportPool && Data.Entries.size() > 1 && NumVertices >= PARALLEL_IMPORT_VERTICES;
+    vector<uint> MeshVertices(Data.Entries.size());
+    vector<vector<uint> > LodIndices(Data.Entries.size());  // simplified levels of every mesh, one after the other
 
-const aiNodeAnim* Scene::FindNodeAnim(const aiAnimation* pAnimation, const string NodeName)
-{
-    for (uint i = 0 ; i < pAnimation->mNumChannels ; i++) {
-        const aiNodeAnim* pNodeAnim = pAnimation->mChannels[i];
-        
-        if (string(pNodeAnim->mNodeName.data) == NodeName) {
-            return pNodeAnim;
+    auto InitMeshes = [&](uint Begin, uint End) {
+        for (uint i = Begin ; i < End ; i++) {
+            const aiMesh* paiMesh = pScene->mMeshes[i];
+            MeshEntry& Entry = Data.Entries[i];
+            InitMesh(i, paiMesh, BoneIndices.empty() ? NULL : &BoneIndices[FirstBoneIndex[i]], Data);
+
+            MeshVertices[i] = paiMesh->mNumVertices;
+
+            if (m_OptimizeMeshes) {
+                MeshVertices[i] = OptimizeMesh(&Data.Vertices[Entry.BaseVertex], paiMesh->mNumVertices,
+                                               Entry.NumIndices ? &Data.Indices[Entry.BaseIndex] : NULL, Entry.NumIndices);
+            }
+
+            InitBounds(&Data.Vertices[Entry.BaseVertex], MeshVertices[i], Entry);
+
+            if (m_MeshLods > 1 && Entry.NumIndices > 0) {
+                InitMeshLods(&Data.Vertices[Entry.BaseVertex], MeshVertices[i], &Data.Indices[Entry.BaseIndex], m_MeshLods,
+                             m_OptimizeMeshes, Entry, LodIndices[i]);
+            }
         }
+    };
+
+    if (Parallel) {
+        m_pImportPool->ParallelFor(Data.Entries.size(), 1, InitMeshes);
     }
-    
-    return NULL;
-}
\ No newline at end of file
+    else {
+        InitMeshes(0, Data.Entries.size());
+    }
+
+    // The simplified levels follow the full meshes in the index buffer
+    for (uint i = 0 ; i < Data.Entries.size() ; i++) {
+        MeshEntry& Entry = Data.Entries[i];
+        uint Offset = Data.Indices.size();
+
+        for (uint l = 1 ; l < Entry.NumLods ; l++) {
+            Entry.Lods[l].BaseIndex = Offset;
+            Offset += Entry.Lods[l].NumIndices;
+        }
+
+        Data.Indices.insert(Data.Indices.end(), LodIndices[i].begin(), LodIndices[i].end());
+    }
+
+    // Welding leaves gaps behind the vertices of the meshes
+    if (m_OptimizeMeshes) {
+        uint NumKept = 0;
+
+        for (uint i = 0 ; i < Data.Entries.size() ; i++) {
+            copy(Data.Vertices.begin() + Data.Entries[i].BaseVertex,
+                 Data.Vertices.begin() + Data.Entries[i].BaseVertex + MeshVertices[i],
+                 Data.Vertices.begin() + NumKept);
+
+            Data.Entries[i].BaseVertex = NumKept;
+            NumKept += MeshVertices[i];
+        }
+
+        Data.Vertices.resize(NumKept);
+    }
+
+    CompileSkeleton(pScene, Data);
+
+    //if (!InitMaterials(pScene, Filename)) {
+    //    return false;
+    //}
+}
+
+
+void Scene::LoadSkeleton(const aiScene* pScene)
+{
+    Clear();
+
+    MeshData Data;
+    InitFromScene(pScene, Data);
+    InitBoneBounds(Data.Vertices.empty() ? NULL : &Data.Vertices[0], Data.Vertices.size(), Data);
+    InitSkeleton(Data);
+
+    if (m_KeepVertices) {
+        m_Vertices.swap(Data.Vertices);
+    }
+}
+
+
+void Scene::InitSkeleton(MeshData& Data)
+{
+    m_Entries.swap(Data.Entries);
+    m_BoneOffsets.swap(Data.BoneOffsets);
+    m_Skeleton = Data.Skel;
+    m_Animations.swap(Data.Animations);
+    m_EntryBounds.swap(Data.EntryBounds);
+    m_EntryBoundsFirst.swap(Data.EntryBoundsFirst);
+    m_NumBones = m_BoneOffsets.size();
+
+    InitInstance(m_Instance);
+    InitLods();
+    InitNodeReach();
+}
+
+
+void Scene::InitLods()
+{
+    // A level of the whole mesh is every entry at that level or, with
+    // fewer levels, its coarsest one
+    m_NumLods = 1;
+
+    for (uint i = 0 ; i < m_Entries.size() ; i++) {
+        m_NumLods = max(m_NumLods, min(m_Entries[i].NumLods, (uint)MAX_MESH_LODS));
+    }
+
+    for (uint l = 0 ; l < MAX_MESH_LODS ; l++) {
+        m_LodErrors[l] = 0.0f;
+
+        for (uint i = 0 ; i < m_Entries.size() ; i++) {
+            m_LodErrors[l] = max(m_LodErrors[l], m_Entries[i].Lods[min(l, m_Entries[i].NumLods - 1)].Error);
+        }
+    }
+
+    // Sphere around the box of the entries' spheres
+    aiVector3D Min(1e30f), Max(-1e30f);
+
+    for (uint i = 0 ; i < m_Entries.size() ; i++) {
+        for (uint k = 0 ; k < 3 ; k++) {
+            Min[k] = min(Min[k], m_Entries[i].Center[k] - m_Entries[i].Radius);
+            Max[k] = max(Max[k], m_Entries[i].Center[k] + m_Entries[i].Radius);
+        }
+    }
+
+    m_BoundCenter = m_Entries.empty() ? aiVector3D(0.0f, 0.0f, 0.0f) : 0.5f * (Min + Max);
+    m_BoundRadius = 0.0f;
+
+    for (uint i = 0 ; i < m_Entries.size() ; i++) {
+        m_BoundRadius = max(m_BoundRadius, (m_Entries[i].Center - m_BoundCenter).Length() + m_Entries[i].Radius);
+    }
+}
+
+
+void Scene::InitNodeReach()
+{
+    const uint NumNodes = m_Skeleton.NumNodes();
+    m_NodeReach.assign(NumNodes, 0.0f);
+    m_BindTransforms.resize(NumNodes);
+
+    for (uint i = 0 ; i < NumNodes ; i++) {
+        ComposeTRS(m_BindTransforms[i], m_Skeleton.BindPositions[i], m_Skeleton.BindRotations[i], m_Skeleton.BindScalings[i]);
+    }
+
+    // The vertices of a bone, whose boxes are in the space of its node
+    for (uint b = 0 ; b < m_EntryBounds.size() ; b++) {
+        const BoneBounds& Bounds = m_EntryBounds[b];
+
+        if (Bounds.Node >= 0) {
+            const aiVector3D& Min = Bounds.Bounds.Min;
+            const aiVector3D& Max = Bounds.Bounds.Max;
+            const aiVector3D Corner(max(fabsf(Min.x), fabsf(Max.x)), max(fabsf(Min.y), fabsf(Max.y)), max(fabsf(Min.z), fabsf(Max.z)));
+            m_NodeReach[Bounds.Node] = max(m_NodeReach[Bounds.Node], Corner.Length());
+        }
+    }
+
+    // Children follow their parents, so going backwards every subtree is
+    // done before its root. A child's reach is in its own, scaled space.
+    vector<float> Scales(NumNodes);
+
+    for (uint i = 0 ; i < NumNodes ; i++) {
+        const aiVector3D& s = m_Skeleton.BindScalings[i];
+        Scales[i] = max(max(fabsf(s.x), fabsf(s.y)), fabsf(s.z));
+    }
+
+    for (uint i = NumNodes ; i-- > 0 ; ) {
+        const int Parent = m_Skeleton.Parents[i];
+
+        if (Parent >= 0) {
+            m_NodeReach[Parent] = max(m_NodeReach[Parent], m_Skeleton.BindPositions[i].Length() + Scales[i] * m_NodeReach[i]);
+        }
+    }
+
+    // In the units of the model, a subtree never reaching further than
+    // the one it is part of
+    for (uint i = 0 ; i < NumNodes ; i++) {
+        const int Parent = m_Skeleton.Parents[i];
+
+        if (Parent >= 0) {
+            Scales[i] *= Scales[Parent];
+        }
+
+        m_NodeReach[i] *= Scales[i];
+    }
+}
+
+
+bool Scene::InitFromData(MeshData& Data, const SkinnedVertex* pVertices, uint NumVertices, const uint* pIndices, uint NumIndices)
+{
+    InitBoneBounds(pVertices, NumVertices, Data);
+    InitSkeleton(Data);
+
+    if (m_KeepVertices) {
+        m_Vertices.assign(pVertices, pVertices + NumVertices);
+    }
+
+    // Vertices and indices share one buffer, the indices start right after
+    // the vertices
+    m_PackedVertices = m_PackVertices && m_NumBones <= MAX_PACKED_BONES;
+
+    vector<PackedSkinnedVertex> PackedVertices;
+
+    if (m_PackedVertices) {
+        PackVertices(pVertices, NumVertices, PackedVertices);
+    }
+
+    const GLsizeiptr VertexSize = m_PackedVertices ? sizeof(PackedSkinnedVertex) * NumVertices : sizeof(SkinnedVertex) * NumVertices;
+    const GLsizeiptr IndexSize  = sizeof(uint) * NumIndices;
+
+    if (!m_PackedVertices && (const char*)pIndices == (const char*)pVertices + VertexSize) {
+        // Straight from the cache mapping
+        InitMeshBuffer(VertexSize, IndexSize, pVertices);
+    }
+    else {
+        InitMeshBuffer(VertexSize, IndexSize, NULL);
+
+        glBindBuffer(GL_ARRAY_BUFFER, m_Buffers[MESH_BUFFER]);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, VertexSize, m_PackedVertices ? (const GLvoid*)PackedVertices.data() : (const GLvoid*)pVertices);
+        glBufferSubData(GL_ARRAY_BUFFER, m_IndexOffset, IndexSize, pIndices);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    return GLCheckError();
+}
+
+
+// Creates the VAO and the buffers for a mesh buffer of the current vertex
+// layout, filled with pData or left undefined
+void Scene::InitMeshBuffer(GLsizeiptr VertexSize, GLsizeiptr IndexSize, const GLvoid* pData)
+{
+    glGenVertexArrays(1, &m_VAO);   
+    glBindVertexArray(m_VAO);
+
+    m_IndexOffset = VertexSize;
+
+    glGenBuffers(ARRAY_SIZE_IN_ELEMENTS(m_Buffers), m_Buffers);
+    glBindBuffer(GL_ARRAY_BUFFER, m_Buffers[MESH_BUFFER]);
+    glBufferData(GL_ARRAY_BUFFER, VertexSize + IndexSize, pData, GL_STATIC_DRAW);
+
+    InitVertexAttributes();
+    InitInstanceAttributes();
+    
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_Buffers[MESH_BUFFER]);
+
+    // Make sure the VAO is not changed from the outside
+    glBindVertexArray(0);   
+
+    InitIndirectCommands();
+}
+
+
+void Scene::InitVertexAttributes()
+{
+    glEnableVertexAttribArray(POSITION_LOCATION);
+    glEnableVertexAttribArray(NORMAL_LOCATION);
+    glEnableVertexAttribArray(BONE_ID_LOCATION);
+    glEnableVertexAttribArray(BONE_WEIGHT_LOCATION);    
+ //    glEnableVertexAttribArray(TEX_COORD_LOCATION);
+
+    if (m_PackedVertices) {
+        // The shader sees the same types either way: normals and weights are
+        // normalized to floats, the bone indices widened to ints
+        const GLsizei Stride = sizeof(PackedSkinnedVertex);
+        glVertexAttribPointer(POSITION_LOCATION, 3, GL_FLOAT, GL_FALSE, Stride, (const GLvoid*)offsetof(PackedSkinnedVertex, Position));    
+        glVertexAttribPointer(NORMAL_LOCATION, 4, GL_INT_2_10_10_10_REV, GL_TRUE, Stride, (const GLvoid*)offsetof(PackedSkinnedVertex, Normal));
+        glVertexAttribIPointer(BONE_ID_LOCATION, 4, GL_UNSIGNED_BYTE, Stride, (const GLvoid*)offsetof(PackedSkinnedVertex, BoneIDs));
+        glVertexAttribPointer(BONE_WEIGHT_LOCATION, 4, GL_UNSIGNED_SHORT, GL_TRUE, Stride, (const GLvoid*)offsetof(PackedSkinnedVertex, Weights));
+ //    glVertexAttribPointer(TEX_COORD_LOCATION, 2, GL_HALF_FLOAT, GL_FALSE, Stride, (const GLvoid*)offsetof(PackedSkinnedVertex, TexCoord));
+    }
+    else {
+        const GLsizei Stride = sizeof(SkinnedVertex);
+        glVertexAttribPointer(POSITION_LOCATION, 3, GL_FLOAT, GL_FALSE, Stride, (const GLvoid*)offsetof(SkinnedVertex, Position));    
+        glVertexAttribPointer(NORMAL_LOCATION, 3, GL_FLOAT, GL_FALSE, Stride, (const GLvoid*)offsetof(SkinnedVertex, Normal));
+        glVertexAttribIPointer(BONE_ID_LOCATION, 4, GL_INT, Stride, (const GLvoid*)offsetof(SkinnedVertex, Bones.IDs));
+        glVertexAttribPointer(BONE_WEIGHT_LOCATION, 4, GL_FLOAT, GL_FALSE, Stride, (const GLvoid*)offsetof(SkinnedVertex, Bones.Weights));
+ //    glVertexAttribPointer(TEX_COORD_LOCATION, 2, GL_FLOAT, GL_FALSE, Stride, (const GLvoid*)offsetof(SkinnedVertex, TexCoord));
+    }
+}
+
+
+// Points the instance attributes at FirstInstance in INSTANCE_BUFFER, which
+// is how the draws without base instance start at a level's instances
+void Scene::InitInstanceAttributes(uint FirstInstance)
+{
+    glBindBuffer(GL_ARRAY_BUFFER, m_Buffers[INSTANCE_BUFFER]);
+
+    const GLsizei Stride = sizeof(RenderInstance);
+    const size_t Offset = sizeof(RenderInstance) * FirstInstance;
+
+    for (uint i = 0 ; i < 3 ; i++) {
+        glVertexAttribPointer(INSTANCE_WORLD_LOCATION + i, 4, GL_FLOAT, GL_FALSE, Stride, 
+                              (const GLvoid*)(Offset + offsetof(RenderInstance, World) + sizeof(AffineRow) * i));
+        glVertexAttribDivisor(INSTANCE_WORLD_LOCATION + i, 1);
+    }
+
+    glVertexAttribIPointer(INSTANCE_PALETTE_LOCATION, 1, GL_INT, Stride, (const GLvoid*)(Offset + offsetof(RenderInstance, PaletteBase)));
+    glVertexAttribDivisor(INSTANCE_PALETTE_LOCATION, 1);
+
+    // The arrays are only enabled by the instanced Render
+}
+
+
+void Scene::InitIndirectCommands()
+{
+    // Group the commands by variant, so that each variant is one draw call
+    m_DrawOrder.clear();
+
+    for (uint v = 0 ; v < NUM_SKINNING_VARIANTS ; v++) {
+        m_VariantFirst[v] = m_DrawOrder.size();
+
+        for (uint i = 0 ; i < m_Entries.size() ; i++) {
+            if (m_Entries[i].Variant == v) {
+                m_DrawOrder.push_back(i);
+            }
+        }
+    }
+
+    m_VariantFirst[NUM_SKINNING_VARIANTS] = m_DrawOrder.size();
+
+    // Within a variant the commands of every level follow each other, so
+    // that a variant still is one call. Each level draws its own instances.
+    m_IndirectCommands.resize(m_DrawOrder.size() * m_NumLods);
+    ZERO_MEM(m_IndirectLodInstances);
+    m_IndirectEntryVisible.clear();
+
+    for (uint v = 0 ; v < NUM_SKINNING_VARIANTS ; v++) {
+        const uint First = m_VariantFirst[v];
+        const uint Count = m_VariantFirst[v + 1] - First;
+
+        for (uint l = 0 ; l < m_NumLods ; l++) {
+            for (uint i = 0 ; i < Count ; i++) {
+                const MeshEntry& Entry = m_Entries[m_DrawOrder[First + i]];
+                const MeshLod& Lod = Entry.Lods[min(l, Entry.NumLods - 1)];
+                DrawElementsIndirectCommand& Command = m_IndirectCommands[First * m_NumLods + l * Count + i];
+                Command.Count         = Lod.NumIndices;
+                Command.InstanceCount = 0;
+                // The element buffer is MESH_BUFFER itself, so the first index
+                // counts from the start of the vertices
+                Command.FirstIndex    = m_IndexOffset / sizeof(uint) + Lod.BaseIndex;
+                Command.BaseVertex    = Entry.BaseVertex;
+                Command.BaseInstance  = 0;
+            }
+        }
+    }
+
+    // Levels of detail past the first start at a non-zero base instance,
+    // which plain ARB_multi_draw_indirect requires to be zero
+    m_MultiDrawIndirect = !m_IndirectCommands.empty() && (GLEW_ARB_multi_draw_indirect || GLEW_VERSION_4_3) &&
+                          (m_NumLods == 1 || GLEW_ARB_base_instance || GLEW_VERSION_4_2);
+
+    if (m_MultiDrawIndirect) {
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_Buffers[INDIRECT_BUFFER]);
+        glBufferData(GL_DRAW_INDIRECT_BUFFER, sizeof(DrawElementsIndirectCommand) * m_IndirectCommands.size(), 
+                     &m_IndirectCommands[0], GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    }
+}
+
+
+void Scene::InitMesh(uint MeshIndex, const aiMesh* paiMesh, const uint* pBoneIndices, MeshData& Data) const
+{    
+    const aiVector3D Zero3D(0.0f, 0.0f, 0.0f);
+    SkinnedVertex* pVertices = &Data.Vertices[Data.Entries[MeshIndex].BaseVertex];
+    
+    // Populate the vertex attributes
+    for (uint i = 0 ; i < paiMesh->mNumVertices ; i++) {
+        const aiVector3D* pPos      = &(paiMesh->mVertices[i]);
+        const aiVector3D* pNormal   = &(paiMesh->mNormals[i]);
+        const aiVector3D* pTexCoord = paiMesh->HasTextureCoords(0) ? &(paiMesh->mTextureCoords[0][i]) : &Zero3D;
+
+        pVertices[i].Position = aiVector3D(pPos->x, pPos->y, pPos->z);
+        pVertices[i].Normal   = aiVector3D(pNormal->x, pNormal->y, pNormal->z);
+        pVertices[i].TexCoord = aiVector2D(pTexCoord->x, pTexCoord->y);        
+    }
+    
+    LoadBones(MeshIndex, paiMesh, pBoneIndices, Data);
+
+    // AddBoneData fills the slots in order, so the vertices blend as many
+    // bones as the last slot with a weight
+    uint NumInfluences = 0;
+
+    for (uint i = 0 ; i < paiMesh->mNumVertices ; i++) {
+        for (uint j = NUM_BONES_PER_VEREX ; j > NumInfluences ; j--) {
+            if (pVertices[i].Bones.Weights[j - 1] != 0.0f) {
+                NumInfluences = j;
+            }
+        }
+    }
+
+    Data.Entries[MeshIndex].Variant = VariantForInfluences(NumInfluences);
+    
+    // Populate the index buffer
+    uint* pIndices = Data.Entries[MeshIndex].NumIndices ? &Data.Indices[Data.Entries[MeshIndex].BaseIndex] : NULL;
+
+    for (uint i = 0 ; i < paiMesh->mNumFaces ; i++) {
+        const aiFace& Face = paiMesh->mFaces[i];
+        assert(Face.mNumIndices == 3);
+        pIndices[3 * i]     = Face.mIndices[0];
+        pIndices[3 * i + 1] = Face.mIndices[1];
+        pIndices[3 * i + 2] = Face.mIndices[2];
+    }
+}
+
+
+// pBoneIndices holds the index of each of the mesh's bones
+void Scene::LoadBones(uint MeshIndex, const aiMesh* pMesh, const uint* pBoneIndices, MeshData& Data) const
+{
+    SkinnedVertex* pVertices = &Data.Vertices[Data.Entries[MeshIndex].BaseVertex];
+
+    for (uint i = 0 ; i < pMesh->mNumBones ; i++) {                
+        const aiBone* pBone = pMesh->mBones[i];
+
+        for (uint j = 0 ; j < pBone->mNumWeights ; j++) {
+            pVertices[pBone->mWeights[j].mVertexId].Bones.AddBoneData(pBoneIndices[i], pBone->mWeights[j].mWeight);
+        }
+    }    
+}
+
+
+/*bool Scene::InitMaterials(const aiScene* pScene, const string& Filename)
+{
+    // Extract the directory part from the file name
+    string::size_type SlashIndex = Filename.find_last_of("/");
+    string Dir;
+
+    if (SlashIndex == string::npos) {
+        Dir = ".";
+    }
+    else if (SlashIndex == 0) {
+        Dir = "/";
+    }
+    else {
+        Dir = Filename.substr(0, SlashIndex);
+    }
+
+    bool Ret = true;
+
+    // Initialize the materials
+    for (uint i = 0 ; i < pScene->mNumMaterials ; i++) {
+        const aiMaterial* pMaterial = pScene->mMaterials[i];
+
+
+        if (pMaterial->GetTextureCount(aiTextureType_DIFFUSE) > 0) {
+            aiString Path;
+
+            if (pMaterial->GetTexture(aiTextureType_DIFFUSE, 0, &Path, NULL, NULL, NULL, NULL, NULL) == AI_SUCCESS) {
+                string p(Path.data);
+                
+                if (p.substr(0, 2) == ".\\") {                    
+                    p = p.substr(2, p.size() - 2);
+                }
+                               
+                string FullPath = Dir + "/" + p;
+                    
+                m_Textures[i] = new Texture(GL_TEXTURE_2D, FullPath.c_str());
+
+                if (!m_Textures[i]->Load()) {
+                    printf("Error loading texture '%s'\n", FullPath.c_str());
+                    delete m_Textures[i];
+                    m_Textures[i] = NULL;
+                    Ret = false;
+                }
+                else {
+                    printf("%d - loaded texture '%s'\n", i, FullPath.c_str());
+                }
+            }
+        }
+    }
+
+    return Ret;
+}*/
+
+
+void Scene::Render(const BoundingBox* pEntryBounds)
+{
+    PROFILE_SCOPE("Scene::Render");
+
+    // Half uploaded meshes are not drawn
+    if (Uploading()) {
+        return;
+    }
+
+    const RenderInstance Instance = { AffineMatrix(), 0 };
+    uint NumInstances = 1;
+    CullInstances(NumInstances, &Instance, pEntryBounds);
+
+    if (NumInstances == 0) {
+        ZERO_MEM(m_LodInstances);
+        return;
+    }
+
+    glBindVertexArray(m_VAO);
+
+    // A single character: the instance attributes take their current
+    // values, an identity world matrix and the first palette entry
+    for (uint i = 0 ; i < 3 ; i++) {
+        glDisableVertexAttribArray(INSTANCE_WORLD_LOCATION + i);
+    }
+    glDisableVertexAttribArray(INSTANCE_PALETTE_LOCATION);
+
+    glVertexAttrib4f(INSTANCE_WORLD_LOCATION + 0, 1.0f, 0.0f, 0.0f, 0.0f);
+    glVertexAttrib4f(INSTANCE_WORLD_LOCATION + 1, 0.0f, 1.0f, 0.0f, 0.0f);
+    glVertexAttrib4f(INSTANCE_WORLD_LOCATION + 2, 0.0f, 0.0f, 1.0f, 0.0f);
+    glVertexAttribI1i(INSTANCE_PALETTE_LOCATION, 0);
+
+    uint LodInstances[MAX_MESH_LODS] = {};
+    LodInstances[SelectLod(AffineMatrix())] = 1;
+    
+    DrawEntries(LodInstances);
+
+    // Make sure the VAO is not changed from the outside    
+    glBindVertexArray(0);
+}
+
+
+void Scene::Render(uint NumInstances, const RenderInstance* pInstances, const BoundingBox* pEntryBounds)
+{
+    PROFILE_SCOPE("Scene::Render");
+
+    if (NumInstances == 0 || Uploading()) {
+        return;
+    }
+
+    pInstances = CullInstances(NumInstances, pInstances, pEntryBounds);
+
+    if (NumInstances == 0) {
+        ZERO_MEM(m_LodInstances);
+        return;
+    }
+
+    // Group the instances by level of detail, each level is drawn from its
+    // own range of the instance buffer
+    uint LodInstances[MAX_MESH_LODS] = {};
+
+    if (m_NumLods > 1) {
+        vector<uint> Lods(NumInstances);
+        uint LodFirst[MAX_MESH_LODS];
+
+        for (uint i = 0 ; i < NumInstances ; i++) {
+            Lods[i] = SelectLod(pInstances[i].World);
+            LodInstances[Lods[i]]++;
+        }
+
+        LodFirst[0] = 0;
+
+        for (uint l = 1 ; l < MAX_MESH_LODS ; l++) {
+            LodFirst[l] = LodFirst[l - 1] + LodInstances[l - 1];
+        }
+
+        m_SortedInstances.resize(NumInstances);
+
+        for (uint i = 0 ; i < NumInstances ; i++) {
+            m_SortedInstances[LodFirst[Lods[i]]++] = pInstances[i];
+        }
+
+        pInstances = &m_SortedInstances[0];
+    }
+    else {
+        LodInstances[0] = NumInstances;
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, m_Buffers[INSTANCE_BUFFER]);
+
+    // Orphan the previous contents instead of waiting for the draws that
+    // still read them
+    if (NumInstances > m_MaxInstances) {
+        m_MaxInstances = NumInstances;
+    }
+
+    glBufferData(GL_ARRAY_BUFFER, sizeof(RenderInstance) * m_MaxInstances, NULL, GL_STREAM_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(RenderInstance) * NumInstances, pInstances);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    glBindVertexArray(m_VAO);
+
+    for (uint i = 0 ; i < 3 ; i++) {
+        glEnableVertexAttribArray(INSTANCE_WORLD_LOCATION + i);
+    }
+    glEnableVertexAttribArray(INSTANCE_PALETTE_LOCATION);
+
+    DrawEntries(LodInstances);
+
+    glBindVertexArray(0);
+}
+
+
+void Scene::SetVariantPrograms(const GLuint* pPrograms)
+{
+    for (uint i = 0 ; i < NUM_SKINNING_VARIANTS ; i++) {
+        m_VariantPrograms[i] = pPrograms ? pPrograms[i] : 0;
+    }
+}
+
+
+// Returns the instances with an entry in the frustum, leaving their number
+// in NumInstances, and marks the entries to draw in m_EntryVisible
+const RenderInstance* Scene::CullInstances(uint& NumInstances, const RenderInstance* pInstances, const BoundingBox* pEntryBounds)
+{
+    PROFILE_SCOPE("Scene::CullInstances");
+
+    const uint NumEntries = m_Entries.size();
+
+    if (!m_Cull || !pEntryBounds || NumEntries == 0) {
+        m_EntryVisible.assign(NumEntries, 1);
+        m_VisibleInstanceCount = NumInstances;
+        return pInstances;
+    }
+
+    // Every box is moved by its instance's world matrix, then all of them
+    // are tested in one batch
+    m_CullBoxes.resize(NumInstances * NumEntries);
+    m_CullVisible.resize(NumInstances * NumEntries);
+
+    for (uint i = 0 ; i < NumInstances ; i++) {
+        for (uint e = 0 ; e < NumEntries ; e++) {
+            m_CullBoxes[i * NumEntries + e] = TransformBounds(pInstances[i].World, pEntryBounds[i * NumEntries + e]);
+        }
+    }
+
+    CullBoxes(m_CullFrustum, &m_CullBoxes[0], m_CullBoxes.size(), &m_CullVisible[0]);
+
+    m_EntryVisible.assign(NumEntries, 0);
+    m_VisibleInstances.clear();
+
+    for (uint i = 0 ; i < NumInstances ; i++) {
+        const unsigned char* pVisible = &m_CullVisible[i * NumEntries];
+        bool Visible = false;
+
+        for (uint e = 0 ; e < NumEntries ; e++) {
+            m_EntryVisible[e] |= pVisible[e];
+            Visible = Visible || pVisible[e];
+        }
+
+        if (Visible) {
+            m_VisibleInstances.push_back(pInstances[i]);
+        }
+    }
+
+    NumInstances = m_VisibleInstances.size();
+    m_VisibleInstanceCount = NumInstances;
+
+    return m_VisibleInstances.empty() ? NULL : &m_VisibleInstances[0];
+}
+
+
+void Scene::SkinnedBounds(const AnimationInstance& Instance, BoundingBox* pEntryBounds) const
+{
+    const bool Posed = Instance.GlobalTransforms.size() == m_Skeleton.NumNodes();
+
+    for (uint e = 0 ; e < m_Entries.size() ; e++) {
+        BoundingBox& Box = pEntryBounds[e];
+        Box = BoundingBox();
+
+        if (!Posed || m_EntryBoundsFirst.empty()) {
+            const MeshEntry& Entry = m_Entries[e];
+            const aiVector3D Extent(Entry.Radius, Entry.Radius, Entry.Radius);
+            Box.Min = Entry.Center - Extent;
+            Box.Max = Entry.Center + Extent;
+            continue;
+        }
+
+        for (uint b = m_EntryBoundsFirst[e] ; b < m_EntryBoundsFirst[e + 1] ; b++) {
+            const BoneBounds& Bounds = m_EntryBounds[b];
+
+            if (Bounds.Node < 0) {
+                Box.Add(Bounds.Bounds);
+            }
+            else {
+                Box.Add(TransformBounds(Instance.GlobalTransforms[Bounds.Node], Bounds.Bounds));
+            }
+        }
+    }
+}
+
+
+// Pixels covered by one unit of the model at the instance, 0 without a
+// view or with the eye inside the instance's bounding sphere
+float Scene::ProjectedScale(const AffineMatrix& World) const
+{
+    if (m_LodPixelsPerUnit <= 0.0f) {
+        return 0.0f;
+    }
+
+    // Distance from the eye to the scaled bounding sphere of the instance
+    const glm::vec4 Row0 = World.Row(0), Row1 = World.Row(1), Row2 = World.Row(2);
+    const glm::vec4 Center(m_BoundCenter.x, m_BoundCenter.y, m_BoundCenter.z, 1.0f);
+    const aiVector3D Position(glm::dot(Row0, Center), glm::dot(Row1, Center), glm::dot(Row2, Center));
+    const float Scale = sqrtf(max(max(Row0.x * Row0.x + Row1.x * Row1.x + Row2.x * Row2.x,
+                                      Row0.y * Row0.y + Row1.y * Row1.y + Row2.y * Row2.y),
+                                  Row0.z * Row0.z + Row1.z * Row1.z + Row2.z * Row2.z));
+    const float Distance = (Position - m_LodEye).Length() - m_BoundRadius * Scale;
+
+    return Distance > 0.0f ? m_LodPixelsPerUnit * Scale / Distance : 0.0f;
+}
+
+
+uint Scene::SelectLod(const AffineMatrix& World) const
+{
+    if (m_NumLods == 1) {
+        return 0;
+    }
+
+    // Pixels covered by one unit of error
+    const float PixelsPerError = ProjectedScale(World);
+
+    if (PixelsPerError <= 0.0f) {
+        return 0;
+    }
+
+    uint Lod = 0;
+
+    while (Lod + 1 < m_NumLods && m_LodErrors[Lod + 1] * PixelsPerError <= m_LodMaxPixelError) {
+        Lod++;
+    }
+
+    return Lod;
+}
+
+
+void Scene::SelectAnimationLod(const AffineMatrix& World, AnimationJob& Job) const
+{
+    Job.UpdateInterval = 1;
+    Job.MinNodeReach   = 0.0f;
+
+    const float PixelsPerUnit = ProjectedScale(World);
+
+    if (PixelsPerUnit <= 0.0f) {
+        return;
+    }
+
+    Job.MinNodeReach = 0.5f * m_AnimationLod.MaxPixelError / PixelsPerUnit;
+
+    // Half the size, twice the interval
+    const float Size = 2.0f * m_BoundRadius * PixelsPerUnit;
+
+    if (Size < m_AnimationLod.FullRatePixels) {
+        const float Interval = min(m_AnimationLod.FullRatePixels / Size, (float)m_AnimationLod.MaxUpdateInterval);
+        Job.UpdateInterval = max(1u, (uint)Interval);
+    }
+}
+
+
+void Scene::DrawEntries(const uint* pLodInstances)
+{
+    const bool Indirect = MultiDrawIndirect();
+
+    if (Indirect) {
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_Buffers[INDIRECT_BUFFER]);
+
+        // The commands only change when the number of instances of some
+        // level or the culled entries do
+        if (!equal(pLodInstances, pLodInstances + m_NumLods, m_IndirectLodInstances) ||
+            m_EntryVisible != m_IndirectEntryVisible) {
+            for (uint v = 0 ; v < NUM_SKINNING_VARIANTS ; v++) {
+                const uint First = m_VariantFirst[v];
+                const uint Count = m_VariantFirst[v + 1] - First;
+                uint BaseInstance = 0;
+
+                for (uint l = 0 ; l < m_NumLods ; l++) {
+                    for (uint i = 0 ; i < Count ; i++) {
+                        DrawElementsIndirectCommand& Command = m_IndirectCommands[First * m_NumLods + l * Count + i];
+                        Command.InstanceCount = m_EntryVisible[m_DrawOrder[First + i]] ? pLodInstances[l] : 0;
+                        Command.BaseInstance  = BaseInstance;
+                    }
+
+                    BaseInstance += pLodInstances[l];
+                }
+            }
+
+            glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, sizeof(DrawElementsIndirectCommand) * m_IndirectCommands.size(), 
+                            &m_IndirectCommands[0]);
+            copy(pLodInstances, pLodInstances + MAX_MESH_LODS, m_IndirectLodInstances);
+            m_IndirectEntryVisible = m_EntryVisible;
+        }
+    }
+
+    copy(pLodInstances, pLodInstances + MAX_MESH_LODS, m_LodInstances);
+
+    bool InstancesMoved = false;
+
+    for (uint v = 0 ; v < NUM_SKINNING_VARIANTS ; v++) {
+        const uint First = m_VariantFirst[v];
+        const uint Count = m_VariantFirst[v + 1] - First;
+
+        if (Count == 0) {
+            continue;
+        }
+
+        if (m_VariantPrograms[v] != 0) {
+            glUseProgram(m_VariantPrograms[v]);
+        }
+
+        if (Indirect) {
+            glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (void*)(sizeof(DrawElementsIndirectCommand) * First * m_NumLods), 
+                                        Count * m_NumLods, 0);
+            continue;
+        }
+
+        // Fallback for contexts without multi-draw indirect
+        uint FirstInstance = 0;
+
+        for (uint l = 0 ; l < m_NumLods ; l++) {
+            if (pLodInstances[l] == 0) {
+                continue;
+            }
+
+            if (FirstInstance > 0 || InstancesMoved) {
+                InitInstanceAttributes(FirstInstance);
+                InstancesMoved = FirstInstance > 0;
+            }
+
+            for (uint i = First ; i < First + Count ; i++) {
+                if (!m_EntryVisible[m_DrawOrder[i]]) {
+                    continue;
+                }
+
+                const MeshEntry& Entry = m_Entries[m_DrawOrder[i]];
+                const MeshLod& Lod = Entry.Lods[min(l, Entry.NumLods - 1)];
+                const uint MaterialIndex = Entry.MaterialIndex;
+
+                //assert(MaterialIndex < m_Textures.size());
+                
+                //if (m_Textures[MaterialIndex]) {
+                //    m_Textures[MaterialIndex]->Bind(GL_TEXTURE0);
+                //}
+
+                glDrawElementsInstancedBaseVertex(GL_TRIANGLES, 
+                                                  Lod.NumIndices, 
+                                                  GL_UNSIGNED_INT, 
+                                                  (void*)(m_IndexOffset + sizeof(uint) * Lod.BaseIndex), 
+                                                  pLodInstances[l],
+                                                  Entry.BaseVertex);
+            }
+
+            FirstInstance += pLodInstances[l];
+        }
+    }
+
+    if (InstancesMoved) {
+        InitInstanceAttributes(0);
+    }
+
+    if (Indirect) {
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    }
+}
+
+
+void Scene::CompileSkeleton(const aiScene* pScene, MeshData& Data) const
+{
+    Data.Skel = Skeleton();
+    Data.Animations.clear();
+
+    vector<const aiNode*> Nodes;
+    CompileNode(pScene->mRootNode, -1, Nodes, Data, Data.Skel);
+
+    Data.Animations.resize(pScene->mNumAnimations);
+
+    for (uint i = 0 ; i < pScene->mNumAnimations ; i++) {
+        const aiAnimation* pAnimation = pScene->mAnimations[i];
+        AnimationClip& Clip = Data.Animations[i];
+
+        LoadAnimationClip(pAnimation, Clip);
+
+        // Resolve node -> channel once so that the per-frame evaluation
+        // never compares or hashes node names
+        unordered_map<string,uint> ChannelMapping;
+        ChannelMapping.reserve(pAnimation->mNumChannels);
+
+        for (uint j = 0 ; j < pAnimation->mNumChannels ; j++) {
+            ChannelMapping[string(pAnimation->mChannels[j]->mNodeName.data)] = j;
+        }
+
+        Clip.NodeChannels.resize(Nodes.size(), -1);
+
+        for (uint j = 0 ; j < Nodes.size() ; j++) {
+            unordered_map<string,uint>::const_iterator it = ChannelMapping.find(string(Nodes[j]->mName.data));
+
+            if (it != ChannelMapping.end()) {
+                Clip.NodeChannels[j] = it->second;
+            }
+        }
+    }
+}
+
+
+void Scene::CompileNode(const aiNode* pNode, int Parent, vector<const aiNode*>& Nodes, const MeshData& Data, Skeleton& Skel) const
+{
+    unordered_map<string,uint>::const_iterator it = Data.BoneMapping.find(string(pNode->mName.data));
+
+    const int NodeIndex = Nodes.size();
+    Nodes.push_back(pNode);
+
+    aiVector3D Position, Scaling;
+    aiQuaternion Rotation;
+    pNode->mTransformation.Decompose(Scaling, Rotation, Position);
+
+    Skel.Parents.push_back(Parent);
+    Skel.BoneIndices.push_back(it != Data.BoneMapping.end() ? (int)it->second : -1);
+    Skel.BindPositions.push_back(Position);
+    Skel.BindRotations.push_back(Rotation);
+    Skel.BindScalings.push_back(Scaling);
+    Skel.Names.push_back(pNode->mName.data);
+
+    for (uint i = 0 ; i < pNode->mNumChildren ; i++) {
+        CompileNode(pNode->mChildren[i], NodeIndex, Nodes, Data, Skel);
+    }
+}
+
+
+void Scene::InitInstance(AnimationInstance& Instance, uint AnimationIndex) const
+{
+    Instance.AnimationIndex    = AnimationIndex;
+    Instance.LastAnimationTime = 0.0f;
+    Instance.Cursors.assign(AnimationIndex < m_Animations.size() ? m_Animations[AnimationIndex].NumChannels() : 0, KeyframeCursor());
+    Instance.Pose.Positions = m_Skeleton.BindPositions;
+    Instance.Pose.Rotations = m_Skeleton.BindRotations;
+    Instance.Pose.Scalings  = m_Skeleton.BindScalings;
+    Instance.GlobalTransforms.resize(m_Skeleton.NumNodes());
+    Instance.UpdateInterval    = 0;
+    Instance.UpdateCountdown   = 0;
+}
+
+
+void Scene::InitLayerState(AnimationLayerState& State, uint AnimationIndex) const
+{
+    State.AnimationIndex    = AnimationIndex;
+    State.LastAnimationTime = 0.0f;
+    State.Cursors.assign(AnimationIndex < m_Animations.size() ? m_Animations[AnimationIndex].NumChannels() : 0, KeyframeCursor());
+    State.Pose.Positions = m_Skeleton.BindPositions;
+    State.Pose.Rotations = m_Skeleton.BindRotations;
+    State.Pose.Scalings  = m_Skeleton.BindScalings;
+    State.ReferenceIndex = -1;
+}
+
+
+// Nodes with a zero weight in pMask are skipped and keep their old values
+void Scene::SamplePose(const AnimationClip& Clip, float AnimationTime, float& LastAnimationTime,
+                       vector<KeyframeCursor>& Cursors, SkeletonPose& Pose, const float* pMask, float MinNodeReach) const
+{
+    // After a loop (or any backwards jump) restart the cursors at the first
+    // key, which is where forward playback continues from
+    if (AnimationTime < LastAnimationTime) {
+        Cursors.assign(Cursors.size(), KeyframeCursor());
+    }
+    LastAnimationTime = AnimationTime;
+
+    // Compressed clips search their shared timeline once for all channels
+    const uint Frame = Clip.IsCompressed() ? FindCompressedFrame(Clip.Compressed, AnimationTime) : 0;
+
+    for (uint i = 0 ; i < m_Skeleton.NumNodes() ; i++) {
+        // Pruned nodes are not read by CalcBoneTransforms
+        if ((pMask && pMask[i] <= 0.0f) || m_NodeReach[i] < MinNodeReach) {
+            continue;
+        }
+
+        const int Channel = Clip.NodeChannels[i];
+
+        if (Channel < 0) {
+            Pose.Positions[i] = m_Skeleton.BindPositions[i];
+            Pose.Rotations[i] = m_Skeleton.BindRotations[i];
+            Pose.Scalings[i]  = m_Skeleton.BindScalings[i];
+            continue;
+        }
+
+        if (Clip.IsCompressed()) {
+            SampleCompressedChannel(Clip.Compressed, Channel, Frame, AnimationTime, Cursors[Channel],
+                                    Pose.Positions[i], Pose.Rotations[i], Pose.Scalings[i]);
+        }
+        else {
+            SampleChannel(Clip.Channels[Channel], AnimationTime, Cursors[Channel],
+                          Pose.Positions[i], Pose.Rotations[i], Pose.Scalings[i]);
+        }
+    }
+}
+
+
+int Scene::FindNode(const string& Name) const
+{
+    for (uint i = 0 ; i < m_Skeleton.Names.size() ; i++) {
+        if (m_Skeleton.Names[i] == Name) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+
+bool Scene::CreateBoneMask(const string& NodeName, BoneMask& Mask, float Weight) const
+{
+    const int Root = FindNode(NodeName);
+    Mask.resize(m_Skeleton.NumNodes(), 0.0f);
+
+    if (Root < 0) {
+        return false;
+    }
+
+    // Nodes are stored depth first, so the subtree is the run of nodes
+    // after Root whose parents are inside it
+    Mask[Root] = Weight;
+
+    for (uint i = Root + 1 ; i < m_Skeleton.NumNodes() && m_Skeleton.Parents[i] >= Root ; i++) {
+        Mask[i] = Weight;
+    }
+
+    return true;
+}
+
+
+bool Scene::CompressAnimations(const ClipCompressionSettings& Settings)
+{
+    bool Ret = true;
+
+    for (uint i = 0 ; i < m_Animations.size() ; i++) {
+        Ret = CompressAnimationClip(m_Animations[i], Settings) && Ret;
+    }
+
+    return Ret;
+}
+
+
+static inline void StoreBoneTransform(AffineMatrix& Out, const AffineMatrix& GlobalTransformation, const AffineMatrix& Offset)
+{
+    MultiplyAffine(Out, GlobalTransformation, Offset);
+}
+
+
+static inline void StoreBoneTransform(DualQuaternion& Out, const AffineMatrix& GlobalTransformation, const AffineMatrix& Offset)
+{
+    AffineMatrix BoneTransformation;
+    MultiplyAffine(BoneTransformation, GlobalTransformation, Offset);
+    Out = DualQuaternion(BoneTransformation);
+}
+
+
+template <class T>
+void Scene::CalcBoneTransforms(const SkeletonPose& Pose, vector<AffineMatrix>& GlobalTransforms, T* pTransforms,
+                               float MinNodeReach) const
+{
+    const uint NumNodes = m_Skeleton.NumNodes();
+    const int* pParents = &m_Skeleton.Parents[0];
+    const int* pBoneIndices = &m_Skeleton.BoneIndices[0];
+
+    // Parents precede their children, so one forward pass suffices
+    for (uint i = 0 ; i < NumNodes ; i++) {
+        // Pruned nodes stay in their bind pose relative to their parent
+        AffineMatrix Composed;
+        const AffineMatrix* pNodeTransformation = &m_BindTransforms[i];
+
+        if (m_NodeReach[i] >= MinNodeReach) {
+            ComposeTRS(Composed, Pose.Positions[i], Pose.Rotations[i], Pose.Scalings[i]);
+            pNodeTransformation = &Composed;
+        }
+
+        const AffineMatrix& NodeTransformation = *pNodeTransformation;
+        AffineMatrix& GlobalTransformation = GlobalTransforms[i];
+
+        if (pParents[i] >= 0) {
+            MultiplyAffine(GlobalTransformation, GlobalTransforms[pParents[i]], NodeTransformation);
+        }
+        else {
+            GlobalTransformation = NodeTransformation;
+        }
+
+        if (pBoneIndices[i] >= 0) {
+            //pTransforms[BoneIndex] = m_GlobalInverseTransform * GlobalTransformation * m_BoneInfo[BoneIndex].BoneOffset;
+            StoreBoneTransform(pTransforms[pBoneIndices[i]], GlobalTransformation, m_BoneOffsets[pBoneIndices[i]]);
+        }
+    }
+}
+
+
+// The bones of global transforms evaluated before
+template <class T>
+void Scene::StoreBoneTransforms(const vector<AffineMatrix>& GlobalTransforms, T* pTransforms) const
+{
+    for (uint i = 0 ; i < m_Skeleton.NumNodes() ; i++) {
+        const int BoneIndex = m_Skeleton.BoneIndices[i];
+
+        if (BoneIndex >= 0) {
+            StoreBoneTransform(pTransforms[BoneIndex], GlobalTransforms[i], m_BoneOffsets[BoneIndex]);
+        }
+    }
+}
+
+
+void Scene::BoneTransform(float TimeInSeconds, vector<aiMatrix4x4>& Transforms)
+{
+    BoneTransform(m_Instance, TimeInSeconds, Transforms);
+}
+
+
+void Scene::BoneTransform(AnimationInstance& Instance, float TimeInSeconds, vector<aiMatrix4x4>& Transforms) const
+{
+    vector<AffineMatrix> AffineTransforms;
+    BoneTransform(Instance, TimeInSeconds, AffineTransforms);
+
+    Transforms.resize(m_NumBones);
+
+    for (uint i = 0 ; i < m_NumBones ; i++) {
+        Transforms[i] = AffineTransforms[i].ToMatrix4x4();
+    }
+}
+
+
+void Scene::BoneTransform(AnimationInstance& Instance, float TimeInSeconds, vector<AffineMatrix>& Transforms) const
+{
+    Transforms.resize(m_NumBones);
+
+    if (m_NumBones > 0) {
+        BoneTransform(Instance, TimeInSeconds, &Transforms[0]);
+    }
+}
+
+
+void Scene::BoneTransformBatch(const AnimationJob* pJobs, uint NumJobs, AffineMatrix* pTransforms, ThreadPool& Pool) const
+{
+    EvaluateBatch(pJobs, NumJobs, pTransforms, Pool);
+}
+
+
+void Scene::BoneTransformBatch(const AnimationJob* pJobs, uint NumJobs, DualQuaternion* pTransforms, ThreadPool& Pool) const
+{
+    EvaluateBatch(pJobs, NumJobs, pTransforms, Pool);
+}
+
+
+// Whether the job at Index is evaluated in this batch. The first batch
+// evaluates every instance, after that an instance waits Index % Interval
+// batches once so that the instances of one interval are spread out.
+static bool UpdateDue(AnimationInstance& Instance, uint Interval, uint Index)
+{
+    Interval = max(Interval, 1u);
+
+    if (Instance.UpdateInterval == 0) {
+        Instance.UpdateInterval  = Interval;
+        Instance.UpdateCountdown = Index % Interval;
+        return true;
+    }
+
+    // Coming closer never waits longer than the new interval
+    if (Instance.UpdateInterval != Interval) {
+        Instance.UpdateInterval  = Interval;
+        Instance.UpdateCountdown = min(Instance.UpdateCountdown, Index % Interval);
+    }
+
+    if (Instance.UpdateCountdown > 0) {
+        Instance.UpdateCountdown--;
+        return false;
+    }
+
+    Instance.UpdateCountdown = Interval - 1;
+    return true;
+}
+
+
+template <class T>
+void Scene::EvaluateBatch(const AnimationJob* pJobs, uint NumJobs, T* pTransforms, ThreadPool& Pool) const
+{
+    if (m_NumBones == 0) {
+        return;
+    }
+
+    // A few characters per chunk keep the scheduling overhead low while
+    // leaving enough chunks to balance uneven skeletons and clips
+    PROFILE_SCOPE("Scene::EvaluateBatch");
+
+    Pool.ParallelFor(NumJobs, 4, [&](uint Begin, uint End) {
+        PROFILE_SCOPE("evaluate chunk");
+
+        for (uint i = Begin ; i < End ; i++) {
+            const AnimationJob& Job = pJobs[i];
+            AnimationInstance& Instance = *Job.pInstance;
+            T* pJobTransforms = pTransforms + i * m_NumBones;
+
+            if (Job.NumLayers == 0 && Instance.AnimationIndex != Job.AnimationIndex) {
+                InitInstance(Instance, Job.AnimationIndex);
+            }
+            else if (Instance.GlobalTransforms.size() != m_Skeleton.NumNodes()) {
+                InitInstance(Instance, Instance.AnimationIndex);
+            }
+
+            if (!UpdateDue(Instance, Job.UpdateInterval, i)) {
+                StoreBoneTransforms(Instance.GlobalTransforms, pJobTransforms);
+                continue;
+            }
+
+            if (Job.NumLayers > 0) {
+                EvaluateLayers(Instance, Job.pLayers, Job.NumLayers, pJobTransforms, Job.MinNodeReach);
+            }
+            else {
+                EvaluateBones(Instance, Job.TimeInSeconds, pJobTransforms, Job.MinNodeReach);
+            }
+        }
+    });
+}
+
+
+void Scene::BoneTransform(AnimationInstance& Instance, float TimeInSeconds, AffineMatrix* pTransforms) const
+{
+    EvaluateBones(Instance, TimeInSeconds, pTransforms);
+}
+
+
+void Scene::BoneTransform(AnimationInstance& Instance, float TimeInSeconds, DualQuaternion* pTransforms) const
+{
+    EvaluateBones(Instance, TimeInSeconds, pTransforms);
+}
+
+
+template <class T>
+void Scene::EvaluateBones(AnimationInstance& Instance, float TimeInSeconds, T* pTransforms, float MinNodeReach) const
+{
+    if (m_NumBones == 0) {
+        return;
+    }
+
+    if (Instance.GlobalTransforms.size() != m_Skeleton.NumNodes()) {
+        InitInstance(Instance, Instance.AnimationIndex);
+    }
+
+    // Without animations the pose stays at the bind pose
+    if (Instance.AnimationIndex < m_Animations.size()) {
+        const AnimationClip& Clip = m_Animations[Instance.AnimationIndex];
+
+        if (Instance.Cursors.size() != Clip.NumChannels()) {
+            InitInstance(Instance, Instance.AnimationIndex);
+        }
+
+        SamplePose(Clip, Clip.AnimationTime(TimeInSeconds), Instance.LastAnimationTime, Instance.Cursors,
+                   Instance.Pose, NULL, MinNodeReach);
+    }
+
+    CalcBoneTransforms(Instance.Pose, Instance.GlobalTransforms, pTransforms, MinNodeReach);
+}
+
+
+void Scene::BoneTransform(AnimationInstance& Instance, const AnimationLayer* pLayers, uint NumLayers, AffineMatrix* pTransforms) const
+{
+    EvaluateLayers(Instance, pLayers, NumLayers, pTransforms);
+}
+
+
+void Scene::BoneTransform(AnimationInstance& Instance, const AnimationLayer* pLayers, uint NumLayers, DualQuaternion* pTransforms) const
+{
+    EvaluateLayers(Instance, pLayers, NumLayers, pTransforms);
+}
+
+
+// Normalized lerp along the shorter arc. Blend weights don't need the
+// constant speed of slerp, and it is several times cheaper.
+static inline aiQuaternion BlendRotation(const aiQuaternion& a, const aiQuaternion& b, float Weight)
+{
+    const float Dot = a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w;
+    const float wa = 1.0f - Weight, wb = Dot < 0.0f ? -Weight : Weight;
+
+    aiQuaternion Out(wa * a.w + wb * b.w, wa * a.x + wb * b.x, wa * a.y + wb * b.y, wa * a.z + wb * b.z);
+    return Out.Normalize();
+}
+
+
+// Moves Pose towards Layer by Weight (times the mask)
+static void BlendPose(SkeletonPose& Pose, const SkeletonPose& Layer, float Weight, const float* pMask)
+{
+    for (uint i = 0 ; i < Pose.Positions.size() ; i++) {
+        const float w = pMask ? Weight * pMask[i] : Weight;
+
+        if (w <= 0.0f) {
+            continue;
+        }
+
+        if (w >= 1.0f) {
+            Pose.Positions[i] = Layer.Positions[i];
+            Pose.Rotations[i] = Layer.Rotations[i];
+            Pose.Scalings[i]  = Layer.Scalings[i];
+            continue;
+        }
+
+        Pose.Positions[i] += w * (Layer.Positions[i] - Pose.Positions[i]);
+        Pose.Rotations[i] = BlendRotation(Pose.Rotations[i], Layer.Rotations[i], w);
+        Pose.Scalings[i]  += w * (Layer.Scalings[i] - Pose.Scalings[i]);
+    }
+}
+
+
+static inline float AddScaling(float Scaling, float Layer, float Reference, float Weight)
+{
+    return Reference != 0.0f ? Scaling * (1.0f + Weight * (Layer / Reference - 1.0f)) : Scaling;
+}
+
+
+// Applies the difference between Layer and Reference on top of Pose
+static void AddPose(SkeletonPose& Pose, const SkeletonPose& Layer, const SkeletonPose& Reference, float Weight,
+                    const float* pMask)
+{
+    const aiQuaternion Identity(1.0f, 0.0f, 0.0f, 0.0f);
+
+    for (uint i = 0 ; i < Pose.Positions.size() ; i++) {
+        const float w = pMask ? Weight * pMask[i] : Weight;
+
+        if (w <= 0.0f) {
+            continue;
+        }
+
+        aiQuaternion Delta = aiQuaternion(Reference.Rotations[i]).Conjugate() * Layer.Rotations[i];
+
+        if (w < 1.0f) {
+            Delta = BlendRotation(Identity, Delta, w);
+        }
+
+        const aiVector3D& s = Layer.Scalings[i];
+        const aiVector3D& r = Reference.Scalings[i];
+        aiVector3D& Scaling = Pose.Scalings[i];
+
+        Pose.Positions[i] += w * (Layer.Positions[i] - Reference.Positions[i]);
+        Pose.Rotations[i] = (Pose.Rotations[i] * Delta).Normalize();
+        Scaling = aiVector3D(AddScaling(Scaling.x, s.x, r.x, w), AddScaling(Scaling.y, s.y, r.y, w),
+                             AddScaling(Scaling.z, s.z, r.z, w));
+    }
+}
+
+
+template <class T>
+void Scene::EvaluateLayers(AnimationInstance& Instance, const AnimationLayer* pLayers, uint NumLayers, T* pTransforms,
+                           float MinNodeReach) const
+{
+    if (m_NumBones == 0) {
+        return;
+    }
+
+    if (Instance.GlobalTransforms.size() != m_Skeleton.NumNodes()) {
+        InitInstance(Instance, Instance.AnimationIndex);
+    }
+
+    SkeletonPose& Pose = Instance.Pose;
+    Pose.Positions = m_Skeleton.BindPositions;
+    Pose.Rotations = m_Skeleton.BindRotations;
+    Pose.Scalings  = m_Skeleton.BindScalings;
+
+    if (Instance.Layers.size() < NumLayers) {
+        Instance.Layers.resize(NumLayers);
+    }
+
+    for (uint i = 0 ; i < NumLayers ; i++) {
+        const AnimationLayer& Layer = pLayers[i];
+
+        if (Layer.AnimationIndex >= m_Animations.size() || Layer.Weight <= 0.0f) {
+            continue;
+        }
+
+        const AnimationClip& Clip = m_Animations[Layer.AnimationIndex];
+        AnimationLayerState& State = Instance.Layers[i];
+
+        if (State.AnimationIndex != Layer.AnimationIndex || State.Cursors.size() != Clip.NumChannels() ||
+            State.Pose.Positions.size() != m_Skeleton.NumNodes()) {
+            InitLayerState(State, Layer.AnimationIndex);
+        }
+
+        assert(!Layer.pMask || Layer.pMask->size() == m_Skeleton.NumNodes());
+        const float* pMask = Layer.pMask ? &(*Layer.pMask)[0] : NULL;
+
+        SamplePose(Clip, Clip.AnimationTime(Layer.TimeInSeconds), State.LastAnimationTime, State.Cursors,
+                   State.Pose, pMask, MinNodeReach);
+
+        if (Layer.Mode == ANIMATION_BLEND_ADDITIVE) {
+            if (State.ReferenceIndex != (int)Layer.AnimationIndex) {
+                vector<KeyframeCursor> Cursors(Clip.NumChannels());
+                float LastAnimationTime = 0.0f;
+
+                State.Reference = State.Pose;
+                SamplePose(Clip, 0.0f, LastAnimationTime, Cursors, State.Reference, NULL);
+                State.ReferenceIndex = Layer.AnimationIndex;
+            }
+
+            AddPose(Pose, State.Pose, State.Reference, Layer.Weight, pMask);
+        }
+        else {
+            BlendPose(Pose, State.Pose, Layer.Weight, pMask);
+        }
+    }
+
+    CalcBoneTransforms(Pose, Instance.GlobalTransforms, pTransforms, MinNodeReach);
+}
@@ -19,7 +19,9 @@
 #ifndef SCENE_H
 #define	SCENE_H
 #define ZERO_MEM(a) memset(a, 0, sizeof(a))
+#include <algorithm>
 #include <map>
+#include <unordered_map>
 #include <vector>
 #include <assert.h>
 #include <GL/glew.h>
@@ -29,12 +31,309 @@
 
 #include <iostream>
 
+#include "animation.h"
+#include "clip_compression.h"
+#include "culling.h"
+#include "pose_math.h"
+#include "thread_pool.h"
+
 //#include "ogldev_util.h"
 //#include "ogldev_math_3d.h"
 //#include "ogldev_texture.h"
 
 using namespace std;
 
+// Node hierarchy flattened at load time. Nodes are stored in topological
+// (pre-)order so every parent precedes its children and a pose can be
+// evaluated with a single linear loop instead of a recursive aiNode walk.
+struct Skeleton
+{
+    vector<int> Parents;                // -1 for the root
+    vector<int> BoneIndices;            // -1 if the node drives no bone
+    vector<aiVector3D> BindPositions;   // local bind pose, decomposed from mTransformation
+    vector<aiQuaternion> BindRotations;
+    vector<aiVector3D> BindScalings;
+    vector<string> Names;
+
+    uint NumNodes() const
+    {
+        return Parents.size();
+    }
+};
+
+#define NUM_BONES_PER_VEREX 4
+
+struct VertexBoneData
+{        
+    uint IDs[NUM_BONES_PER_VEREX];
+    float Weights[NUM_BONES_PER_VEREX];
+
+    VertexBoneData()
+    {
+        Reset();
+    };
+    
+    void Reset()
+    {
+        ZERO_MEM(IDs);
+        ZERO_MEM(Weights);        
+    }
+    
+    void AddBoneData(uint BoneID, float Weight);
+};
+
+// Interleaved vertex, 64 bytes
+struct SkinnedVertex
+{
+    aiVector3D Position;
+    aiVector3D Normal;
+    aiVector2D TexCoord;
+    VertexBoneData Bones;
+};
+
+// Packed alternative to SkinnedVertex for the GPU, 32 bytes: snorm
+// 2_10_10_10 normal, half float texcoords, 8-bit bone indices and 16-bit
+// unorm weights. Only usable with at most 256 bones.
+struct PackedSkinnedVertex
+{
+    aiVector3D Position;
+    GLuint Normal;
+    GLushort TexCoord[2];
+    GLubyte BoneIDs[NUM_BONES_PER_VEREX];
+    GLushort Weights[NUM_BONES_PER_VEREX];
+};
+
+#define MAX_PACKED_BONES 256
+
+#define INVALID_MATERIAL 0xFFFFFFFF
+
+// Layout of one command in a GL_DRAW_INDIRECT_BUFFER
+struct DrawElementsIndirectCommand
+{
+    GLuint Count;
+    GLuint InstanceCount;
+    GLuint FirstIndex;      // in indices from the start of the buffer
+    GLint  BaseVertex;
+    GLuint BaseInstance;
+};
+
+// Per-instance vertex attributes of an instanced draw
+struct RenderInstance
+{
+    AffineMatrix World;     // applied before the modelMatrix uniform
+    GLint PaletteBase;      // first bone of the instance in the bone palette
+};
+
+// Vertex shader variants, cheapest first: how many bones are blended per
+// vertex, none for rigid meshes. Every mesh entry is drawn with the
+// cheapest variant that covers all of its vertices.
+enum SkinningVariant {
+    SKINNING_RIGID,
+    SKINNING_1_BONE,
+    SKINNING_2_BONES,
+    SKINNING_4_BONES,
+    NUM_SKINNING_VARIANTS
+};
+
+// The BONE_INFLUENCES value a variant's shader is compiled with
+uint SkinningVariantInfluences(SkinningVariant Variant);
+
+#define MAX_MESH_LODS 4
+
+// One level of detail of a mesh entry, a range of the shared index buffer
+// over the entry's vertices
+struct MeshLod
+{
+    unsigned int NumIndices;
+    unsigned int BaseIndex;
+    float Error;                // largest deviation from the full mesh, in model units
+};
+
+struct MeshEntry {
+    MeshEntry()
+    {
+        NumIndices    = 0;
+        BaseVertex    = 0;
+        BaseIndex     = 0;
+        MaterialIndex = INVALID_MATERIAL;
+        Variant       = SKINNING_4_BONES;
+        NumLods       = 1;
+        ZERO_MEM(Lods);
+        Radius        = 0.0f;
+    }
+    
+    unsigned int NumIndices;
+    unsigned int BaseVertex;
+    unsigned int BaseIndex;
+    unsigned int MaterialIndex;
+    unsigned int Variant;       // SkinningVariant
+    unsigned int NumLods;
+    MeshLod Lods[MAX_MESH_LODS];  // Lods[0] is the full mesh, NumIndices at BaseIndex
+    aiVector3D Center;          // bounding sphere of the vertices
+    float Radius;
+};
+
+// Box around the vertices of a mesh entry influenced by one bone, in the
+// space of the bone (bone offset * position), so that the skinned box only
+// needs the node's global transform. Node is -1 for the box of the
+// vertices drawn in their bind pose.
+struct BoneBounds
+{
+    int Node;
+    BoundingBox Bounds;
+};
+
+// Everything LoadMesh extracts from a file before touching GL, which is
+// also what the mesh cache stores
+struct MeshData
+{
+    vector<SkinnedVertex> Vertices;
+    vector<uint> Indices;
+    vector<MeshEntry> Entries;
+    vector<AffineMatrix> BoneOffsets;
+    Skeleton Skel;
+    vector<AnimationClip> Animations;
+    unordered_map<string,uint> BoneMapping;   // bone name -> index, only used while importing
+    vector<BoneBounds> EntryBounds;           // built at every load, not cached
+    vector<uint> EntryBoundsFirst;            // first box of each entry, one more than entries
+};
+
+// Result of Scene::ImportMesh, ready to be uploaded
+struct ImportedMesh
+{
+    MeshData Data;
+    bool Packed;                // Buffer holds PackedSkinnedVertex vertices
+    vector<char> Buffer;        // contents of the mesh buffer, vertices then indices
+    GLsizeiptr VertexSize;      // bytes of vertices in Buffer
+};
+
+// Local space transforms of every skeleton node (structure-of-arrays)
+struct SkeletonPose
+{
+    vector<aiVector3D> Positions;
+    vector<aiQuaternion> Rotations;
+    vector<aiVector3D> Scalings;
+};
+
+// Per node weights of an AnimationLayer, see Scene::CreateBoneMask
+typedef vector<float> BoneMask;
+
+enum AnimationBlendMode {
+    ANIMATION_BLEND_OVERRIDE,   // moves the pose towards the clip by the layer weight
+    ANIMATION_BLEND_ADDITIVE    // adds the weighted difference between the clip and its first frame
+};
+
+// One clip contributing to a blended pose. Layers are applied in order,
+// starting from the bind pose. A crossfade from A to B is A at weight 1
+// followed by B at the fade amount; a blend of several clips gives every
+// override layer its weight divided by the sum of its own and all earlier
+// weights.
+struct AnimationLayer
+{
+    uint AnimationIndex;
+    float TimeInSeconds;
+    float Weight;
+    AnimationBlendMode Mode;
+    const BoneMask* pMask;      // NULL for every node
+
+    AnimationLayer()
+    {
+        AnimationIndex = 0;
+        TimeInSeconds  = 0.0f;
+        Weight         = 1.0f;
+        Mode           = ANIMATION_BLEND_OVERRIDE;
+        pMask          = NULL;
+    }
+};
+
+// Sampling state of one layer of an AnimationInstance
+struct AnimationLayerState
+{
+    uint AnimationIndex;
+    float LastAnimationTime;
+    vector<KeyframeCursor> Cursors;
+    SkeletonPose Pose;
+    int ReferenceIndex;         // clip sampled into Reference, -1 if none
+    SkeletonPose Reference;     // first frame of the clip, for additive layers
+
+    AnimationLayerState()
+    {
+        AnimationIndex    = 0;
+        LastAnimationTime = 0.0f;
+        ReferenceIndex    = -1;
+    }
+};
+
+// Playback state of one animated character. Everything that changes from
+// frame to frame lives here, so many instances can share one Scene.
+struct AnimationInstance
+{
+    uint AnimationIndex;
+    float LastAnimationTime;
+    vector<KeyframeCursor> Cursors;  // one per channel of the playing animation
+    SkeletonPose Pose;
+    vector<AffineMatrix> GlobalTransforms;
+    vector<AnimationLayerState> Layers;  // used when evaluating layers
+    uint UpdateInterval;        // of the last batch, 0 until evaluated by one
+    uint UpdateCountdown;       // batches left before the next evaluation
+
+    AnimationInstance()
+    {
+        AnimationIndex    = 0;
+        LastAnimationTime = 0.0f;
+        UpdateInterval    = 0;
+        UpdateCountdown   = 0;
+    }
+};
+
+// One character to evaluate in a batch. Every job needs its own instance.
+// With layers the job is blended from them and AnimationIndex and
+// TimeInSeconds are ignored.
+//
+// A job with an UpdateInterval of N is only evaluated in every Nth batch,
+// the batches in between writing the bones of its last pose again. The
+// instances of a batch take turns by their job index, so that only about
+// 1 / N of them are evaluated in any one batch. Nodes whose subtree
+// reaches less than MinNodeReach from them keep their bind pose (see
+// Scene::SelectAnimationLod).
+struct AnimationJob
+{
+    AnimationInstance* pInstance;
+    uint AnimationIndex;
+    float TimeInSeconds;
+    const AnimationLayer* pLayers;
+    uint NumLayers;
+    uint UpdateInterval;
+    float MinNodeReach;
+
+    AnimationJob()
+    {
+        pInstance      = NULL;
+        AnimationIndex = 0;
+        TimeInSeconds  = 0.0f;
+        pLayers        = NULL;
+        NumLayers      = 0;
+        UpdateInterval = 1;
+        MinNodeReach   = 0.0f;
+    }
+};
+
+// How Scene::SelectAnimationLod reduces the animation of small characters
+struct AnimationLodSettings
+{
+    float MaxPixelError;        // furthest a node left in its bind pose may move its vertices on screen
+    float FullRatePixels;       // characters at least this tall on screen are evaluated every batch
+    uint MaxUpdateInterval;
+
+    // Everything in full
+    AnimationLodSettings()
+    {
+        MaxPixelError     = 0.0f;
+        FullRatePixels    = 0.0f;
+        MaxUpdateInterval = 1;
+    }
+};
+
 class Scene
 {
 public:
@@ -42,110 +341,359 @@ public:
 
     ~Scene();
 
-    bool LoadMesh(const string& Filename);
+    // With a CacheFilename the imported data is written to that file, and
+    // later loads of the same (unchanged) source map it instead of running
+    // the Assimp import
+    bool LoadMesh(const string& Filename, const string& CacheFilename = "");
+
+    // Takes the bones, skeleton and animations of an imported scene without
+    // creating any GL objects, for tools and benchmarks that only animate
+    void LoadSkeleton(const aiScene* pScene);
+
+    // The part of LoadMesh that doesn't need GL: reads the cache or imports
+    // and flattens the file, writing the cache if needed, and lays out the
+    // mesh buffer. Only reads the vertex settings of the Scene, so it can
+    // run on any thread while the Scene keeps rendering.
+    bool ImportMesh(const string& Filename, const string& CacheFilename, ImportedMesh& Mesh) const;
+
+    // Replaces the loaded mesh with Mesh (which is emptied) and creates its
+    // GL objects, leaving the mesh buffer to ContinueUpload. Render draws
+    // nothing until the upload is done.
+    bool BeginUpload(ImportedMesh& Mesh);
+
+    // Uploads at most Budget bytes of the pending mesh buffer and subtracts
+    // them from Budget. Returns true once nothing is left.
+    bool ContinueUpload(size_t& Budget);
+
+    bool Uploading() const
+    {
+        return m_UploadOffset < m_UploadBuffer.size();
+    }
+
+    // With a cull frustum set, pEntryBounds (one box per mesh entry, see
+    // SkinnedBounds) skips the entries outside of it
+    void Render(const BoundingBox* pEntryBounds = NULL);
+
+    // Draws every mesh entry once for all NumInstances instances. Each
+    // instance reads its bones from the palette starting at PaletteBase,
+    // so the palettes of a whole crowd can share one buffer.
+    //
+    // With a cull frustum set and pEntryBounds, which then holds the boxes
+    // of every entry for every instance, instance after instance, only the
+    // instances with an entry in the frustum are drawn, and only the
+    // entries in the frustum for at least one of them.
+    void Render(uint NumInstances, const RenderInstance* pInstances, const BoundingBox* pEntryBounds = NULL);
+
+    // Frustum Render culls against, in the space the instance world
+    // matrices transform to (e.g. projection * view * modelMatrix). NULL,
+    // the default, turns culling off.
+    void SetCullFrustum(const Frustum* pFrustum)
+    {
+        m_Cull = pFrustum != NULL;
+
+        if (pFrustum) {
+            m_CullFrustum = *pFrustum;
+        }
+    }
+
+    // Instances drawn by the last Render, after culling
+    uint VisibleInstances() const
+    {
+        return m_VisibleInstanceCount;
+    }
+
+    // Writes one box per mesh entry to pEntryBounds around the entry's
+    // vertices as skinned (with linear blending) by the pose Instance was
+    // last evaluated in by BoneTransform or BoneTransformBatch, in the
+    // space of the mesh. Only costs a transformed box per bone of each
+    // entry. Instances without a skeleton pose get the boxes of the bind
+    // pose bounding spheres.
+    void SkinnedBounds(const AnimationInstance& Instance, BoundingBox* pEntryBounds) const;
+
+    uint NumEntries() const
+    {
+        return m_Entries.size();
+    }
+
+    // Selects the vertex layout used by the next LoadMesh. Packed vertices
+    // are half the size but fall back to the full layout for skeletons
+    // with more than MAX_PACKED_BONES bones.
+    void SetPackedVertices(bool Packed)
+    {
+        m_PackVertices = Packed;
+    }
+
+    // Whether the loaded mesh actually uses packed vertices
+    bool PackedVertices() const
+    {
+        return m_PackedVertices;
+    }
+
+    // Welds duplicate vertices and reorders the triangles and vertices of
+    // every mesh entry for the post-transform cache and vertex fetch during
+    // the next import (see OptimizeMesh). Off by default.
+    void SetOptimizeMeshes(bool Optimize)
+    {
+        m_OptimizeMeshes = Optimize;
+    }
+
+    // Number of levels of detail the next import builds for every mesh
+    // entry, the full mesh included, each with about half the triangles of
+    // the one before (see SimplifyMesh). 1, the default, builds none.
+    void SetMeshLods(uint NumLods)
+    {
+        m_MeshLods = max(1u, min(NumLods, (uint)MAX_MESH_LODS));
+    }
+
+    // Threads the imports spread large meshes over, owned by the caller.
+    // A pool runs one loop at a time, so an import on another thread holds
+    // up the loops of the render thread (BoneTransformBatch, CullInstances)
+    // for as long as it simplifies: give imports running alongside frames a
+    // pool of their own. NULL, the default, imports on the calling thread.
+    void SetImportPool(ThreadPool* pPool)
+    {
+        m_pImportPool = pPool;
+    }
+
+    // Levels of detail of the loaded mesh
+    uint NumLods() const
+    {
+        return m_NumLods;
+    }
+
+    // Where Render looks from when it picks the level of detail of every
+    // instance. Eye is in the space the instance world matrices transform
+    // to, before the modelMatrix uniform, and PixelsPerUnit the projected
+    // size of one unit at distance one (viewport height / (2 tan(fovy / 2))).
+    // Instances get the coarsest level whose error projects to at most
+    // MaxPixelError pixels. Without a view everything is drawn in full.
+    void SetLodView(const aiVector3D& Eye, float PixelsPerUnit, float MaxPixelError = 1.0f)
+    {
+        m_LodEye           = Eye;
+        m_LodPixelsPerUnit = PixelsPerUnit;
+        m_LodMaxPixelError = MaxPixelError;
+    }
+
+    // Instances drawn at Lod by the last Render
+    uint LodInstances(uint Lod) const
+    {
+        return m_LodInstances[Lod];
+    }
+
+    // Animation level of detail for SelectAnimationLod
+    void SetAnimationLod(const AnimationLodSettings& Settings)
+    {
+        m_AnimationLod = Settings;
+    }
+
+    // Sets the UpdateInterval and MinNodeReach of Job for an instance at
+    // World, seen from the LOD view (see SetLodView). Rotating a subtree
+    // moves its vertices by at most twice its reach, so the nodes reaching
+    // less than half of MaxPixelError on screen keep their bind pose,
+    // moving their vertices rigidly with the nearest evaluated ancestor as
+    // if their weights had been collapsed into it. Characters smaller than
+    // FullRatePixels are evaluated less often, down to every
+    // MaxUpdateInterval batches.
+    void SelectAnimationLod(const AffineMatrix& World, AnimationJob& Job) const;
+
+    // How far the subtree of Node and the vertices of its bones reach from
+    // it in the bind pose, in model units. Never more than its parent's.
+    float NodeReach(uint Node) const
+    {
+        return m_NodeReach[Node];
+    }
 
-    void Render();
+    // Keeps a copy of the bind pose vertices on the CPU after the next
+    // LoadMesh or LoadSkeleton, e.g. for CpuSkinning
+    void SetKeepVertices(bool Keep)
+    {
+        m_KeepVertices = Keep;
+    }
+
+    const vector<SkinnedVertex>& Vertices() const
+    {
+        return m_Vertices;
+    }
+
+    // With multi-draw indirect (GL 4.3 or ARB_multi_draw_indirect) all mesh
+    // entries are submitted with one call from commands written at load
+    // time, otherwise with one draw per entry. Disabling it forces the loop.
+    void SetMultiDrawIndirect(bool Enabled)
+    {
+        m_UseMultiDrawIndirect = Enabled;
+    }
+
+    // Whether Render currently submits with multi-draw indirect
+    bool MultiDrawIndirect() const
+    {
+        return m_UseMultiDrawIndirect && m_MultiDrawIndirect;
+    }
+
+    // Programs indexed by SkinningVariant. Once set, Render draws the mesh
+    // entries of each variant with its program and leaves the last one
+    // bound. Otherwise everything is drawn with the current program, which
+    // then has to blend four bones.
+    void SetVariantPrograms(const GLuint* pPrograms);
+
+    // Mesh entries drawn with Variant
+    uint NumEntries(SkinningVariant Variant) const
+    {
+        return m_VariantFirst[Variant + 1] - m_VariantFirst[Variant];
+    }
 	
     uint NumBones() const
     {
         return m_NumBones;
     }
     
-    void BoneTransform(float TimeInSeconds, vector<aiMatrix4x4>& Transforms);
-    
-private:
-    #define NUM_BONES_PER_VEREX 4
+    uint NumAnimations() const
+    {
+        return m_Animations.size();
+    }
 
-    struct BoneInfo
+    const AnimationClip& Animation(uint Index) const
     {
-        aiMatrix4x4 BoneOffset;
-        aiMatrix4x4 FinalTransformation;        
+        return m_Animations[Index];
+    }
 
-        BoneInfo()
-        {
-            //BoneOffset.SetZero();
-            //FinalTransformation.SetZero();            
-        }
-    };
-    
-    struct VertexBoneData
-    {        
-        uint IDs[NUM_BONES_PER_VEREX];
-        float Weights[NUM_BONES_PER_VEREX];
-
-        VertexBoneData()
-        {
-            Reset();
-        };
-        
-        void Reset()
-        {
-            ZERO_MEM(IDs);
-            ZERO_MEM(Weights);        
-        }
-        
-        void AddBoneData(uint BoneID, float Weight);
-    };
+    // Index of the skeleton node called Name, -1 if there is none
+    int FindNode(const string& Name) const;
+
+    // Sets the weight of the node called NodeName and everything below it
+    // to Weight, leaving the rest of Mask (zero when new) as it is, so masks
+    // for several parts of the body can be built up. Returns false if there
+    // is no such node.
+    bool CreateBoneMask(const string& NodeName, BoneMask& Mask, float Weight = 1.0f) const;
+
+    // Replaces the keys of every animation with their compressed form (see
+    // CompressAnimationClip), which is then decoded while sampling. Returns
+    // false if some animation had to stay uncompressed.
+    bool CompressAnimations(const ClipCompressionSettings& Settings);
+
+    void InitInstance(AnimationInstance& Instance, uint AnimationIndex = 0) const;
+
+    void BoneTransform(float TimeInSeconds, vector<aiMatrix4x4>& Transforms);
+
+    void BoneTransform(AnimationInstance& Instance, float TimeInSeconds, vector<aiMatrix4x4>& Transforms) const;
+
+    void BoneTransform(AnimationInstance& Instance, float TimeInSeconds, vector<AffineMatrix>& Transforms) const;
+
+    // Writes NumBones() matrices to pTransforms, e.g. a mapped palette buffer
+    void BoneTransform(AnimationInstance& Instance, float TimeInSeconds, AffineMatrix* pTransforms) const;
+
+    // Same with dual quaternions for dual quaternion skinning. Bones must
+    // not be scaled.
+    void BoneTransform(AnimationInstance& Instance, float TimeInSeconds, DualQuaternion* pTransforms) const;
+
+    // Evaluates NumJobs characters across the pool and writes NumBones()
+    // bones per job, job after job, to pTransforms. Only the instances
+    // and the output are written, so the Scene can be shared by any number
+    // of threads once it is loaded.
+    void BoneTransformBatch(const AnimationJob* pJobs, uint NumJobs, AffineMatrix* pTransforms, ThreadPool& Pool) const;
 
-    void CalcInterpolatedScaling(aiVector3D& Out, float AnimationTime, const aiNodeAnim* pNodeAnim);
-    void CalcInterpolatedRotation(aiQuaternion& Out, float AnimationTime, const aiNodeAnim* pNodeAnim);
-    void CalcInterpolatedPosition(aiVector3D& Out, float AnimationTime, const aiNodeAnim* pNodeAnim);    
-    uint FindScaling(float AnimationTime, const aiNodeAnim* pNodeAnim);
-    uint FindRotation(float AnimationTime, const aiNodeAnim* pNodeAnim);
-    uint FindPosition(float AnimationTime, const aiNodeAnim* pNodeAnim);
-    const aiNodeAnim* FindNodeAnim(const aiAnimation* pAnimation, const string NodeName);
-    void ReadNodeHeirarchy(float AnimationTime, const aiNode* pNode, const aiMatrix4x4& ParentTransform);
-    bool InitFromScene(const aiScene* pScene, const string& Filename);
-    void InitMesh(uint MeshIndex,
-                  const aiMesh* paiMesh,
-                  vector<aiVector3D>& Positions,
-                  vector<aiVector3D>& Normals,
-                  vector<aiVector2D>& TexCoords,
-                  vector<VertexBoneData>& Bones,
-                  vector<unsigned int>& Indices);
-    void LoadBones(uint MeshIndex, const aiMesh* paiMesh, vector<VertexBoneData>& Bones);
+    void BoneTransformBatch(const AnimationJob* pJobs, uint NumJobs, DualQuaternion* pTransforms, ThreadPool& Pool) const;
+
+    // Samples every layer into its own local pose, blends the local poses
+    // and only then runs the hierarchy pass once, so the cost grows with
+    // layers times nodes rather than with full evaluations. Writes
+    // NumBones() transforms to pTransforms.
+    void BoneTransform(AnimationInstance& Instance, const AnimationLayer* pLayers, uint NumLayers, AffineMatrix* pTransforms) const;
+
+    void BoneTransform(AnimationInstance& Instance, const AnimationLayer* pLayers, uint NumLayers, DualQuaternion* pTransforms) const;
+    
+private:
+    void SamplePose(const AnimationClip& Clip, float AnimationTime, float& LastAnimationTime,
+                    vector<KeyframeCursor>& Cursors, SkeletonPose& Pose, const float* pMask, float MinNodeReach = 0.0f) const;
+    void InitLayerState(AnimationLayerState& State, uint AnimationIndex) const;
+    template <class T> void EvaluateBones(AnimationInstance& Instance, float TimeInSeconds, T* pTransforms, float MinNodeReach = 0.0f) const;
+    template <class T> void EvaluateLayers(AnimationInstance& Instance, const AnimationLayer* pLayers, uint NumLayers, T* pTransforms,
+                                           float MinNodeReach = 0.0f) const;
+    template <class T> void EvaluateBatch(const AnimationJob* pJobs, uint NumJobs, T* pTransforms, ThreadPool& Pool) const;
+    template <class T> void CalcBoneTransforms(const SkeletonPose& Pose, vector<AffineMatrix>& GlobalTransforms, T* pTransforms,
+                                               float MinNodeReach = 0.0f) const;
+    template <class T> void StoreBoneTransforms(const vector<AffineMatrix>& GlobalTransforms, T* pTransforms) const;
+    void CompileSkeleton(const aiScene* pScene, MeshData& Data) const;
+    void CompileNode(const aiNode* pNode, int Parent, vector<const aiNode*>& Nodes, const MeshData& Data, Skeleton& Skel) const;
+    bool ImportScene(const string& Filename, const string& CacheFilename, uint64_t SourceHash, MeshData& Data) const;
+    uint64_t CacheSeed() const;
+    void InitFromScene(const aiScene* pScene, MeshData& Data) const;
+    void InitMesh(uint MeshIndex, const aiMesh* paiMesh, const uint* pBoneIndices, MeshData& Data) const;
+    void LoadBones(uint MeshIndex, const aiMesh* paiMesh, const uint* pBoneIndices, MeshData& Data) const;
     bool InitMaterials(const aiScene* pScene, const string& Filename);
+    bool InitFromData(MeshData& Data, const SkinnedVertex* pVertices, uint NumVertices, const uint* pIndices, uint NumIndices);
+    void InitSkeleton(MeshData& Data);
+    void InitMeshBuffer(GLsizeiptr VertexSize, GLsizeiptr IndexSize, const GLvoid* pData);
+    void InitVertexAttributes();
+    void InitInstanceAttributes(uint FirstInstance = 0);
+    void InitIndirectCommands();
+    void InitLods();
+    void InitNodeReach();
+    float ProjectedScale(const AffineMatrix& World) const;
+    uint SelectLod(const AffineMatrix& World) const;
+    const RenderInstance* CullInstances(uint& NumInstances, const RenderInstance* pInstances, const BoundingBox* pEntryBounds);
+    void DrawEntries(const uint* pLodInstances);
     void Clear();
-
-#define INVALID_MATERIAL 0xFFFFFFFF
   
 enum VB_TYPES {
-    INDEX_BUFFER,
-    POS_VB,
-    NORMAL_VB,
-    TEXCOORD_VB,
-    BONE_VB,
+    MESH_BUFFER,    // interleaved vertices followed by the indices
+    INSTANCE_BUFFER,
+    INDIRECT_BUFFER,
     NUM_VBs            
 };
 
     GLuint m_VAO;
     GLuint m_Buffers[NUM_VBs];
-
-    struct MeshEntry {
-        MeshEntry()
-        {
-            NumIndices    = 0;
-            BaseVertex    = 0;
-            BaseIndex     = 0;
-            MaterialIndex = INVALID_MATERIAL;
-        }
-        
-        unsigned int NumIndices;
-        unsigned int BaseVertex;
-        unsigned int BaseIndex;
-        unsigned int MaterialIndex;
-    };
+    GLsizeiptr m_IndexOffset;  // byte offset of the indices in MESH_BUFFER
+    uint m_MaxInstances;       // capacity of INSTANCE_BUFFER
+    bool m_UseMultiDrawIndirect;
+    bool m_MultiDrawIndirect;  // supported and INDIRECT_BUFFER written
+    vector<DrawElementsIndirectCommand> m_IndirectCommands;  // copy of INDIRECT_BUFFER
+    vector<uint> m_DrawOrder;  // mesh entries grouped by variant
+    uint m_VariantFirst[NUM_SKINNING_VARIANTS + 1];  // first entry of each variant in m_DrawOrder
+    uint m_NumLods;
+    float m_LodErrors[MAX_MESH_LODS];  // largest error of any entry at each level
+    aiVector3D m_BoundCenter;          // bounding sphere of all the entries
+    float m_BoundRadius;
+    aiVector3D m_LodEye;
+    float m_LodPixelsPerUnit;          // 0 without a view
+    float m_LodMaxPixelError;
+    uint m_LodInstances[MAX_MESH_LODS];  // instances of each level in the last draw
+    uint m_IndirectLodInstances[MAX_MESH_LODS];  // instances of each level in INDIRECT_BUFFER
+    vector<RenderInstance> m_SortedInstances;  // instances grouped by level
+    AnimationLodSettings m_AnimationLod;
+    bool m_Cull;
+    Frustum m_CullFrustum;
+    vector<BoundingBox> m_CullBoxes;           // entry boxes of every instance in the last draw
+    vector<unsigned char> m_CullVisible;
+    vector<RenderInstance> m_VisibleInstances;
+    vector<unsigned char> m_EntryVisible;      // per entry, drawn by the last Render
+    vector<unsigned char> m_IndirectEntryVisible;  // entries drawn by INDIRECT_BUFFER
+    uint m_VisibleInstanceCount;
+    GLuint m_VariantPrograms[NUM_SKINNING_VARIANTS];
+    bool m_PackVertices;
+    bool m_OptimizeMeshes;
+    uint m_MeshLods;
+    ThreadPool* m_pImportPool;
+    bool m_PackedVertices;
+    bool m_KeepVertices;
+    vector<SkinnedVertex> m_Vertices;
+    vector<char> m_UploadBuffer;    // mesh buffer contents still being uploaded
+    size_t m_UploadOffset;
     
     vector<MeshEntry> m_Entries;
+    vector<BoneBounds> m_EntryBounds;
+    vector<uint> m_EntryBoundsFirst;
     //vector<Texture*> m_Textures;
      
-    map<string,uint> m_BoneMapping; // maps a bone name to its index
     uint m_NumBones;
-    vector<BoneInfo> m_BoneInfo;
+    vector<AffineMatrix> m_BoneOffsets;
+
+    Skeleton m_Skeleton;
+    vector<float> m_NodeReach;         // per node, how far its subtree and vertices reach from it
+    vector<AffineMatrix> m_BindTransforms;  // local bind pose of every node
+    vector<AnimationClip> m_Animations;
+    AnimationInstance m_Instance;  // used by the single character BoneTransform
     //aiMatrix4x4 m_GlobalInverseTransform;
-    
-    const aiScene* m_pScene;
-    Assimp::Importer m_Importer;
 };
 
 
@@ -0,0 +1,111 @@
+#include "thread_pool.h"
+
+ThreadPool::ThreadPool(int NumWorkers)
+{
+    m_Generation = 0;
+    m_Busy       = 0;
+    m_Quit       = false;
+    m_pFunc      = NULL;
+    m_Count      = 0;
+    m_Grain      = 1;
+    m_Next       = 0;
+
+    if (NumWorkers < 0) {
+        NumWorkers = (int)thread::hardware_concurrency() - 1;
+    }
+
+    for (int i = 0 ; i < NumWorkers ; i++) {
+        m_Workers.push_back(thread(&ThreadPool::WorkerMain, this));
+    }
+}
+
+
+ThreadPool::~ThreadPool()
+{
+    {
+        lock_guard<mutex> Lock(m_Mutex);
+        m_Quit = true;
+    }
+    m_WorkReady.notify_all();
+
+    for (uint i = 0 ; i < m_Workers.size() ; i++) {
+        m_Workers[i].join();
+    }
+}
+
+
+void ThreadPool::ParallelFor(uint Count, uint Grain, const function<void(uint, uint)>& Func)
+{
+    if (Count == 0) {
+        return;
+    }
+
+    if (Grain == 0) {
+        Grain = 1;
+    }
+
+    // Not worth waking anybody up for a single chunk
+    if (m_Workers.empty() || Count <= Grain) {
+        Func(0, Count);
+        return;
+    }
+
+    lock_guard<mutex> LoopLock(m_LoopMutex);
+
+    {
+        lock_guard<mutex> Lock(m_Mutex);
+        m_pFunc = &Func;
+        m_Count = Count;
+        m_Grain = Grain;
+        m_Next  = 0;
+        m_Busy  = m_Workers.size();
+        m_Generation++;
+    }
+    m_WorkReady.notify_all();
+
+    RunChunks();
+
+    unique_lock<mutex> Lock(m_Mutex);
+    m_WorkDone.wait(Lock, [this] { return m_Busy == 0; });
+    m_pFunc = NULL;
+}
+
+
+void ThreadPool::RunChunks()
+{
+    for (;;) {
+        uint Begin = m_Next.fetch_add(m_Grain);
+
+        if (Begin >= m_Count) {
+            break;
+        }
+
+        (*m_pFunc)(Begin, min(Begin + m_Grain, m_Count));
+    }
+}
+
+
+void ThreadPool::WorkerMain()
+{
+    uint Generation = 0;
+
+    for (;;) {
+        {
+            unique_lock<mutex> Lock(m_Mutex);
+            m_WorkReady.wait(Lock, [&] { return m_Quit || m_Generation != Generation; });
+
+            if (m_Quit) {
+                return;
+            }
+            Generation = m_Generation;
+        }
+
+        RunChunks();
+
+        {
+            lock_guard<mutex> Lock(m_Mutex);
+            m_Busy--;
+        }
+        m_WorkDone.notify_one();
+    }
+}
@@ -0,0 +1,54 @@
+#ifndef THREAD_POOL_H
+#define	THREAD_POOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+// Fixed set of worker threads for data parallel loops. The calling thread
+// takes part in every loop, so a pool with 0 workers runs loops inline.
+class ThreadPool
+{
+public:
+    // NumWorkers defaults to one less than the number of hardware threads
+    explicit ThreadPool(int NumWorkers = -1);
+
+    ~ThreadPool();
+
+    uint NumThreads() const
+    {
+        return m_Workers.size() + 1;
+    }
+
+    // Calls Func(Begin, End) on chunks of at most Grain items until
+    // [0, Count) is covered and returns once all chunks are done. Loops
+    // started from several threads run one after the other; they must not
+    // be started from inside Func.
+    void ParallelFor(uint Count, uint Grain, const function<void(uint, uint)>& Func);
+
+private:
+    void WorkerMain();
+    void RunChunks();
+
+    vector<thread> m_Workers;
+    mutex m_LoopMutex;     // held by the thread running the current loop
+    mutex m_Mutex;
+    condition_variable m_WorkReady;
+    condition_variable m_WorkDone;
+    uint m_Generation;     // incremented for every loop
+    uint m_Busy;           // workers still inside the current loop
+    bool m_Quit;
+
+    const function<void(uint, uint)>* m_pFunc;
+    uint m_Count;
+    uint m_Grain;
+    atomic<uint> m_Next;
+};
+
+#endif	/* THREAD_POOL_H */
@@ -8,7 +8,10 @@
 // -----------------------------------------------------------------------------
 
 #include "utils.hpp"
+#include <cstdio>
+#include <cstring>
 #include <stdexcept>
+#include <stdint.h>
 
 GLuint loadShader(GLenum type, std::string const& s)
 {
@@ -31,7 +34,8 @@ GLuint loadShader(GLenum type, std::string const& s)
   return id;
 }
 
-GLuint createProgram(std::string const& v, std::string const& f)
+static GLuint linkProgram(std::string const& v, std::string const& f,
+    bool retrievable)
 {
   GLuint id = glCreateProgram();
 
@@ -43,6 +47,9 @@ GLuint createProgram(std::string const& v, std::string const& f)
   glDeleteShader(vsHandle);
   glDeleteShader(fsHandle);
 
+  if (retrievable)
+    glProgramParameteri(id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+
   glLinkProgram(id);
   GLint successful;
 
@@ -58,6 +65,170 @@ GLuint createProgram(std::string const& v, std::string const& f)
   return id;
 }
 
+GLuint createProgram(std::string const& v, std::string const& f)
+{
+  return linkProgram(v, f, false);
+}
+
+// Program cache file: the header, then the binary
+#define PROGRAM_CACHE_MAGIC "GLPROGC1"
+
+struct ProgramCacheHeader
+{
+  char magic[8];
+  uint64_t key;
+  GLenum format;
+  GLint size;
+};
+
+// 64-bit FNV-1a of a string and its terminating zero, so that
+// consecutive strings can't run into each other
+static uint64_t hashString(const char* s, uint64_t hash)
+{
+  do {
+    hash ^= static_cast<unsigned char>(*s);
+    hash *= 1099511628211ULL;
+  } while (*s++);
+  return hash;
+}
+
+// A binary is only valid for the driver that produced it
+static uint64_t programKey(std::string const& v, std::string const& f)
+{
+  const GLenum driverStrings[] = { GL_VENDOR, GL_RENDERER, GL_VERSION,
+      GL_SHADING_LANGUAGE_VERSION };
+  uint64_t key = 14695981039346656037ULL;
+
+  for (unsigned i = 0; i < sizeof(driverStrings) / sizeof(driverStrings[0]); ++i) {
+    const GLubyte* s = glGetString(driverStrings[i]);
+    key = hashString(s ? reinterpret_cast<const char*>(s) : "", key);
+  }
+
+  key = hashString(v.c_str(), key);
+  return hashString(f.c_str(), key);
+}
+
+static bool programBinarySupported()
+{
+  if (!GLEW_VERSION_4_1 && !GLEW_ARB_get_program_binary)
+    return false;
+
+  GLint numFormats = 0;
+  glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &numFormats);
+  return numFormats > 0;
+}
+
+// 0 if cacheFile doesn't hold a usable binary for key
+static GLuint loadProgramBinary(std::string const& cacheFile, uint64_t key)
+{
+  std::ifstream in(cacheFile.c_str(), std::ios::binary);
+  ProgramCacheHeader header;
+
+  if (!in.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+      memcmp(header.magic, PROGRAM_CACHE_MAGIC, sizeof(header.magic)) != 0 ||
+      header.key != key || header.size <= 0)
+    return 0;
+
+  std::vector<char> binary(header.size);
+  if (!in.read(&binary[0], binary.size()))
+    return 0;
+
+  // The driver may still reject the binary, e.g. after an update that
+  // didn't change its version string
+  GLuint id = glCreateProgram();
+  glProgramBinary(id, header.format, &binary[0], header.size);
+
+  GLint successful;
+  glGetProgramiv(id, GL_LINK_STATUS, &successful);
+  if (!successful) {
+    glDeleteProgram(id);
+
+    // An unknown format leaves GL_INVALID_ENUM behind, which must not be
+    // blamed on the compile from source that follows
+    while (glGetError() != GL_NO_ERROR)
+      ;
+    return 0;
+  }
+  return id;
+}
+
+// Writes through a temporary file, so readers never see a partial binary
+static bool storeProgramBinary(GLuint id, std::string const& cacheFile,
+    uint64_t key)
+{
+  GLint size = 0;
+  glGetProgramiv(id, GL_PROGRAM_BINARY_LENGTH, &size);
+  if (size <= 0)
+    return false;
+
+  ProgramCacheHeader header;
+  memcpy(header.magic, PROGRAM_CACHE_MAGIC, sizeof(header.magic));
+  header.key = key;
+
+  std::vector<char> binary(size);
+  glGetProgramBinary(id, size, &header.size, &header.format, &binary[0]);
+  if (header.size <= 0)
+    return false;
+
+  const std::string tempFile = cacheFile + ".tmp";
+
+  {
+    std::ofstream out(tempFile.c_str(), std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(&binary[0], header.size);
+
+    if (!out) {
+      std::remove(tempFile.c_str());
+      return false;
+    }
+  }
+
+  return std::rename(tempFile.c_str(), cacheFile.c_str()) == 0;
+}
+
+GLuint createProgram(std::string const& v, std::string const& f,
+    std::string const& cacheFile)
+{
+  if (cacheFile.empty() || !programBinarySupported())
+    return createProgram(v, f);
+
+  const uint64_t key = programKey(v, f);
+
+  GLuint id = loadProgramBinary(cacheFile, key);
+  if (id)
+    return id;
+
+  id = linkProgram(v, f, true);
+  storeProgramBinary(id, cacheFile, key);
+  return id;
+}
+
+// #version has to stay the first directive
+static std::string addDefines(std::string const& source,
+    std::vector<std::string> const& defines)
+{
+  std::string block;
+  for (unsigned i = 0; i < defines.size(); ++i)
+    block += "#define " + defines[i] + "\n";
+
+  std::string::size_type pos = source.find("#version");
+  if (pos == std::string::npos)
+    return block + source;
+
+  pos = source.find('\n', pos);
+  if (pos == std::string::npos)
+    return source + "\n" + block;
+
+  return source.substr(0, pos + 1) + block + source.substr(pos + 1);
+}
+
+GLuint createProgram(std::string const& v, std::string const& f,
+    std::vector<std::string> const& defines, std::string const& cacheFile)
+{
+  return createProgram(addDefines(v, defines), addDefines(f, defines),
+      cacheFile);
+}
+
 GLuint createTexture2D(unsigned const& width, unsigned const& height,
     const char* data)
 {
@@ -17,6 +17,7 @@
 #include <streambuf>
 #include <cerrno>
 #include <iostream>
+#include <vector>
 
 // Read a small text file.
 inline std::string readFile(std::string const& file)
@@ -32,6 +33,18 @@ inline std::string readFile(std::string const& file)
 
 GLuint loadShader(GLenum type, std::string const& s);
 GLuint createProgram(std::string const& v, std::string const& f);
+// Like createProgram, but loads the program binary an earlier run stored in
+// cacheFile when it was built from the same sources by the same driver, and
+// stores the linked binary there otherwise. Compiles from source whenever
+// the cached binary is missing, stale or rejected.
+GLuint createProgram(std::string const& v, std::string const& f,
+    std::string const& cacheFile);
+// Compiles a variant of the sources: every entry of defines ("NAME" or
+// "NAME VALUE") becomes a #define line right after the #version directive
+// of both shaders. The defines are part of the sources the program cache
+// is keyed by, so each variant needs a cache file of its own.
+GLuint createProgram(std::string const& v, std::string const& f,
+    std::vector<std::string> const& defines, std::string const& cacheFile = "");
 GLuint createTexture2D(unsigned const& width, unsigned const& height,
     const char* data);
 GLuint createTexture3D(unsigned const& width, unsigned const& height,
@@ -1,29 +1,108 @@
 #version 330
 
+// Specialized by defines inserted after the version line:
+//   BONE_INFLUENCES           bones blended per vertex: 0 (rigid), 1, 2 or 4
+//   DUAL_QUATERNION_SKINNING  the palette holds dual quaternions instead of
+//                             matrices
+#ifndef BONE_INFLUENCES
+#define BONE_INFLUENCES 4
+#endif
+
+// With packed vertices the normal arrives as snorm 2_10_10_10, the bone
+// indices as bytes and the weights as unorm shorts; the types seen here
+// are the same
 layout(location = 0) in vec3 position;
 layout(location = 1) in vec3 normal;
 
 layout(location = 2) in ivec4 BoneIDs;
 layout(location = 3) in vec4 Weights;
 
+// Per-instance rows of the world matrix and first palette bone. Outside of
+// instanced draws these hold an identity matrix and 0.
+layout(location = 4) in vec4 InstanceWorld0;
+layout(location = 5) in vec4 InstanceWorld1;
+layout(location = 6) in vec4 InstanceWorld2;
+layout(location = 7) in int InstancePaletteBase;
+
 uniform mat4 projMatrix;
 uniform mat4 viewMatrix;
 uniform mat4 modelMatrix;
 
-uniform mat4 gBones[100];
- 
+// Bone palette starting at texel gPaletteOffset: three RGBA32F texels per
+// bone holding the rows of a 3x4 affine matrix, or with dual quaternion
+// skinning two holding the real (rotation) and dual (translation) part of
+// a unit dual quaternion
+uniform samplerBuffer gBonePalette;
+uniform int gPaletteOffset;
+
 out vec4 vertexPos;
 out vec3 Normal;
- 
+
+#ifdef DUAL_QUATERNION_SKINNING
+
+vec4 BonePart(int Bone, int Part)
+{
+    return texelFetch(gBonePalette, gPaletteOffset + (InstancePaletteBase + Bone) * 2 + Part);
+}
+
+#else
+
+vec4 BoneRow(int Bone, int Row)
+{
+    return texelFetch(gBonePalette, gPaletteOffset + (InstancePaletteBase + Bone) * 3 + Row);
+}
+
+#endif
+
 void main()
 {
-    mat4 BoneTransform = gBones[BoneIDs[0]] * Weights[0];
-    BoneTransform += gBones[BoneIDs[1]] * Weights[1];
-    BoneTransform += gBones[BoneIDs[2]] * Weights[2];
-    BoneTransform += gBones[BoneIDs[3]] * Weights[3];
+#if BONE_INFLUENCES == 0
+    // Rigid meshes are drawn in their bind pose
+    vec4 skinnedPosition = vec4(position, 1.0);
+    vec3 skinnedNormal = normal;
+#elif defined(DUAL_QUATERNION_SKINNING)
+    // q and -q are the same rotation: blend every bone in the hemisphere of
+    // the first one so that opposite signs don't cancel out
+    vec4 Real0 = BonePart(BoneIDs[0], 0);
+    vec4 Real = Real0 * Weights[0];
+    vec4 Dual = BonePart(BoneIDs[0], 1) * Weights[0];
+
+    for (int i = 1 ; i < BONE_INFLUENCES ; i++) {
+        vec4 RealI = BonePart(BoneIDs[i], 0);
+        float Weight = dot(Real0, RealI) < 0.0 ? -Weights[i] : Weights[i];
+        Real += RealI * Weight;
+        Dual += BonePart(BoneIDs[i], 1) * Weight;
+    }
+
+    float Length = length(Real);
+    Real /= Length;
+    Dual /= Length;
+
+    // Rotate by Real, then translate by 2 * Dual * conjugate(Real)
+    vec3 Rotated = position + 2.0 * cross(Real.xyz, cross(Real.xyz, position) + Real.w * position);
+    vec3 Translation = 2.0 * (Real.w * Dual.xyz - Dual.w * Real.xyz + cross(Real.xyz, Dual.xyz));
+
+    vec4 skinnedPosition = vec4(Rotated + Translation, 1.0);
+    vec3 skinnedNormal = normal + 2.0 * cross(Real.xyz, cross(Real.xyz, normal) + Real.w * normal);
+#else
+    // Blend the rows of the bone matrices
+    vec4 Row0 = BoneRow(BoneIDs[0], 0) * Weights[0];
+    vec4 Row1 = BoneRow(BoneIDs[0], 1) * Weights[0];
+    vec4 Row2 = BoneRow(BoneIDs[0], 2) * Weights[0];
+
+    for (int i = 1 ; i < BONE_INFLUENCES ; i++) {
+        Row0 += BoneRow(BoneIDs[i], 0) * Weights[i];
+        Row1 += BoneRow(BoneIDs[i], 1) * Weights[i];
+        Row2 += BoneRow(BoneIDs[i], 2) * Weights[i];
+    }
+
+    vec4 skinnedPosition = vec4(dot(Row0, vec4(position, 1.0)), dot(Row1, vec4(position, 1.0)), dot(Row2, vec4(position, 1.0)), 1.0);
+    vec3 skinnedNormal = vec3(dot(Row0.xyz, normal), dot(Row1.xyz, normal), dot(Row2.xyz, normal));
+#endif
 
+    mat4 worldMatrix = modelMatrix * transpose(mat4(InstanceWorld0, InstanceWorld1, InstanceWorld2, vec4(0.0, 0.0, 0.0, 1.0)));
 
-    Normal = normalize(vec3(viewMatrix * modelMatrix * BoneTransform * vec4(normal,0.0)));
+    Normal = normalize(vec3(viewMatrix * worldMatrix * vec4(skinnedNormal, 0.0)));
 	//TexCoord = vec2(texCoord);
-    gl_Position = projMatrix * viewMatrix * modelMatrix * BoneTransform * vec4(position,1.0);
-}
\ No newline at end of file
+    gl_Position = projMatrix * viewMatrix * worldMatrix * skinnedPosition;
+}